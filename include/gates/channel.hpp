@@ -40,8 +40,12 @@
 
 #include "qasmtools/utils/angle.hpp"
 
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
 #include <iostream>
 #include <map>
+#include <optional>
 #include <unordered_map>
 #include <variant>
 #include <vector>
@@ -52,26 +56,18 @@ namespace gates {
 namespace utils = qasmtools::utils;
 
 /**
- * \struct staq::gates::ChannelRepr
- * \brief Gates in the channel representation parameterized by an argument type
- *
- * Decouples the gates and gate logic from the representation of their
- * arguments.
- *
- * \tparam qarg The type of arguments to gates. Must have an overload for both <
- * and std::hash
+ * \struct staq::gates::ChannelBase
+ * \brief Single-qubit Paulis and Pauli phases, independent of the argument type
  */
-template <typename qarg>
-struct ChannelRepr {
-
+struct ChannelBase {
     /**
-     * \class staq::gates::ChannelRepr::PauliOp
+     * \class staq::gates::ChannelBase::PauliOp
      * \brief The single qubit Pauli group
      */
     enum class PauliOp : unsigned short { i = 0, x = 1, z = 2, y = 3 };
 
     /**
-     * \class staq::gates::ChannelRepr::IPhase
+     * \class staq::gates::ChannelBase::IPhase
      * \brief Pauli global phases (powers of i)
      */
     enum class IPhase : unsigned short {
@@ -217,6 +213,20 @@ struct ChannelRepr {
                     (static_cast<unsigned short>(q) << 2));
         return commute_table[idx % 16];
     }
+};
+
+/**
+ * \struct staq::gates::ChannelRepr
+ * \brief Gates in the channel representation parameterized by an argument type
+ *
+ * Decouples the gates and gate logic from the representation of their
+ * arguments.
+ *
+ * \tparam qarg The type of arguments to gates. Must have an overload for both <
+ * and std::hash
+ */
+template <typename qarg>
+struct ChannelRepr : ChannelBase {
 
     /**
      * \class staq::gates::ChannelRepr::Pauli
@@ -719,5 +729,600 @@ struct ChannelRepr {
     }
 };
 
+/**
+ * \struct staq::gates::ChannelRepr<int>
+ * \brief Gates in the channel representation over dense qubit indices
+ *
+ * Paulis are stored in symplectic form as packed X and Z bit vectors, 64
+ * qubits per word, so that multiplication and commutation are word-wide
+ * bitwise operations. Cliffords are stored as a stabilizer tableau, giving
+ * the images of \f$X_q\f$ and \f$Z_q\f$ for each qubit q acted on.
+ */
+template <>
+struct ChannelRepr<int> : ChannelBase {
+    using word = std::uint64_t;
+    static constexpr int word_bits = 64;
+
+    /**
+     * \class staq::gates::ChannelRepr<int>::Pauli
+     * \brief Class representing an multi-qubit pauli operator
+     *
+     * A qubit with only its X (resp. Z) bit set carries X (resp. Z), and one
+     * with both bits set carries Y
+     */
+    class Pauli {
+      public:
+        /** @name Constructors */
+        /**@{*/
+        /** \brief Default constructor */
+        Pauli() = default;
+        /** \brief Constructs a Pauli from a qubit, PauliOp pair */
+        Pauli(std::pair<int, PauliOp> gate) { set(gate.first, gate.second); }
+        /** \brief Constructs a multi-qubit Pauli given a hash map from qubits
+         * to PauliOps */
+        Pauli(const std::unordered_map<int, PauliOp>& pauli) {
+            for (auto& [q, p] : pauli)
+                set(q, p);
+        }
+        /**@}*/
+
+        /** @name Smart constructors */
+        /**@{*/
+        /** \brief Construct a single-qubit identity Pauli */
+        static Pauli i(int q) { return Pauli(std::make_pair(q, PauliOp::i)); }
+        /** \brief Construct a single-qubit X Pauli */
+        static Pauli x(int q) { return Pauli(std::make_pair(q, PauliOp::x)); }
+        /** \brief Construct a single-qubit Z Pauli */
+        static Pauli z(int q) { return Pauli(std::make_pair(q, PauliOp::z)); }
+        /** \brief Construct a single-qubit Y Pauli */
+        static Pauli y(int q) { return Pauli(std::make_pair(q, PauliOp::y)); }
+        /**@}*/
+
+        /** @name Accessors */
+        /**@{*/
+        /** \brief Return the phase of the Pauli */
+        IPhase phase() const { return phase_; }
+
+        /** \brief Return the number of qubits acted on non-trivially */
+        std::size_t weight() const {
+            std::size_t ret = 0;
+            for (std::size_t w = 0; w < x_.size(); w++)
+                ret += popcount(x_[w] | z_[w]);
+            return ret;
+        }
+
+        /** \brief Return the single-qubit Pauli on a qubit */
+        PauliOp at(int q) const {
+            std::size_t w = q / word_bits;
+            if (w >= x_.size())
+                return PauliOp::i;
+
+            word mask = word(1) << (q % word_bits);
+            return static_cast<PauliOp>(((x_[w] & mask) ? 1 : 0) |
+                                        ((z_[w] & mask) ? 2 : 0));
+        }
+
+        /**
+         * \brief Apply a function to each non-trivial Pauli gate
+         *
+         * \tparam Fn The type of the function to be applied.
+         *            Must be invocable on a (qarg, PauliOp) pair
+         * \param fn The function to be applied to each non-trivial (qarg,
+         * PauliOp) pair
+         */
+        template <typename Fn>
+        void foreach (Fn&& fn) const {
+            static_assert(std::is_invocable_r_v<
+                          void, Fn, const std::pair<int, PauliOp>&>);
+            for (std::size_t w = 0; w < x_.size(); w++) {
+                for (word bits = x_[w] | z_[w]; bits != 0; bits &= bits - 1) {
+                    int q = static_cast<int>(w * word_bits + lowest_bit(bits));
+                    const auto p = std::make_pair(q, at(q));
+                    fn(p);
+                }
+            }
+        }
+        /**@}*/
+
+        /** @name Operators */
+        /**@{*/
+        /** \brief Scale-assign a Pauli by a (Pauli) phase */
+        Pauli& operator*=(const IPhase& phase) {
+            phase_ *= phase;
+            return *this;
+        }
+        /** \brief Scale a Pauli by a (Pauli) phase */
+        Pauli operator*(const IPhase& phase) const {
+            auto tmp_(*this);
+            tmp_ *= phase;
+            return tmp_;
+        }
+
+        /**
+         * \brief Multiply-assign a Pauli by a Pauli
+         *
+         * The phase picks up a factor of i for each qubit where the product
+         * is XY, ZX or YZ, and of -i for each where it is XZ, ZY or YX
+         */
+        Pauli& operator*=(const Pauli& P) {
+            if (P.x_.size() > x_.size()) {
+                x_.resize(P.x_.size(), 0);
+                z_.resize(P.x_.size(), 0);
+            }
+
+            std::size_t pos = 0;
+            std::size_t neg = 0;
+            for (std::size_t w = 0; w < P.x_.size(); w++) {
+                word x1 = x_[w], z1 = z_[w];
+                word x2 = P.x_[w], z2 = P.z_[w];
+
+                word y1 = x1 & z1, y2 = x2 & z2;
+                word xo1 = x1 & ~z1, xo2 = x2 & ~z2;
+                word zo1 = z1 & ~x1, zo2 = z2 & ~x2;
+
+                pos += popcount((xo1 & y2) | (zo1 & xo2) | (y1 & zo2));
+                neg += popcount((xo1 & zo2) | (zo1 & y2) | (y1 & xo2));
+
+                x_[w] = x1 ^ x2;
+                z_[w] = z1 ^ z2;
+            }
+
+            phase_ *= P.phase_;
+            phase_ *= static_cast<IPhase>((pos + 3 * neg) % 4);
+            return *this;
+        }
+        /** \brief Multiply a Pauli by a Pauli */
+        Pauli operator*(const Pauli& P) const {
+            auto tmp_(*this);
+            tmp_ *= P;
+            return tmp_;
+        }
+
+        /** \brief Negate the Pauli's phase */
+        Pauli operator-() const { return (*this) * IPhase::two; }
+
+        /** \brief Equality between Paulis */
+        bool operator==(const Pauli& P) const {
+            if (phase_ != P.phase_)
+                return false;
+
+            auto n = std::max(x_.size(), P.x_.size());
+            for (std::size_t w = 0; w < n; w++) {
+                if (x_word(w) != P.x_word(w) || z_word(w) != P.z_word(w))
+                    return false;
+            }
+
+            return true;
+        }
+        /** \brief Inequality between Paulis */
+        bool operator!=(const Pauli& P) const { return !(*this == P); }
+        /**@}*/
+
+        /** @name Queries */
+        /**@{*/
+        /**
+         * \brief Check whether it commutes with another Pauli
+         * \param P A constant reference to a Pauli
+         * \return True if it commutes with P
+         */
+        bool commutes_with(const Pauli& P) const {
+            auto n = std::min(x_.size(), P.x_.size());
+
+            word anti = 0;
+            for (std::size_t w = 0; w < n; w++)
+                anti ^= (x_[w] & P.z_[w]) ^ (z_[w] & P.x_[w]);
+
+            return (popcount(anti) % 2) == 0;
+        }
+
+        /**
+         * \brief Check whether it acts non-trivially on a qubit of another
+         * Pauli
+         * \param P A constant reference to a Pauli
+         * \return True if the supports of the two Paulis intersect
+         */
+        bool overlaps(const Pauli& P) const {
+            auto n = std::min(x_.size(), P.x_.size());
+            for (std::size_t w = 0; w < n; w++) {
+                if ((x_[w] | z_[w]) & (P.x_[w] | P.z_[w]))
+                    return true;
+            }
+            return false;
+        }
+
+        /**
+         * \brief Check whether it acts trivially on a qubit
+         * \param q A quantum argument
+         * \return True if the Pauli acts trivially on q
+         */
+        bool trivial_on(int q) const { return at(q) == PauliOp::i; }
+
+        /**
+         * \brief Check if it is strictly a Z axis rotation
+         * \return True if the Pauli is I or Z on all qubits
+         */
+        bool is_z() const {
+            for (auto w : x_) {
+                if (w != 0)
+                    return false;
+            }
+            return true;
+        }
+        /**@}*/
+
+        /** @name Printing */
+        /**@{*/
+        /** \brief Pretty printing of Paulis */
+        std::ostream& print(std::ostream& os) const {
+            os << phase_;
+            foreach ([&os](auto& p) {
+                os << p.second << "(" << p.first << ")";
+            });
+            return os;
+        }
+        /**@}*/
+
+      private:
+        std::vector<word> x_;         ///< X bits, 64 qubits per word
+        std::vector<word> z_;         ///< Z bits, 64 qubits per word
+        IPhase phase_ = IPhase::zero; ///< the phase of the Pauli
+
+        void set(int q, PauliOp p) {
+            std::size_t w = q / word_bits;
+            if (w >= x_.size()) {
+                x_.resize(w + 1, 0);
+                z_.resize(w + 1, 0);
+            }
+
+            word mask = word(1) << (q % word_bits);
+            auto bits = static_cast<unsigned short>(p);
+            x_[w] = (bits & 1) ? (x_[w] | mask) : (x_[w] & ~mask);
+            z_[w] = (bits & 2) ? (z_[w] | mask) : (z_[w] & ~mask);
+        }
+
+        word x_word(std::size_t w) const { return w < x_.size() ? x_[w] : 0; }
+        word z_word(std::size_t w) const { return w < z_.size() ? z_[w] : 0; }
+
+        static std::size_t popcount(word w) {
+            return std::bitset<word_bits>(w).count();
+        }
+        static int lowest_bit(word w) {
+            int i = 0;
+            for (; (w & 1) == 0; w >>= 1)
+                i++;
+            return i;
+        }
+    };
+
+    /** \brief Extraction operation overload for Paulis */
+    friend std::ostream& operator<<(std::ostream& os, const Pauli& P) {
+        return P.print(os);
+    }
+
+    /**
+     * \classs staq::gates::ChannelRepr<int>::Clifford
+     * \brief Class representing an n-qubit Clifford operator as a stabilizer
+     * tableau
+     *
+     * Stores the images \f$CX_qC^\dagger\f$ and \f$CZ_qC^\dagger\f$ of the
+     * generators on each qubit q the operator acts on. The image of \f$Y_q\f$
+     * is \f$iCX_qC^\dagger CZ_qC^\dagger\f$. No entry means the operator acts
+     * trivially on that qubit.
+     */
+    class Clifford {
+      public:
+        /** @name Constructors */
+        /**@{*/
+        /** \brief Default constructor */
+        Clifford() = default;
+        /** \brief Construct a Clifford from the images of X and Z on each
+         * qubit */
+        Clifford(std::unordered_map<int, std::pair<Pauli, Pauli>> tableau)
+            : tableau_(std::move(tableau)) {}
+        /**@}*/
+
+        /** @name Smart constructors */
+        /**@{*/
+        /** \brief Construct an \f$H\f$ gate */
+        static Clifford h(int q) {
+            return Clifford({{q, {Pauli::z(q), Pauli::x(q)}}});
+        }
+        /** \brief Construct an \f$S\f$ gate */
+        static Clifford s(int q) {
+            return Clifford({{q, {Pauli::y(q), Pauli::z(q)}}});
+        }
+        /** \brief Construct an \f$S^\dagger\f$ gate */
+        static Clifford sdg(int q) {
+            return Clifford({{q, {-(Pauli::y(q)), Pauli::z(q)}}});
+        }
+        /** \brief Construct a \f$CNOT\f$ gate */
+        static Clifford cnot(int q1, int q2) {
+            return Clifford(
+                {{q1, {Pauli::x(q1) * Pauli::x(q2), Pauli::z(q1)}},
+                 {q2, {Pauli::x(q2), Pauli::z(q1) * Pauli::z(q2)}}});
+        }
+        /** \brief Construct a (Clifford) \f$X\f$ gate */
+        static Clifford x(int q) {
+            return Clifford({{q, {Pauli::x(q), -(Pauli::z(q))}}});
+        }
+        /** \brief Construct a (Clifford) \f$Z\f$ gate */
+        static Clifford z(int q) {
+            return Clifford({{q, {-(Pauli::x(q)), Pauli::z(q)}}});
+        }
+        /** \brief Construct a (Clifford) \f$Y\f$ gate */
+        static Clifford y(int q) {
+            return Clifford({{q, {-(Pauli::x(q)), -(Pauli::z(q))}}});
+        }
+        /**@}*/
+
+        /** @name Accessors */
+        /**@{*/
+        /**
+         * \brief Apply a function to each qubit in the tableau
+         *
+         * \tparam Fn The type of the function to be applied.
+         *            Must be invocable on an int
+         * \param fn The function to be applied to each qubit
+         */
+        template <typename Fn>
+        void foreach_qubit(Fn&& fn) const {
+            static_assert(std::is_invocable_r_v<void, Fn, int const&>);
+            for (auto& [q, row] : tableau_)
+                fn(q);
+        }
+        /**@}*/
+
+        /** @name Operators */
+        /**@{*/
+        /**
+         * \brief Conjugate a Pauli
+         * \param P Const reference to a Pauli
+         * \return Pauli that is equal to \f$CPC^\dagger\f$
+         */
+        Pauli conjugate(const Pauli& P) const {
+            Pauli ret;
+            ret *= P.phase();
+
+            P.foreach ([&ret, this](auto& p) {
+                auto& [q, op] = p;
+                auto it = this->tableau_.find(q);
+                if (it == tableau_.end()) {
+                    ret *= Pauli(p);
+                    return;
+                }
+
+                // Y = iXZ
+                auto bits = static_cast<unsigned short>(op);
+                if (bits & 1)
+                    ret *= it->second.first;
+                if (bits & 2)
+                    ret *= it->second.second;
+                if (bits == 3)
+                    ret *= IPhase::one;
+            });
+
+            return ret;
+        }
+
+        /** \brief Multiply-assign by a Clifford */
+        Clifford& operator*=(const Clifford& C) {
+            std::vector<std::pair<int, std::pair<Pauli, Pauli>>> images;
+            images.reserve(C.tableau_.size());
+            for (auto& [q, row] : C.tableau_) {
+                images.emplace_back(q, std::make_pair(conjugate(row.first),
+                                                      conjugate(row.second)));
+            }
+
+            for (auto& [q, row] : images)
+                tableau_[q] = std::move(row);
+            return *this;
+        }
+        /** \brief Multiply by a Clifford */
+        Clifford operator*(const Clifford& C) {
+            Clifford ret(*this);
+            ret *= C;
+            return ret;
+        }
+        /**@}*/
+
+        /** @name Printing */
+        /**@{*/
+        /** \brief Pretty printer */
+        std::ostream& print(std::ostream& os) const {
+            os << "{ ";
+            for (auto& [q, row] : tableau_) {
+                os << Pauli::x(q) << " --> " << row.first << ", ";
+                os << Pauli::z(q) << " --> " << row.second << ", ";
+            }
+            os << "}";
+
+            return os;
+        }
+        /**@}*/
+
+      private:
+        /** The images of X and Z on each qubit acted on */
+        std::unordered_map<int, std::pair<Pauli, Pauli>> tableau_;
+    };
+
+    /** \brief Extraction operator overload for Cliffords */
+    friend std::ostream& operator<<(std::ostream& os, const Clifford& P) {
+        return P.print(os);
+    }
+
+    /**
+     * \class staq::gates::ChannelRepr<int>::Uninterp
+     * \brief Class storing an uninterpreted operation on some set of qubits
+     */
+    class Uninterp {
+      public:
+        /** \brief Construct an uninterpreted gate on some list of qubits */
+        Uninterp(std::vector<int> qubits) : qubits_(qubits) {}
+
+        /**
+         * \brief Apply a function to each qubit
+         *
+         * \tparam Fn The type of the function to be applied.
+         *            Must be invocable on an int
+         * \param fn The function to be applied to each qubit
+         */
+        template <typename Fn>
+        void foreach_qubit(Fn&& fn) const {
+            static_assert(std::is_invocable_r_v<void, Fn, int const&>);
+            for (auto& q : qubits_)
+                fn(q);
+        }
+
+        /** \brief Pretty printer */
+        std::ostream& print(std::ostream& os) const {
+            os << "U(";
+            for (auto& q : qubits_)
+                os << q << ",";
+            os << ")";
+
+            return os;
+        }
+
+      private:
+        std::vector<int>
+            qubits_; ///< A list of qubits the gate acts non-trivially on
+    };
+
+    /** \brief Extraction operator overload for Uninterpreted gates */
+    friend std::ostream& operator<<(std::ostream& os, const Uninterp& P) {
+        return P.print(os);
+    }
+
+    /**
+     * \class staq::gates::ChannelRepr<int>::Rotation
+     * \brief Class storing a rotation of some angle around a pauli
+     *
+     * A rotation with angle \f$\theta\f$ and Pauli \f$P\f$ represents the
+     * unitary \f$\frac{1 + e^{i\theta}}{2} I + \frac{1 - e^{i\theta}}{2} P\f$
+     */
+    class Rotation {
+      public:
+        /** @name Constructors */
+        /**@{*/
+        /** \brief Empty constructor */
+        Rotation() : theta_(utils::angles::zero) {}
+        /** \brief Construct a rotation from an angle and Pauli */
+        Rotation(utils::Angle theta, Pauli pauli)
+            : theta_(theta), pauli_(std::move(pauli)) {}
+        /**@}*/
+
+        /** @name Smart constructors */
+        /**@{*/
+        /** \brief Construct a \f$T\f$ gate */
+        static Rotation t(int q) {
+            return Rotation(utils::angles::pi_quarter, Pauli::z(q));
+        }
+        /** \brief Construct a \f$T^\dagger\f$ gate */
+        static Rotation tdg(int q) {
+            return Rotation(-utils::angles::pi_quarter, Pauli::z(q));
+        }
+        /** \brief Construct an \f$R_Z(\theta)\f$ gate */
+        static Rotation rz(utils::Angle theta, int q) {
+            return Rotation(theta, Pauli::z(q));
+        }
+        /** \brief Construct an \f$R_X(\theta)\f$ gate */
+        static Rotation rx(utils::Angle theta, int q) {
+            return Rotation(theta, Pauli::x(q));
+        }
+        /** \brief Construct an \f$R_Y(\theta)\f$ gate */
+        static Rotation ry(utils::Angle theta, int q) {
+            return Rotation(theta, Pauli::y(q));
+        }
+        /**@}*/
+
+        /** @name Accessors */
+        /**@{*/
+        /** \brief Get the angle of rotation */
+        utils::Angle rotation_angle() { return theta_; }
+        /** \brief Get the Pauli rotated on */
+        const Pauli& pauli() const { return pauli_; }
+        /**@}*/
+
+        /** @name Operators */
+        /**@{*/
+        /**
+         * \brief Commutes a rotation through a Clifford on the left
+         * \param C Const reference to a Clifford gate
+         * \return A rotation \f$R(\theta, P')\f$ such that
+         *              \f$CR(\theta, P) = R(\theta, P')C\f$
+         */
+        Rotation commute_left(const Clifford& C) const {
+            return Rotation(theta_, C.conjugate(pauli_));
+        }
+
+        /** \brief Equality between Rotation gates */
+        bool operator==(const Rotation& R) const {
+            return (theta_ == R.theta_) && (pauli_ == R.pauli_);
+        }
+        /** \brief Inequality between Rotation gates */
+        bool operator!=(const Rotation& R) const { return !(*this == R); }
+
+        /** \brief Checks whether the rotation commutes with another rotation */
+        bool commutes_with(const Rotation& R) const {
+            return pauli_.commutes_with(R.pauli_);
+        }
+
+        /** \brief Checks whether the rotation commutes with an uninterpreted
+         * gate */
+        bool commutes_with(const Uninterp& U) const {
+            auto tmp = true;
+
+            U.foreach_qubit(
+                [&tmp, this](int q) { tmp &= pauli_.trivial_on(q); });
+
+            return tmp;
+        }
+
+        /**
+         * \brief Attempts to merge with another rotation
+         * \param R Const reference to a rotation gate
+         * \return A phase \f$\phi\f$ and rotation \f$R'\f$ such that \f$\phi
+         * R'\f$ is equal to the product of the object and R
+         */
+        std::optional<std::pair<utils::Angle, Rotation>>
+        try_merge(const Rotation& R) const {
+            if (pauli_ == R.pauli_) {
+                auto phase = utils::angles::zero;
+                auto rotation = Rotation(theta_ + R.theta_, pauli_);
+                return std::make_optional(std::make_pair(phase, rotation));
+            } else if (pauli_ == -(R.pauli_)) {
+                auto phase = R.theta_;
+                auto rotation = Rotation(theta_ + -R.theta_, pauli_);
+                return std::make_optional(std::make_pair(phase, rotation));
+            } else {
+                return std::nullopt;
+            }
+        }
+
+        /** \brief Checks whether the rotation is a Z axis rotation */
+        bool is_z_rotation() const { return pauli_.is_z(); }
+        /**@}*/
+
+        /** @name Printing */
+        /**@{*/
+        /** \brief Pretty printer */
+        std::ostream& print(std::ostream& os) const {
+            os << "R(" << theta_ << ", " << pauli_ << ")";
+
+            return os;
+        }
+        /**@}*/
+
+      private:
+        utils::Angle theta_; ///< The angle of rotation
+        Pauli pauli_;        ///< The Pauli rotated on
+    };
+
+    /** \brief Extraction operator overload for Rotation gates */
+    friend std::ostream& operator<<(std::ostream& os, const Rotation& P) {
+        return P.print(os);
+    }
+};
+
 } // namespace gates
 } // namespace staq
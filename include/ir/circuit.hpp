@@ -0,0 +1,594 @@
+/*
+ * This file is part of staq.
+ *
+ * Copyright (c) 2019 - 2021 softwareQ Inc. All rights reserved.
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * \file ir/circuit.hpp
+ * \brief Flat circuit representation
+ */
+
+#pragma once
+
+#include "qasmtools/ast/ast.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace staq {
+namespace ir {
+
+namespace ast = qasmtools::ast;
+namespace parser = qasmtools::parser;
+
+/**
+ * \brief Enum of circuit operations
+ */
+enum class Opcode : std::uint8_t {
+    U,        ///< U(theta,phi,lambda) q
+    CX,       ///< CX c,t
+    Barrier,  ///< barrier q1,...,qn
+    Measure,  ///< measure q -> c
+    Reset,    ///< reset q
+    Gate,     ///< application of a declared gate
+    Register, ///< qreg or creg declaration
+    Opaque,   ///< any other top-level statement, kept as an AST node
+    Nop       ///< an erased operation
+};
+
+/**
+ * \class staq::ir::Register
+ * \brief Register table entry
+ *
+ * Qubits (resp. bits) are numbered densely across all quantum (resp.
+ * classical) registers, in declaration order. The ith element of the register
+ * has index base + i.
+ */
+struct Register {
+    ast::symbol name; ///< register identifier
+    bool quantum;     ///< whether the register is quantum
+    int size;         ///< number of elements
+    int base;         ///< dense index of the first element
+};
+
+/**
+ * \class staq::ir::Circuit
+ * \brief Structure-of-arrays representation of a flat program
+ *
+ * Operations are stored as parallel arrays indexed by operation number: an
+ * opcode, a slice of a shared qubit operand array, a slice of a shared
+ * parameter pool, an auxiliary integer and an optional classical condition.
+ * Qubit operands are dense indices; an operand referring to an entire register
+ * (e.g. in a gate applied across registers) is encoded as a negative number,
+ * see staq::ir::Circuit::whole_register.
+ *
+ * The auxiliary integer is the classical operand of a measurement, the name
+ * index of a declared gate application, the register index of a declaration,
+ * or the index of an opaque statement.
+ *
+ * A circuit is lowered from a program with staq::ir::lower and raised back to
+ * an equivalent program with staq::ir::raise. The source position of each
+ * statement, and of the if statement guarding it, is kept alongside the
+ * operation; variable accesses are raised at the position of their statement.
+ */
+class Circuit {
+  public:
+    /**
+     * \class staq::ir::Circuit::operands
+     * \brief Contiguous range of operands
+     */
+    template <typename T>
+    struct operands {
+        T* first; ///< first element
+        T* last;  ///< one past the last element
+
+        T* begin() const { return first; }
+        T* end() const { return last; }
+        std::size_t size() const { return last - first; }
+        T& operator[](std::size_t i) const { return first[i]; }
+    };
+
+    Circuit() = default;
+    Circuit(parser::Position pos, bool std_include)
+        : pos_(pos), std_include_(std_include) {}
+
+    /** @name Operand encoding */
+    /**@{*/
+    /** \brief Operand encoding of an entire register */
+    static int whole_register(int reg) { return -(reg + 1); }
+    /** \brief Whether an operand refers to an entire register */
+    static bool is_register(int operand) { return operand < 0; }
+    /** \brief Register index of a whole-register operand */
+    static int register_of(int operand) { return -operand - 1; }
+    /**@}*/
+
+    /** @name Accessors */
+    /**@{*/
+    std::size_t size() const { return ops_.size(); }
+    Opcode opcode(std::size_t i) const { return ops_[i]; }
+    operands<int> qargs(std::size_t i) {
+        return {qargs_.data() + qarg_offsets_[i],
+                qargs_.data() + qarg_offsets_[i + 1]};
+    }
+    operands<const int> qargs(std::size_t i) const {
+        return {qargs_.data() + qarg_offsets_[i],
+                qargs_.data() + qarg_offsets_[i + 1]};
+    }
+    std::size_t num_params(std::size_t i) const {
+        return param_offsets_[i + 1] - param_offsets_[i];
+    }
+    const ast::Expr& param(std::size_t i, std::size_t j) const {
+        return *params_[param_offsets_[i] + j];
+    }
+    /** \brief Constant value of a parameter, or nullopt if symbolic */
+    std::optional<double> value(std::size_t i, std::size_t j) const {
+        double v = values_[param_offsets_[i] + j];
+        if (v != v)
+            return std::nullopt;
+        return v;
+    }
+    int aux(std::size_t i) const { return aux_[i]; }
+    const ast::symbol& gate_name(std::size_t i) const {
+        return names_[aux_[i]];
+    }
+    /** \brief The (register, value) tested before the operation, if any */
+    std::optional<std::pair<int, int>> condition(std::size_t i) const {
+        if (cond_reg_[i] < 0)
+            return std::nullopt;
+        return std::make_pair(cond_reg_[i], cond_val_[i]);
+    }
+    /** \brief Source position of the statement */
+    parser::Position position(std::size_t i) const { return positions_[i]; }
+    /** \brief Source position of the if statement guarding the operation */
+    parser::Position condition_position(std::size_t i) const {
+        return cond_positions_[i];
+    }
+    const ast::Stmt& opaque(std::size_t i) const { return *opaque_[aux_[i]]; }
+    ast::Stmt& opaque(std::size_t i) { return *opaque_[aux_[i]]; }
+
+    const std::vector<Register>& registers() const { return registers_; }
+    int num_qubits() const { return num_qubits_; }
+    int num_bits() const { return num_bits_; }
+    parser::Position pos() const { return pos_; }
+    bool std_include() const { return std_include_; }
+    /**@}*/
+
+    /** @name Registers */
+    /**@{*/
+    /**
+     * \brief Declares a register
+     *
+     * \return The index of the new register
+     */
+    int add_register(const ast::symbol& name, bool quantum, int size) {
+        int idx = static_cast<int>(registers_.size());
+        int& count = quantum ? num_qubits_ : num_bits_;
+        auto& owner = quantum ? qubit_reg_ : bit_reg_;
+
+        if (!register_index_.insert({name, idx}).second)
+            throw std::logic_error("Register \"" + name + "\" declared twice");
+        registers_.push_back(Register{name, quantum, size, count});
+        owner.insert(owner.end(), size, idx);
+        count += size;
+
+        return idx;
+    }
+
+    /** \brief Dense operand for a variable access */
+    int index_of(const ast::VarAccess& va) const {
+        auto it = register_index_.find(va.var());
+        if (it == register_index_.end())
+            throw std::logic_error("Undeclared register \"" + va.var() + "\"");
+
+        auto& reg = registers_[it->second];
+        if (!va.offset())
+            return whole_register(it->second);
+        else if (*va.offset() < 0 || *va.offset() >= reg.size)
+            throw std::out_of_range("Index out of range in access " +
+                                    va.var());
+        return reg.base + *va.offset();
+    }
+
+    /** \brief Variable access for a dense qubit operand */
+    ast::VarAccess
+    qubit_access(int operand, parser::Position pos = parser::Position()) const {
+        return access(operand, qubit_reg_, pos);
+    }
+
+    /** \brief Variable access for a dense classical operand */
+    ast::VarAccess bit_access(int operand,
+                              parser::Position pos = parser::Position()) const {
+        return access(operand, bit_reg_, pos);
+    }
+    /**@}*/
+
+    /** @name Construction */
+    /**@{*/
+    std::size_t add_u(ast::ptr<ast::Expr> theta, ast::ptr<ast::Expr> phi,
+                      ast::ptr<ast::Expr> lambda, int q) {
+        std::size_t i = push(Opcode::U, 0);
+        add_param(std::move(theta));
+        add_param(std::move(phi));
+        add_param(std::move(lambda));
+        qargs_.push_back(q);
+        return finish(i);
+    }
+    std::size_t add_cx(int ctrl, int tgt) {
+        std::size_t i = push(Opcode::CX, 0);
+        qargs_.push_back(ctrl);
+        qargs_.push_back(tgt);
+        return finish(i);
+    }
+    std::size_t add_barrier(const std::vector<int>& qs) {
+        std::size_t i = push(Opcode::Barrier, 0);
+        qargs_.insert(qargs_.end(), qs.begin(), qs.end());
+        return finish(i);
+    }
+    std::size_t add_measure(int q, int c) {
+        std::size_t i = push(Opcode::Measure, c);
+        qargs_.push_back(q);
+        return finish(i);
+    }
+    std::size_t add_reset(int q) {
+        std::size_t i = push(Opcode::Reset, 0);
+        qargs_.push_back(q);
+        return finish(i);
+    }
+    std::size_t add_gate(const ast::symbol& name,
+                         std::vector<ast::ptr<ast::Expr>> params,
+                         const std::vector<int>& qs) {
+        auto [it, inserted] =
+            name_index_.insert({name, static_cast<int>(names_.size())});
+        if (inserted)
+            names_.push_back(name);
+
+        std::size_t i = push(Opcode::Gate, it->second);
+        for (auto& param : params)
+            add_param(std::move(param));
+        qargs_.insert(qargs_.end(), qs.begin(), qs.end());
+        return finish(i);
+    }
+    std::size_t add_declaration(int reg) {
+        return finish(push(Opcode::Register, reg));
+    }
+    std::size_t add_opaque(ast::ptr<ast::Stmt> stmt) {
+        std::size_t i = push(Opcode::Opaque, static_cast<int>(opaque_.size()));
+        opaque_.emplace_back(std::move(stmt));
+        return finish(i);
+    }
+
+    /** \brief Attaches a classical condition to an operation */
+    void set_condition(std::size_t i, int reg, int val,
+                       parser::Position pos = parser::Position()) {
+        cond_reg_[i] = reg;
+        cond_val_[i] = val;
+        cond_positions_[i] = pos;
+    }
+
+    /** \brief Sets the source position of an operation */
+    void set_position(std::size_t i, parser::Position pos) {
+        positions_[i] = pos;
+    }
+    /**@}*/
+
+    /** @name Editing */
+    /**@{*/
+    /** \brief Marks an operation as erased */
+    void erase(std::size_t i) { ops_[i] = Opcode::Nop; }
+
+    /** \brief Removes erased operations, compacting all arrays */
+    void compact() {
+        std::size_t n = 0, q = 0, p = 0;
+        for (std::size_t i = 0; i < ops_.size(); i++) {
+            if (ops_[i] == Opcode::Nop)
+                continue;
+
+            std::size_t qb = qarg_offsets_[i], qe = qarg_offsets_[i + 1];
+            std::size_t pb = param_offsets_[i], pe = param_offsets_[i + 1];
+
+            ops_[n] = ops_[i];
+            aux_[n] = aux_[i];
+            cond_reg_[n] = cond_reg_[i];
+            cond_val_[n] = cond_val_[i];
+            positions_[n] = positions_[i];
+            cond_positions_[n] = cond_positions_[i];
+            qarg_offsets_[n] = static_cast<std::uint32_t>(q);
+            param_offsets_[n] = static_cast<std::uint32_t>(p);
+            for (std::size_t j = qb; j < qe; j++)
+                qargs_[q++] = qargs_[j];
+            for (std::size_t j = pb; j < pe; j++, p++) {
+                params_[p] = std::move(params_[j]);
+                values_[p] = values_[j];
+            }
+            n++;
+        }
+
+        ops_.resize(n);
+        aux_.resize(n);
+        cond_reg_.resize(n);
+        cond_val_.resize(n);
+        positions_.resize(n);
+        cond_positions_.resize(n);
+        qarg_offsets_.resize(n + 1);
+        param_offsets_.resize(n + 1);
+        qarg_offsets_[n] = static_cast<std::uint32_t>(q);
+        param_offsets_[n] = static_cast<std::uint32_t>(p);
+        qargs_.resize(q);
+        params_.resize(p);
+        values_.resize(p);
+    }
+    /**@}*/
+
+  private:
+    parser::Position pos_;    ///< position of the original program
+    bool std_include_ = true; ///< whether the program includes qelib1
+
+    std::vector<Opcode> ops_;                     ///< operation codes
+    std::vector<std::uint32_t> qarg_offsets_{0};  ///< qubit operand slices
+    std::vector<int> qargs_;                      ///< qubit operands
+    std::vector<std::uint32_t> param_offsets_{0}; ///< parameter slices
+    std::vector<ast::ptr<ast::Expr>> params_;     ///< parameter pool
+    std::vector<double> values_; ///< constant parameter values, or NaN
+    std::vector<int> aux_;       ///< auxiliary operands
+    std::vector<int> cond_reg_;  ///< condition registers, or -1
+    std::vector<int> cond_val_;  ///< condition values
+    std::vector<parser::Position> positions_;      ///< statement positions
+    std::vector<parser::Position> cond_positions_; ///< if statement positions
+
+    std::vector<ast::symbol> names_;                      ///< gate names
+    std::unordered_map<ast::symbol, int> name_index_;     ///< name lookup
+    std::vector<ast::ptr<ast::Stmt>> opaque_;             ///< opaque stmts
+    std::vector<Register> registers_;                     ///< register table
+    std::unordered_map<ast::symbol, int> register_index_; ///< register lookup
+    std::vector<int> qubit_reg_; ///< owning register of each qubit
+    std::vector<int> bit_reg_;   ///< owning register of each bit
+    int num_qubits_ = 0;         ///< number of dense qubit indices
+    int num_bits_ = 0;           ///< number of dense bit indices
+
+    std::size_t push(Opcode op, int aux) {
+        ops_.push_back(op);
+        aux_.push_back(aux);
+        cond_reg_.push_back(-1);
+        cond_val_.push_back(0);
+        positions_.emplace_back();
+        cond_positions_.emplace_back();
+        return ops_.size() - 1;
+    }
+
+    std::size_t finish(std::size_t i) {
+        qarg_offsets_.push_back(static_cast<std::uint32_t>(qargs_.size()));
+        param_offsets_.push_back(static_cast<std::uint32_t>(params_.size()));
+        return i;
+    }
+
+    void add_param(ast::ptr<ast::Expr> expr) {
+        auto val = expr->constant_eval();
+        values_.push_back(val ? *val
+                              : std::numeric_limits<double>::quiet_NaN());
+        params_.emplace_back(std::move(expr));
+    }
+
+    ast::VarAccess access(int operand, const std::vector<int>& owner,
+                          parser::Position pos) const {
+        if (is_register(operand))
+            return ast::VarAccess(pos, registers_[register_of(operand)].name);
+
+        auto& reg = registers_[owner[operand]];
+        return ast::VarAccess(pos, reg.name, operand - reg.base);
+    }
+};
+
+/**
+ * \class staq::ir::Lowering
+ * \brief Lowers a program to a flat circuit
+ *
+ * Top-level gates, measurements, resets and register declarations are lowered
+ * to operations, and if statements to conditions on the guarded operation.
+ * Gate and oracle declarations are kept as opaque statements.
+ */
+class Lowering final : public ast::Visitor {
+  public:
+    Lowering() = default;
+    ~Lowering() = default;
+
+    /** \brief Main lowering method */
+    Circuit run(ast::Program& prog) {
+        circuit_ = Circuit(prog.pos(), prog.std_include());
+        prog.accept(*this);
+        return std::move(circuit_);
+    }
+
+    // Variables & expressions are handled by their parent statements
+    void visit(ast::VarAccess&) override {}
+    void visit(ast::BExpr&) override {}
+    void visit(ast::UExpr&) override {}
+    void visit(ast::PiExpr&) override {}
+    void visit(ast::IntExpr&) override {}
+    void visit(ast::RealExpr&) override {}
+    void visit(ast::VarExpr&) override {}
+
+    // Statements
+    void visit(ast::MeasureStmt& stmt) override {
+        lowered(circuit_.add_measure(circuit_.index_of(stmt.q_arg()),
+                                     circuit_.index_of(stmt.c_arg())), stmt);
+    }
+    void visit(ast::ResetStmt& stmt) override {
+        lowered(circuit_.add_reset(circuit_.index_of(stmt.arg())), stmt);
+    }
+    void visit(ast::IfStmt& stmt) override {
+        int reg = circuit_.register_of(
+            circuit_.index_of(ast::VarAccess(stmt.pos(), stmt.var())));
+        stmt.then().accept(*this);
+        circuit_.set_condition(last_, reg, stmt.cond(), stmt.pos());
+    }
+
+    // Gates
+    void visit(ast::UGate& gate) override {
+        lowered(circuit_.add_u(ast::object::clone(gate.theta()),
+                               ast::object::clone(gate.phi()),
+                               ast::object::clone(gate.lambda()),
+                               circuit_.index_of(gate.arg())), gate);
+    }
+    void visit(ast::CNOTGate& gate) override {
+        lowered(circuit_.add_cx(circuit_.index_of(gate.ctrl()),
+                                circuit_.index_of(gate.tgt())), gate);
+    }
+    void visit(ast::BarrierGate& gate) override {
+        std::vector<int> qs;
+        for (auto& arg : gate.args())
+            qs.push_back(circuit_.index_of(arg));
+        lowered(circuit_.add_barrier(qs), gate);
+    }
+    void visit(ast::DeclaredGate& gate) override {
+        std::vector<ast::ptr<ast::Expr>> params;
+        gate.foreach_carg([&params](auto& expr) {
+            params.emplace_back(ast::object::clone(expr));
+        });
+        std::vector<int> qs;
+        for (auto& arg : gate.qargs())
+            qs.push_back(circuit_.index_of(arg));
+        lowered(circuit_.add_gate(gate.name(), std::move(params), qs), gate);
+    }
+
+    // Declarations
+    void visit(ast::GateDecl& decl) override {
+        lowered(circuit_.add_opaque(ast::object::clone(decl)), decl);
+    }
+    void visit(ast::OracleDecl& decl) override {
+        lowered(circuit_.add_opaque(ast::object::clone(decl)), decl);
+    }
+    void visit(ast::RegisterDecl& decl) override {
+        int reg =
+            circuit_.add_register(decl.id(), decl.is_quantum(), decl.size());
+        lowered(circuit_.add_declaration(reg), decl);
+    }
+    void visit(ast::AncillaDecl& decl) override {
+        lowered(circuit_.add_opaque(ast::object::clone(decl)), decl);
+    }
+
+    // Program
+    void visit(ast::Program& prog) override {
+        prog.foreach_stmt([this](auto& stmt) { stmt.accept(*this); });
+    }
+
+  private:
+    Circuit circuit_;
+    std::size_t last_ = 0; ///< the most recently lowered operation
+
+    void lowered(std::size_t i, const ast::ASTNode& node) {
+        last_ = i;
+        circuit_.set_position(i, node.pos());
+    }
+};
+
+/** \brief Lowers a program to a flat circuit */
+inline Circuit lower(ast::Program& prog) {
+    Lowering alg;
+    return alg.run(prog);
+}
+
+/** \brief Raises a flat circuit back to a program */
+inline ast::ptr<ast::Program> raise(const Circuit& circuit) {
+    std::list<ast::ptr<ast::Stmt>> body;
+
+    for (std::size_t i = 0; i < circuit.size(); i++) {
+        ast::ptr<ast::Stmt> stmt;
+        auto qargs = circuit.qargs(i);
+        auto pos = circuit.position(i);
+
+        auto clone_params = [&circuit, i]() {
+            std::vector<ast::ptr<ast::Expr>> ret;
+            for (std::size_t j = 0; j < circuit.num_params(i); j++)
+                ret.emplace_back(ast::object::clone(circuit.param(i, j)));
+            return ret;
+        };
+        auto accesses = [&circuit, &qargs, pos]() {
+            std::vector<ast::VarAccess> ret;
+            for (int q : qargs)
+                ret.emplace_back(circuit.qubit_access(q, pos));
+            return ret;
+        };
+
+        switch (circuit.opcode(i)) {
+            case Opcode::U:
+                stmt = std::make_unique<ast::UGate>(
+                    pos, ast::object::clone(circuit.param(i, 0)),
+                    ast::object::clone(circuit.param(i, 1)),
+                    ast::object::clone(circuit.param(i, 2)),
+                    circuit.qubit_access(qargs[0], pos));
+                break;
+            case Opcode::CX:
+                stmt = std::make_unique<ast::CNOTGate>(
+                    pos, circuit.qubit_access(qargs[0], pos),
+                    circuit.qubit_access(qargs[1], pos));
+                break;
+            case Opcode::Barrier:
+                stmt = std::make_unique<ast::BarrierGate>(pos, accesses());
+                break;
+            case Opcode::Measure:
+                stmt = std::make_unique<ast::MeasureStmt>(
+                    pos, circuit.qubit_access(qargs[0], pos),
+                    circuit.bit_access(circuit.aux(i), pos));
+                break;
+            case Opcode::Reset:
+                stmt = std::make_unique<ast::ResetStmt>(
+                    pos, circuit.qubit_access(qargs[0], pos));
+                break;
+            case Opcode::Gate:
+                stmt = std::make_unique<ast::DeclaredGate>(
+                    pos, circuit.gate_name(i), clone_params(), accesses());
+                break;
+            case Opcode::Register: {
+                auto& reg = circuit.registers()[circuit.aux(i)];
+                stmt = std::make_unique<ast::RegisterDecl>(
+                    pos, reg.name, reg.quantum, reg.size);
+                break;
+            }
+            case Opcode::Opaque:
+                stmt = ast::object::clone(circuit.opaque(i));
+                break;
+            case Opcode::Nop:
+                continue;
+        }
+
+        if (auto cond = circuit.condition(i)) {
+            stmt = std::make_unique<ast::IfStmt>(
+                circuit.condition_position(i),
+                circuit.registers()[cond->first].name, cond->second,
+                std::move(stmt));
+        }
+        body.emplace_back(std::move(stmt));
+    }
+
+    return ast::Program::create(circuit.pos(), circuit.std_include(),
+                                std::move(body), circuit.num_bits(),
+                                circuit.num_qubits());
+}
+
+} // namespace ir
+} // namespace staq
@@ -33,14 +33,22 @@
 
 #include "qasmtools/ast/var.hpp"
 
+#include <algorithm>
 #include <limits>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
 #include <functional>
+#include <iterator>
 #include <iostream>
 #include <list>
+#include <memory>
 #include <optional>
 #include <queue>
+#include <random>
 #include <set>
+#include <string>
 #include <unordered_map>
 #include <vector>
 #include <fstream>
@@ -89,9 +97,9 @@ class Device {
      * \param dag A digraph, given as a Boolean adjacency matrix
      */
     Device(std::string name, int n, const std::vector<std::vector<bool>>& dag)
-        : name_(name), qubits_(n), couplings_(dag),
-          single_qubit_fidelities_(n, FIDELITY_1),
-          coupling_fidelities_(n, std::vector<double>(n, FIDELITY_1)) {}
+        : Device(name, n, dag, std::vector<double>(n, FIDELITY_1),
+                 std::vector<std::vector<double>>(
+                     n, std::vector<double>(n, FIDELITY_1))) {}
     /**
      * \brief Construct a device from a coupling graph
      * \param name A name for the device
@@ -104,10 +112,46 @@ class Device {
     Device(std::string name, int n, const std::vector<std::vector<bool>>& dag,
            const std::vector<double>& sq_fi,
            const std::vector<std::vector<double>>& tq_fi)
-        : name_(name), qubits_(n), couplings_(dag),
-          single_qubit_fidelities_(sq_fi), coupling_fidelities_(tq_fi) {}
+        : name_(name), qubits_(n), single_qubit_fidelities_(sq_fi) {
+        std::vector<std::pair<coupling, double>> edges;
+        for (auto i = 0; i < n; i++) {
+            for (auto j = 0; j < n; j++) {
+                if (dag[i][j])
+                    edges.emplace_back(std::make_pair(i, j), tq_fi[i][j]);
+            }
+        }
+        init_couplings(edges);
+    }
+    /**
+     * \brief Construct a device from a list of couplings
+     *
+     * Suited to large devices, as the coupling graph is never stored as a
+     * matrix.
+     *
+     * \param name A name for the device
+     * \param n The number of qubits
+     * \param edges The (control, target) couplings with their average
+     * two-qubit gate fidelities
+     * \param sq_fi A vector of average single-qubit gate fidelities for each
+     * qubit
+     */
+    Device(std::string name, int n,
+           std::vector<std::pair<coupling, double>> edges,
+           const std::vector<double>& sq_fi)
+        : name_(name), qubits_(n), single_qubit_fidelities_(sq_fi) {
+        std::sort(edges.begin(), edges.end());
+        init_couplings(edges);
+    }
     /**@}*/
 
+    /**
+     * \brief Largest device for which all shortest paths are precomputed
+     *
+     * Shortest paths on larger devices are computed from one source at a time
+     * as needed, and only a bounded number of sources are kept.
+     */
+    static constexpr int dense_limit = 256;
+
     std::string name_;
     int qubits_;
 
@@ -119,7 +163,7 @@ class Device {
      */
     bool coupled(int i, int j) {
         if (0 <= i && i < qubits_ && 0 <= j && j < qubits_)
-            return couplings_[i][j];
+            return find_coupling(i, j) != -1;
         else
             throw std::out_of_range("Qubit(s) not in range");
     }
@@ -143,7 +187,7 @@ class Device {
      */
     double tq_fidelity(int i, int j) {
         if (coupled(i, j))
-            return coupling_fidelities_[i][j];
+            return coupling_fidelities_[find_coupling(i, j)];
         else
             throw std::logic_error("Qubit not coupled");
     }
@@ -158,41 +202,26 @@ class Device {
      * \return A shortest (or highest fidelity) path between qubits i and j
      */
     path shortest_path(int i, int j) {
-        compute_shortest_paths();
-        path ret{i};
-
-        if (shortest_paths[i][j] == qubits_) {
-            return ret;
-        }
-
-        while (i != j) {
-            i = shortest_paths[i][j];
-            ret.push_back(i);
-        }
-
-        return ret;
+        std::vector<int> ret;
+        walk_path(i, j, ret);
+        return path(ret.begin(), ret.end());
     }
 
     /**
      * \brief Get the distance of a shortest path between two qubits
      * \param i The control qubit
      * \param j The target qubit
-     * \return The length of a shortest path between qubits i and j
+     * \return The length of a shortest path between qubits i and j, or -1 if
+     * there is none
      */
     int distance(int i, int j) {
-        compute_shortest_paths();
-
-        if (shortest_paths[i][j] == qubits_) {
-            return -1;
-        }
-
-        int ret = 0;
-        while (i != j) {
-            i = shortest_paths[i][j];
-            ++ret;
+        if (qubits_ > dense_limit) {
+            auto& row = sparse_row(i);
+            return row.prev[j] == -1 ? -1 : row.hops[j];
         }
 
-        return ret;
+        compute_shortest_paths();
+        return hops[i][j];
     }
 
     /**
@@ -212,11 +241,11 @@ class Device {
 
         std::set<std::pair<coupling, double>, cmp_couplings> ret(cmp);
         for (auto i = 0; i < qubits_; i++) {
-            for (auto j = 0; j < qubits_; j++) {
-                if (couplings_[i][j]) {
-                    ret.insert(std::make_pair(std::make_pair(i, j),
-                                              coupling_fidelities_[i][j]));
-                }
+            for (auto k = coupling_offsets_[i]; k < coupling_offsets_[i + 1];
+                 k++) {
+                ret.insert(std::make_pair(
+                    std::make_pair(i, coupling_targets_[k]),
+                    coupling_fidelities_[k]));
             }
         }
 
@@ -228,55 +257,29 @@ class Device {
      *
      * Given a set of terminal nodes and a root node in the coupling graph,
      * attempts to find a minimal weight set of edges connecting the root to
-     * each terminal.
+     * each terminal. Terminals are joined one at a time, cheapest first, by a
+     * shortest path from the closest node already in the tree.
+     *
+     * Trees are memoized on the set of terminals and the root, so repeated
+     * blocks of a circuit are only solved once.
      *
      * \param terminals A list of terminal qubits to be connected
      * \param root A root for the Steiner tree
      * \return A spanning tree represented as a list of edges
      */
     spanning_tree steiner(std::list<int> terminals, int root) {
-        compute_shortest_paths();
+        steiner_key key{root, {terminals.begin(), terminals.end()}};
+        auto& nodes = key.terminals;
+        std::sort(nodes.begin(), nodes.end());
+        nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+        nodes.erase(std::remove(nodes.begin(), nodes.end(), root),
+                    nodes.end());
 
-        spanning_tree ret;
-
-        // Internal data structures
-        std::vector<double> vertex_cost(qubits_);
-        std::vector<int> edge_in(qubits_);
-        std::set<int> in_tree{root};
-
-        auto min_node = terminals.end();
-        for (auto it = terminals.begin(); it != terminals.end(); it++) {
-            vertex_cost[*it] = dist[root][*it];
-            edge_in[*it] = root;
-            if (min_node == terminals.end() ||
-                (vertex_cost[*it] < vertex_cost[*min_node])) {
-                min_node = it;
-            }
-        }
+        if (auto tree = steiner_memo_.find(key))
+            return *tree;
 
-        // Algorithm proper
-        while (min_node != terminals.end()) {
-            auto current = *min_node;
-            terminals.erase(min_node);
-            auto new_nodes = add_to_tree(
-                ret, shortest_path(edge_in[current], current), in_tree);
-            in_tree.insert(new_nodes.begin(), new_nodes.end());
-
-            // Update costs, edges, and find new minimum edge
-            min_node = terminals.end();
-            for (auto it = terminals.begin(); it != terminals.end(); it++) {
-                for (auto node : new_nodes) {
-                    if (dist[node][*it] < vertex_cost[*it]) {
-                        vertex_cost[*it] = dist[node][*it];
-                        edge_in[*it] = node;
-                    }
-                }
-                if (min_node == terminals.end() ||
-                    (vertex_cost[*it] < vertex_cost[*min_node])) {
-                    min_node = it;
-                }
-            }
-        }
+        auto ret = compute_steiner(nodes, root);
+        steiner_memo_.insert(std::move(key), ret);
 
         return ret;
     }
@@ -338,27 +341,180 @@ class Device {
                     ? json{{"id", i}}
                     : json{{"id", i},
                            {"fidelity", single_qubit_fidelities_[i]}});
-            for (int j = 0; j < qubits_; j++) {
-                if (i != j && couplings_[i][j]) {
+            for (auto k = coupling_offsets_[i]; k < coupling_offsets_[i + 1];
+                 k++) {
+                auto j = coupling_targets_[k];
+                auto f = coupling_fidelities_[k];
+                if (i != j) {
                     js["couplings"].push_back(
-                        coupling_fidelities_[i][j] == FIDELITY_1
+                        f == FIDELITY_1
                             ? json{{"control", i}, {"target", j}}
                             : json{{"control", i},
                                    {"target", j},
-                                   {"fidelity", coupling_fidelities_[i][j]}});
+                                   {"fidelity", f}});
                 }
             }
         }
         return js.dump(2);
     }
 
+    /**
+     * \brief Writes the device and its shortest paths to a binary cache
+     *
+     * The cache holds, in native byte order and with every array aligned to
+     * its element size, a header (magic, version, byte order mark, key,
+     * number of qubits, name length, number of couplings, whether paths
+     * follow), the name padded to 8 bytes, the single-qubit fidelities, the
+     * (control, target) couplings, their fidelities and, for devices up to
+     * the dense limit, the distance, successor and hop matrices.
+     *
+     * \param os The output stream, opened in binary mode
+     * \param key A key identifying the source of the device
+     */
+    void write_cache(std::ostream& os, std::uint64_t key) {
+        compute_shortest_paths();
+        bool has_paths = qubits_ <= dense_limit;
+
+        auto put = [&os](const auto* data, std::size_t count) {
+            os.write(reinterpret_cast<const char*>(data),
+                     count * sizeof(*data));
+        };
+        auto put_value = [&put](auto value) { put(&value, 1); };
+
+        auto m = static_cast<std::uint32_t>(coupling_targets_.size());
+        os.write(cache_magic, sizeof(cache_magic));
+        put_value(cache_version);
+        put_value(cache_byte_order);
+        put_value(key);
+        put_value(static_cast<std::uint32_t>(qubits_));
+        put_value(static_cast<std::uint32_t>(name_.size()));
+        put_value(m);
+        put_value(static_cast<std::uint32_t>(has_paths));
+        os.write(name_.data(), name_.size());
+        os.write("\0\0\0\0\0\0\0", (8 - name_.size() % 8) % 8);
+
+        put(single_qubit_fidelities_.data(), qubits_);
+        for (auto i = 0; i < qubits_; i++) {
+            for (auto k = coupling_offsets_[i]; k < coupling_offsets_[i + 1];
+                 k++) {
+                put_value(static_cast<std::int32_t>(i));
+                put_value(static_cast<std::int32_t>(coupling_targets_[k]));
+            }
+        }
+        put(coupling_fidelities_.data(), m);
+
+        if (has_paths) {
+            for (auto& row : dist)
+                put(row.data(), qubits_);
+            for (auto& row : shortest_paths)
+                put(row.data(), qubits_);
+            for (auto& row : hops)
+                put(row.data(), qubits_);
+        }
+    }
+
+    /**
+     * \brief Reads a device written by write_cache
+     * \param is The input stream, opened in binary mode
+     * \param key The key the cache must have been written with
+     * \return The device, or nothing if the cache is invalid or stale
+     */
+    static std::optional<Device> read_cache(std::istream& is,
+                                            std::uint64_t key) {
+        auto get = [&is](auto* data, std::size_t count) {
+            is.read(reinterpret_cast<char*>(data), count * sizeof(*data));
+            return static_cast<bool>(is);
+        };
+
+        char magic[sizeof(cache_magic)];
+        std::uint32_t version, byte_order, n, name_size, m, has_paths;
+        std::uint64_t stored_key;
+        if (!get(magic, sizeof(magic)) ||
+            !std::equal(magic, magic + sizeof(magic), cache_magic) ||
+            !get(&version, 1) || version != cache_version ||
+            !get(&byte_order, 1) || byte_order != cache_byte_order ||
+            !get(&stored_key, 1) || stored_key != key || !get(&n, 1) ||
+            !get(&name_size, 1) || !get(&m, 1) || !get(&has_paths, 1))
+            return std::nullopt;
+        if (n > (1u << 24) || name_size > (1u << 16) ||
+            static_cast<std::uint64_t>(m) > static_cast<std::uint64_t>(n) * n ||
+            has_paths != (n <= static_cast<std::uint32_t>(dense_limit)))
+            return std::nullopt;
+
+        std::string name(name_size, '\0');
+        char pad[8];
+        if (!get(name.data(), name_size) ||
+            !get(pad, (8 - name_size % 8) % 8))
+            return std::nullopt;
+
+        std::vector<double> sq_fi(n);
+        std::vector<std::int32_t> ends(2 * static_cast<std::size_t>(m));
+        std::vector<double> tq_fi(m);
+        if (!get(sq_fi.data(), n) || !get(ends.data(), ends.size()) ||
+            !get(tq_fi.data(), m))
+            return std::nullopt;
+
+        std::vector<std::pair<coupling, double>> edges;
+        edges.reserve(m);
+        for (std::size_t k = 0; k < m; k++) {
+            auto i = ends[2 * k];
+            auto j = ends[2 * k + 1];
+            if (i < 0 || j < 0 || static_cast<std::uint32_t>(i) >= n ||
+                static_cast<std::uint32_t>(j) >= n)
+                return std::nullopt;
+            edges.emplace_back(std::make_pair(i, j), tq_fi[k]);
+        }
+        Device ret(name, static_cast<int>(n), std::move(edges), sq_fi);
+
+        if (has_paths) {
+            ret.dist.assign(n, std::vector<double>(n));
+            ret.shortest_paths.assign(n, std::vector<int>(n));
+            ret.hops.assign(n, std::vector<int>(n));
+            for (auto& row : ret.dist) {
+                if (!get(row.data(), n))
+                    return std::nullopt;
+            }
+            for (auto& row : ret.shortest_paths) {
+                if (!get(row.data(), n))
+                    return std::nullopt;
+            }
+            for (auto& row : ret.hops) {
+                if (!get(row.data(), n))
+                    return std::nullopt;
+            }
+            if (!ret.valid_paths())
+                return std::nullopt;
+        }
+
+        return ret;
+    }
+
   private:
-    std::vector<std::vector<bool>>
-        couplings_; ///< The adjacency matrix of the device topology
     std::vector<double>
         single_qubit_fidelities_; ///< The fidelities of single-qubit gates
-    std::vector<std::vector<double>>
+
+    /** @name Binary cache format */
+    /**@{*/
+    static constexpr char cache_magic[8] = {'s', 't', 'a', 'q',
+                                            'd', 'e', 'v', '\0'};
+    static constexpr std::uint32_t cache_version = 1;
+    static constexpr std::uint32_t cache_byte_order = 0x01020304;
+    /**@}*/
+
+    /** @name Coupling digraph, in compressed sparse row form */
+    /**@{*/
+    std::vector<int> coupling_offsets_; ///< Start of each qubit's couplings
+    std::vector<int> coupling_targets_; ///< Sorted targets of the couplings
+    std::vector<double>
         coupling_fidelities_; ///< The fidelities of two-qubit gates
+    /**@}*/
+
+    /** @name Undirected weighted graph used for paths */
+    /**@{*/
+    std::vector<int> neighbour_offsets_;
+    std::vector<int> neighbours_;
+    std::vector<double> neighbour_weights_; ///< -log of the fidelities
+    /**@}*/
 
     /** @name All-pairs-shortest-paths */
     /**@{*/
@@ -366,14 +522,354 @@ class Device {
         dist; ///< Distances returned by Floyd-Warshall
     std::vector<std::vector<int>>
         shortest_paths; ///< Matrix return by Floyd-Warshall
+    std::vector<std::vector<int>>
+        hops; ///< Lengths of the paths in shortest_paths, -1 if none
+    /**@}*/
+
+    /** @name Single-source shortest paths, for large devices */
+    /**@{*/
+    struct sparse_paths {
+        std::vector<double> dist; ///< Distances from the source
+        std::vector<int> prev;    ///< Predecessors, -1 if unreachable
+        std::vector<int> hops;    ///< Number of edges on each path
+    };
+    std::vector<std::shared_ptr<const sparse_paths>>
+        sparse_rows_;                ///< Cached sources, by qubit
+    std::deque<int> sparse_order_;   ///< Cached sources, oldest first
+    /**@}*/
+
+    /** @name Steiner trees */
+    /**@{*/
+    struct steiner_key {
+        int root;
+        std::vector<int> terminals; ///< Sorted, distinct and without root
+
+        bool operator==(const steiner_key& other) const {
+            return root == other.root && terminals == other.terminals;
+        }
+    };
+    struct steiner_key_hash {
+        std::size_t operator()(const steiner_key& key) const {
+            std::size_t ret = std::hash<int>()(key.root);
+            for (auto t : key.terminals)
+                ret ^= std::hash<int>()(t) + 0x9e3779b9 + (ret << 6) +
+                       (ret >> 2);
+            return ret;
+        }
+    };
+
+    /**
+     * \brief Least recently used cache of Steiner trees
+     *
+     * The index points into the list, so a copy rebuilds it over its own
+     * list rather than sharing the iterators of the original.
+     */
+    class steiner_cache {
+      public:
+        static constexpr std::size_t capacity = 1 << 12;
+
+        steiner_cache() = default;
+        steiner_cache(const steiner_cache& other) : lru_(other.lru_) {
+            reindex();
+        }
+        steiner_cache(steiner_cache&&) = default;
+        steiner_cache& operator=(const steiner_cache& other) {
+            if (this != &other) {
+                lru_ = other.lru_;
+                reindex();
+            }
+            return *this;
+        }
+        steiner_cache& operator=(steiner_cache&&) = default;
+
+        /** \brief The tree for a key, marked as most recently used */
+        const spanning_tree* find(const steiner_key& key) {
+            auto it = index_.find(key);
+            if (it == index_.end())
+                return nullptr;
+            lru_.splice(lru_.begin(), lru_, it->second);
+            return &it->second->second;
+        }
+
+        /** \brief Adds a tree, evicting the least recently used if full */
+        void insert(steiner_key key, const spanning_tree& tree) {
+            if (lru_.size() >= capacity) {
+                index_.erase(lru_.back().first);
+                lru_.pop_back();
+            }
+            lru_.emplace_front(key, tree);
+            index_.emplace(std::move(key), lru_.begin());
+        }
+
+      private:
+        using entry = std::pair<steiner_key, spanning_tree>;
+
+        std::list<entry> lru_; ///< Memoized trees, newest first
+        std::unordered_map<steiner_key, std::list<entry>::iterator,
+                           steiner_key_hash>
+            index_; ///< Memoized trees, by terminals and root
+
+        void reindex() {
+            index_.clear();
+            for (auto it = lru_.begin(); it != lru_.end(); it++)
+                index_.emplace(it->first, it);
+        }
+    } steiner_memo_; ///< Memoized trees
+
+    struct steiner_scratch {
+        std::vector<bool> in_tree; ///< By qubit, cleared after each use
+        std::vector<int> tree_nodes;
+        std::vector<double> cost; ///< By terminal
+        std::vector<int> edge_in; ///< By terminal
+        std::vector<bool> joined; ///< By terminal
+        std::vector<int> path;
+    } steiner_scratch_; ///< Buffers reused across Steiner tree computations
     /**@}*/
 
+    /**
+     * \brief Builds the sparse coupling graphs
+     * \param edges The couplings with their fidelities, sorted
+     */
+    void init_couplings(const std::vector<std::pair<coupling, double>>& edges) {
+        coupling_offsets_.assign(qubits_ + 1, 0);
+        coupling_targets_.clear();
+        coupling_fidelities_.clear();
+        for (auto& [c, f] : edges) {
+            coupling_offsets_[c.first + 1]++;
+            coupling_targets_.push_back(c.second);
+            coupling_fidelities_.push_back(f);
+        }
+        for (auto i = 0; i < qubits_; i++)
+            coupling_offsets_[i + 1] += coupling_offsets_[i];
+
+        // Swaps cost the same either way, so paths ignore directions,
+        // preferring the fidelity of the (i, j) coupling for the edge i -- j
+        std::vector<std::vector<std::pair<int, double>>> adj(qubits_);
+        for (auto& [c, f] : edges) {
+            auto [i, j] = c;
+            if (i == j)
+                continue;
+            adj[i].emplace_back(j, -std::log(f));
+            if (find_coupling(j, i) == -1)
+                adj[j].emplace_back(i, -std::log(f));
+        }
+        neighbour_offsets_.assign(1, 0);
+        neighbours_.clear();
+        neighbour_weights_.clear();
+        for (auto& row : adj) {
+            std::sort(row.begin(), row.end());
+            for (auto& [j, w] : row) {
+                neighbours_.push_back(j);
+                neighbour_weights_.push_back(w);
+            }
+            neighbour_offsets_.push_back(static_cast<int>(neighbours_.size()));
+        }
+    }
+
+    /**
+     * \brief Whether the successor and hop matrices describe paths
+     *
+     * Each successor is in range and one hop closer to the target, so that
+     * walking a path always ends at its target.
+     */
+    bool valid_paths() const {
+        for (auto i = 0; i < qubits_; i++) {
+            for (auto j = 0; j < qubits_; j++) {
+                auto k = shortest_paths[i][j];
+                auto len = hops[i][j];
+                if (i == j) {
+                    if (k != i || len != 0)
+                        return false;
+                } else if (k == qubits_) {
+                    if (len != -1)
+                        return false;
+                } else if (k < 0 || k >= qubits_ || k == i || len < 1 ||
+                           hops[k][j] != len - 1) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    /** \brief Index of a coupling in the sparse graph, or -1 */
+    int find_coupling(int i, int j) const {
+        auto first = coupling_targets_.begin() + coupling_offsets_[i];
+        auto last = coupling_targets_.begin() + coupling_offsets_[i + 1];
+        auto it = std::lower_bound(first, last, j);
+        if (it == last || *it != j)
+            return -1;
+        return static_cast<int>(it - coupling_targets_.begin());
+    }
+
+    /** \brief Weight of a shortest path between two qubits */
+    double weight(int i, int j) {
+        if (qubits_ > dense_limit)
+            return sparse_row(i).dist[j];
+        return dist[i][j];
+    }
+
+    /**
+     * \brief Dijkstra's single-source shortest paths, cached
+     * \note Only a bounded number of sources are kept, so the result is only
+     * valid until the next call
+     */
+    const sparse_paths& sparse_row(int src) {
+        if (sparse_rows_.empty())
+            sparse_rows_.resize(qubits_);
+        if (sparse_rows_[src])
+            return *sparse_rows_[src];
+
+        // Keep about 2^22 entries per table
+        auto capacity = std::max<std::size_t>(64, (1 << 22) / qubits_);
+        if (sparse_order_.size() >= capacity) {
+            sparse_rows_[sparse_order_.front()].reset();
+            sparse_order_.pop_front();
+        }
+
+        auto row = std::make_shared<sparse_paths>();
+        row->dist.assign(qubits_, -std::log(0.0000000001));
+        row->prev.assign(qubits_, -1);
+        row->hops.assign(qubits_, 0);
+
+        std::vector<bool> done(qubits_, false);
+        using entry = std::pair<double, int>;
+        std::priority_queue<entry, std::vector<entry>, std::greater<entry>>
+            queue;
+        row->dist[src] = 0;
+        row->prev[src] = src;
+        queue.emplace(0, src);
+        while (!queue.empty()) {
+            auto u = queue.top().second;
+            queue.pop();
+            if (done[u])
+                continue;
+            done[u] = true;
+
+            for (auto k = neighbour_offsets_[u]; k < neighbour_offsets_[u + 1];
+                 k++) {
+                auto v = neighbours_[k];
+                auto d = row->dist[u] + neighbour_weights_[k];
+                if (row->prev[v] == -1 || d < row->dist[v]) {
+                    row->dist[v] = d;
+                    row->prev[v] = u;
+                    row->hops[v] = row->hops[u] + 1;
+                    queue.emplace(d, v);
+                }
+            }
+        }
+
+        sparse_rows_[src] = row;
+        sparse_order_.push_back(src);
+        return *row;
+    }
+
+    /**
+     * \brief Writes a shortest path between two qubits into a buffer
+     * \see staq::mapping::Device::shortest_path
+     */
+    void walk_path(int i, int j, std::vector<int>& out) {
+        out.clear();
+        if (qubits_ > dense_limit) {
+            auto& row = sparse_row(i);
+            if (row.prev[j] != -1) {
+                for (auto v = j; v != i; v = row.prev[v])
+                    out.push_back(v);
+            }
+            out.push_back(i);
+            std::reverse(out.begin(), out.end());
+            return;
+        }
+
+        compute_shortest_paths();
+        out.push_back(i);
+        if (shortest_paths[i][j] == qubits_)
+            return;
+        while (i != j) {
+            i = shortest_paths[i][j];
+            out.push_back(i);
+        }
+    }
+
+    /**
+     * \brief Steiner tree heuristic
+     * \param terminals The terminals, sorted, distinct and without the root
+     * \param root The root
+     * \see staq::mapping::Device::steiner
+     */
+    spanning_tree compute_steiner(const std::vector<int>& terminals,
+                                  int root) {
+        compute_shortest_paths();
+
+        spanning_tree ret;
+        auto k = terminals.size();
+        auto& s = steiner_scratch_;
+        s.in_tree.resize(qubits_, false);
+        s.cost.assign(k, 0);
+        s.edge_in.assign(k, root);
+        s.joined.assign(k, false);
+
+        // Relaxes the cost of the remaining terminals against a tree node
+        auto relax = [&](int node) {
+            const double* w = qubits_ > dense_limit
+                                  ? sparse_row(node).dist.data()
+                                  : dist[node].data();
+            for (std::size_t t = 0; t < k; t++) {
+                if (!s.joined[t] && w[terminals[t]] < s.cost[t]) {
+                    s.cost[t] = w[terminals[t]];
+                    s.edge_in[t] = node;
+                }
+            }
+        };
+
+        s.in_tree[root] = true;
+        s.tree_nodes.assign(1, root);
+        {
+            const double* w = qubits_ > dense_limit
+                                  ? sparse_row(root).dist.data()
+                                  : dist[root].data();
+            for (std::size_t t = 0; t < k; t++)
+                s.cost[t] = w[terminals[t]];
+        }
+
+        for (std::size_t step = 0; step < k; step++) {
+            std::size_t next = k;
+            for (std::size_t t = 0; t < k; t++) {
+                if (!s.joined[t] && (next == k || s.cost[t] < s.cost[next]))
+                    next = t;
+            }
+            s.joined[next] = true;
+
+            // Join the path at its last node already in the tree
+            walk_path(s.edge_in[next], terminals[next], s.path);
+            auto first = s.path.size() - 1;
+            while (first > 0 && !s.in_tree[s.path[first]])
+                first--;
+            for (auto i = first; i + 1 < s.path.size(); i++) {
+                ret.emplace_back(s.path[i], s.path[i + 1]);
+                s.in_tree[s.path[i + 1]] = true;
+                s.tree_nodes.push_back(s.path[i + 1]);
+            }
+
+            std::sort(s.path.begin() + first, s.path.end());
+            for (auto i = first; i < s.path.size(); i++)
+                relax(s.path[i]);
+        }
+
+        for (auto node : s.tree_nodes)
+            s.in_tree[node] = false;
+
+        return ret;
+    }
+
     /**
      * \brief Floyd-Warshall all-pairs-shortest-paths algorithm
-     * \note Assigns result to dist and shortest_paths
+     * \note Assigns result to dist, shortest_paths and hops, and does nothing
+     * for devices over the dense limit
      */
     void compute_shortest_paths() {
-        if (dist.empty() || shortest_paths.empty()) {
+        if (qubits_ <= dense_limit &&
+            (dist.empty() || shortest_paths.empty())) {
             // Initialize
             dist = std::vector<std::vector<double>>(
                 qubits_, std::vector<double>(qubits_));
@@ -383,21 +879,18 @@ class Device {
             // All-pairs shortest paths
             for (auto i = 0; i < qubits_; i++) {
                 for (auto j = 0; j < qubits_; j++) {
-                    if (i == j) {
-                        dist[i][j] = 0;
-                        shortest_paths[i][j] = j;
-                    } else if (couplings_[i][j]) {
-                        dist[i][j] = -std::log(coupling_fidelities_[i][j]);
-                        shortest_paths[i][j] = j;
-                    } else if (couplings_[j][i]) { // Since swaps are the same
-                                                   // cost either direction
-                        dist[i][j] = -std::log(coupling_fidelities_[j][i]);
-                        shortest_paths[i][j] = j;
-                    } else {
-                        dist[i][j] =
-                            -std::log(0.0000000001); // Effectively infinite
-                        shortest_paths[i][j] = qubits_;
-                    }
+                    dist[i][j] =
+                        -std::log(0.0000000001); // Effectively infinite
+                    shortest_paths[i][j] = qubits_;
+                }
+                dist[i][i] = 0;
+                shortest_paths[i][i] = i;
+
+                // Since swaps are the same cost either direction
+                for (auto k = neighbour_offsets_[i];
+                     k < neighbour_offsets_[i + 1]; k++) {
+                    dist[i][neighbours_[k]] = neighbour_weights_[k];
+                    shortest_paths[i][neighbours_[k]] = neighbours_[k];
                 }
             }
 
@@ -411,62 +904,56 @@ class Device {
                     }
                 }
             }
-        }
-    }
 
-    /**
-     * \brief Adds a path to a spanning tree
-     *
-     * Inserts a path into a spanning tree so that edges are not duplicated, and
-     * moreover maintains the spanning tree property & the topological order on
-     * the tree
-     *
-     * \param s_tree The input spanning tree
-     * \param p Const reference to the path to be inserted
-     * \param in_tree The set of nodes already in the tree
-     * \return The set of nodes in the resulting spanning tree
-     */
-    std::set<int> add_to_tree(spanning_tree& s_tree, const path& p,
-                              const std::set<int>& in_tree) {
-        std::set<int> ret;
-
-        int next = -1;
-        auto insert_iter = s_tree.end();
-        for (auto it = p.rbegin(); it != p.rend(); it++) {
-            // If we're not at the endpoint, insert the edge
-            if (next != -1) {
-                s_tree.insert(insert_iter, std::make_pair(*it, next));
-                --insert_iter;
+            // Path lengths, walking each path only up to a known length
+            hops = std::vector<std::vector<int>>(
+                qubits_, std::vector<int>(qubits_, qubits_));
+            std::vector<int> stack;
+            for (auto j = 0; j < qubits_; j++) {
+                hops[j][j] = 0;
+                for (auto i = 0; i < qubits_; i++) {
+                    auto k = i;
+                    while (hops[k][j] == qubits_ &&
+                           shortest_paths[k][j] != qubits_) {
+                        stack.push_back(k);
+                        k = shortest_paths[k][j];
+                    }
+                    auto len = hops[k][j] == qubits_ ? -1 : hops[k][j];
+                    for (; !stack.empty(); stack.pop_back()) {
+                        if (len != -1)
+                            len++;
+                        hops[stack.back()][j] = len;
+                    }
+                    if (hops[i][j] == qubits_)
+                        hops[i][j] = -1;
+                }
             }
-            next = *it;
-            ret.insert(*it);
-
-            // If the current node is already in the tree, we're done
-            if (in_tree.find(*it) != in_tree.end())
-                break;
         }
-
-        return ret;
     }
 };
 
+/** \brief 64-bit FNV-1a hash, keying device caches by their source */
+inline std::uint64_t fnv1a(const std::string& data) {
+    std::uint64_t ret = 0xcbf29ce484222325ULL;
+    for (unsigned char c : data) {
+        ret ^= c;
+        ret *= 0x100000001b3ULL;
+    }
+    return ret;
+}
+
 /**
- * \brief JSON deserialization of Device object
- * The JSON object should have:
- * - name: string
- * - qubits: list of {{id: int}, optional {fidelity: double}}
- * - couplings: list of {{control: int}, {target: int}, optional {fidelity:
- * double}} Unspecified fidelities are set to a default value
+ * \brief JSON deserialization of Device object from a string
+ * \see staq::mapping::parse_json
  */
-inline Device parse_json(std::string fname) {
-    std::ifstream ifs(fname);
-    json j = json::parse(ifs);
+inline Device parse_json_string(const std::string& text) {
+    json j = json::parse(text);
 
     std::string name = j["name"];
     int n = j["qubits"].size();
-    std::vector<std::vector<bool>> dag(n, std::vector<bool>(n));
+    std::set<coupling> dag;
     std::vector<double> sq_fi(n);
-    std::vector<std::vector<double>> tq_fi(n, std::vector<double>(n));
+    std::vector<std::pair<coupling, double>> tq_fi;
 
     for (json& qubit : j["qubits"]) {
         int id = qubit["id"];
@@ -491,17 +978,74 @@ inline Device parse_json(std::string fname) {
         if (x == y) {
             throw std::logic_error("Qubit can't be coupled with itself");
         }
-        if (dag[x][y]) {
+        if (!dag.insert(std::make_pair(x, y)).second) {
             throw std::logic_error("Duplicate coupling");
         }
-        dag[x][y] = true;
         auto it = coupling.find("fidelity");
         if (it != coupling.end())
-            tq_fi[x][y] = *it;
+            tq_fi.emplace_back(std::make_pair(x, y), *it);
         else
-            tq_fi[x][y] = FIDELITY_1;
+            tq_fi.emplace_back(std::make_pair(x, y), FIDELITY_1);
     }
-    return Device(name, n, dag, sq_fi, tq_fi);
+    return Device(name, n, std::move(tq_fi), sq_fi);
+}
+
+/**
+ * \brief JSON deserialization of Device object
+ * The JSON object should have:
+ * - name: string
+ * - qubits: list of {{id: int}, optional {fidelity: double}}
+ * - couplings: list of {{control: int}, {target: int}, optional {fidelity:
+ * double}} Unspecified fidelities are set to a default value
+ *
+ * Optionally, the device and its shortest paths are cached next to the JSON
+ * file, in fname + ".cache", keyed by a hash of the JSON text. A valid cache
+ * is loaded in place of parsing, and a missing or stale one is (re)written
+ * when possible.
+ *
+ * \param fname The JSON file
+ * \param cache Whether to use the cache
+ */
+inline Device parse_json(std::string fname, bool cache = false) {
+    std::ifstream ifs(fname, std::ios::binary);
+    std::string text((std::istreambuf_iterator<char>(ifs)),
+                     std::istreambuf_iterator<char>());
+    if (!cache)
+        return parse_json_string(text);
+
+    auto key = fnv1a(text);
+    auto cache_name = fname + ".cache";
+    {
+        std::ifstream is(cache_name, std::ios::binary);
+        if (is) {
+            if (auto ret = Device::read_cache(is, key))
+                return std::move(*ret);
+        }
+    }
+
+    auto ret = parse_json_string(text);
+
+    // Write to a temporary file first, so that concurrent runs never read a
+    // partial cache. Failing to write the cache is not an error.
+    auto tmp = cache_name + "." + std::to_string(std::random_device()()) +
+               ".tmp";
+    bool written = false;
+    {
+        std::ofstream os(tmp, std::ios::binary);
+        if (os) {
+            ret.write_cache(os, key);
+            written = static_cast<bool>(os);
+        }
+    }
+    if (!written || std::rename(tmp.c_str(), cache_name.c_str()) != 0) {
+        // Renaming over an existing file fails on some platforms
+        if (written && std::remove(cache_name.c_str()) == 0 &&
+            std::rename(tmp.c_str(), cache_name.c_str()) == 0)
+            return ret;
+        std::remove(tmp.c_str());
+    }
+
+    return ret;
 }
 
 /** \brief Generates a fully connected device with a given number of qubits */
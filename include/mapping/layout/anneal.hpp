@@ -0,0 +1,334 @@
+/*
+ * This file is part of staq.
+ *
+ * Copyright (c) 2019 - 2021 softwareQ Inc. All rights reserved.
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * \file mapping/layout/anneal.hpp
+ * \brief Simulated annealing layout generation
+ */
+
+#pragma once
+
+#include "mapping/device.hpp"
+#include "mapping/layout/bestfit.hpp"
+#include "mapping/mapping/steiner.hpp"
+#include "tools/parallel.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace staq {
+namespace mapping {
+
+/**
+ * \class staq::mapping::AnnealLayout
+ * \brief An initial layout found by multi-start simulated annealing
+ *
+ * Anneals the placement of the virtual qubits against a cost model, either
+ * the CNOT count of the Steiner mapper or an estimate of the number of swaps
+ * the swap mapper inserts, namely the number of extra hops between the
+ * arguments of each CNOT gate. A move relocates a virtual qubit to another
+ * physical qubit, swapping with its occupant if any, and is scored by
+ * re-evaluating only the cost terms acting on the qubits moved.
+ *
+ * The first restart starts from the best-fit layout and the others from
+ * random layouts. Restarts run on worker threads, each from its own seed,
+ * and the cheapest result wins with ties going to the earliest restart, so
+ * without a time budget the layout depends only on the seed.
+ */
+class AnnealLayout {
+  public:
+    enum class cost_model { steiner, swap };
+
+    struct config {
+        cost_model cost = cost_model::steiner;
+        unsigned restarts = 8;      ///< number of annealing runs
+        std::size_t iterations = 0; ///< moves per run, 0 = automatic
+        std::uint64_t seed = 0;     ///< seed of the random number generators
+        unsigned threads = 1;       ///< threads, 0 = hardware concurrency
+        double time_budget = 0;     ///< wall-clock seconds, 0 = unlimited
+    };
+
+    AnnealLayout(Device& device) : AnnealLayout(device, config()) {}
+    AnnealLayout(Device& device, const config& params)
+        : device_(device), config_(params) {}
+
+    /** \brief Main generation method */
+    layout generate(ast::Program& prog) {
+        start_ = std::chrono::steady_clock::now();
+
+        auto summary = summarize_steiner(prog);
+        auto nv = summary.qubits.size();
+        if (nv > static_cast<std::size_t>(device_.qubits_))
+            throw std::logic_error("Not enough physical qubits");
+
+        init_terms(summary);
+        auto init = summary.place(compute_bestfit_layout(device_, prog));
+
+        auto restarts = std::max(config_.restarts, 1u);
+        auto threads = tools::num_threads(config_.threads, restarts);
+        std::vector<Device> devices(threads, device_);
+        std::vector<synthesis::linear_op<bool>> identities(
+            threads, synthesis::identity(device_.qubits_));
+
+        std::vector<run_result> results(restarts);
+        tools::parallel_for(restarts, threads,
+                            [&](unsigned worker, std::size_t r) {
+                                results[r] = anneal(r, init, devices[worker],
+                                                    identities[worker]);
+                            });
+
+        auto best = std::min_element(results.begin(), results.end(),
+                                     [](const auto& a, const auto& b) {
+                                         return a.cost < b.cost;
+                                     });
+
+        layout ret;
+        for (std::size_t v = 0; v < nv; v++)
+            ret[summary.qubits[v]] = best->phys[v];
+
+        return ret;
+    }
+
+  private:
+    struct interaction {
+        int ctrl, tgt; // virtual qubits
+        int count;     // number of CNOT gates
+    };
+    struct run_result {
+        long cost = 0;
+        std::vector<int> phys;
+    };
+
+    Device device_;
+    config config_;
+    std::chrono::steady_clock::time_point start_;
+
+    std::vector<steiner_block> blocks_;     ///< terms of the Steiner model
+    std::vector<interaction> interactions_; ///< terms of the swap model
+    std::vector<std::vector<int>> hops_;    ///< physical distances
+    std::vector<std::vector<std::size_t>> terms_on_; ///< by virtual qubit
+
+    void init_terms(const steiner_summary& summary) {
+        blocks_.clear();
+        interactions_.clear();
+        terms_on_.assign(summary.qubits.size(), {});
+
+        if (config_.cost == cost_model::steiner) {
+            blocks_ = summary.blocks();
+            for (std::size_t t = 0; t < blocks_.size(); t++) {
+                for (auto v : blocks_[t].support)
+                    terms_on_[v].push_back(t);
+            }
+        } else {
+            std::map<std::pair<int, int>, int> counts;
+            for (auto& [a, b] : summary.ops) {
+                if (a >= 0 && b >= 0)
+                    counts[{a, b}]++;
+            }
+            for (auto& [args, count] : counts) {
+                terms_on_[args.first].push_back(interactions_.size());
+                terms_on_[args.second].push_back(interactions_.size());
+                interactions_.push_back({args.first, args.second, count});
+            }
+
+            auto n = device_.qubits_;
+            hops_.assign(n, std::vector<int>(n, 0));
+            for (int i = 0; i < n; i++) {
+                for (int j = 0; j < n; j++) {
+                    auto d = device_.distance(i, j);
+                    hops_[i][j] = d < 0 ? n : d;
+                }
+            }
+        }
+    }
+
+    std::size_t num_terms() const {
+        return config_.cost == cost_model::steiner ? blocks_.size()
+                                                   : interactions_.size();
+    }
+
+    long term_cost(std::size_t t, const std::vector<int>& phys, Device& device,
+                   synthesis::linear_op<bool>& identity) const {
+        if (config_.cost == cost_model::steiner)
+            return steiner_cost(blocks_[t], phys, device, identity);
+
+        auto& term = interactions_[t];
+        auto d = hops_[phys[term.ctrl]][phys[term.tgt]];
+        return static_cast<long>(term.count) * std::max(d - 1, 0);
+    }
+
+    bool out_of_time() const {
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start_;
+        return config_.time_budget > 0 &&
+               elapsed.count() >= config_.time_budget;
+    }
+
+    // One annealing run, from the best-fit layout for the first run and
+    // from a random layout otherwise
+    run_result anneal(std::size_t r, const std::vector<int>& init,
+                      Device& device,
+                      synthesis::linear_op<bool>& identity) const {
+        auto n = static_cast<std::size_t>(device.qubits_);
+        auto nv = init.size();
+        std::mt19937_64 gen(config_.seed + 0x9e3779b97f4a7c15ULL * r);
+        auto uniform = [&gen](std::size_t k) { return gen() % k; };
+        auto real = [&gen]() { return (gen() >> 11) * 0x1.0p-53; };
+
+        // Placement of virtual qubits and occupants of physical qubits
+        std::vector<int> phys = init;
+        if (r != 0) {
+            std::vector<int> perm(n);
+            for (std::size_t i = 0; i < n; i++)
+                perm[i] = static_cast<int>(i);
+            for (std::size_t i = n; i > 1; i--)
+                std::swap(perm[i - 1], perm[uniform(i)]);
+            std::copy(perm.begin(), perm.begin() + nv, phys.begin());
+        }
+        std::vector<int> occupant(n, -1);
+        for (std::size_t v = 0; v < nv; v++)
+            occupant[phys[v]] = static_cast<int>(v);
+
+        std::vector<long> cost(num_terms());
+        long total = 0;
+        for (std::size_t t = 0; t < cost.size(); t++)
+            total += cost[t] = term_cost(t, phys, device, identity);
+
+        run_result best{total, phys};
+        if (nv == 0 || n < 2 || cost.empty())
+            return best;
+
+        // Moves virtual qubit u to physical qubit p, swapping with the
+        // occupant of p, and returns the occupant
+        auto relocate = [&](int u, int p) {
+            auto v = occupant[p];
+            if (v != -1)
+                phys[v] = phys[u];
+            occupant[phys[u]] = v;
+            occupant[p] = u;
+            phys[u] = p;
+            return v;
+        };
+
+        // Change in cost after moving u and v, along with the new cost of
+        // the affected terms
+        std::vector<std::size_t> affected;
+        std::vector<long> updated;
+        auto score = [&](int u, int v) {
+            affected.clear();
+            if (v == -1) {
+                affected = terms_on_[u];
+            } else {
+                std::set_union(terms_on_[u].begin(), terms_on_[u].end(),
+                               terms_on_[v].begin(), terms_on_[v].end(),
+                               std::back_inserter(affected));
+            }
+
+            long delta = 0;
+            updated.clear();
+            for (auto t : affected) {
+                updated.push_back(term_cost(t, phys, device, identity));
+                delta += updated.back() - cost[t];
+            }
+            return delta;
+        };
+        auto random_move = [&](int& u, int& p) {
+            u = static_cast<int>(uniform(nv));
+            p = static_cast<int>(uniform(n - 1));
+            if (p >= phys[u])
+                p++;
+        };
+
+        // Initial temperature from the average uphill move
+        long uphill = 0;
+        int samples = 0;
+        for (int i = 0; i < 32; i++) {
+            int u, p;
+            random_move(u, p);
+            auto from = phys[u];
+            auto delta = score(u, relocate(u, p));
+            if (delta > 0) {
+                uphill += delta;
+                samples++;
+            }
+            relocate(u, from);
+        }
+        double t0 = samples == 0 ? 1.0 : static_cast<double>(uphill) / samples;
+        double t1 = t0 * 1e-3;
+
+        auto iterations = config_.iterations;
+        if (iterations == 0)
+            iterations = nv * (config_.cost == cost_model::steiner ? 50 : 2000);
+
+        for (std::size_t i = 0; i < iterations; i++) {
+            if (i % 64 == 0 && out_of_time())
+                break;
+
+            auto temp = t0 * std::pow(t1 / t0, static_cast<double>(i) /
+                                                   iterations);
+            int u, p;
+            random_move(u, p);
+            auto from = phys[u];
+            auto delta = score(u, relocate(u, p));
+
+            if (delta <= 0 || real() < std::exp(-delta / temp)) {
+                for (std::size_t k = 0; k < affected.size(); k++)
+                    cost[affected[k]] = updated[k];
+                total += delta;
+                if (total < best.cost) {
+                    best.cost = total;
+                    best.phys = phys;
+                }
+            } else {
+                relocate(u, from);
+            }
+        }
+
+        return best;
+    }
+};
+
+/** \brief Generates a simulated annealing layout for a program on a device */
+inline layout compute_anneal_layout(Device& device, ast::Program& prog) {
+    AnnealLayout gen(device);
+    return gen.generate(prog);
+}
+
+/** \brief Generates a simulated annealing layout with configuration */
+inline layout compute_anneal_layout(Device& device, ast::Program& prog,
+                                    const AnnealLayout::config& params) {
+    AnnealLayout gen(device, params);
+    return gen.generate(prog);
+}
+
+} // namespace mapping
+} // namespace staq
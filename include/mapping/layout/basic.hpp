@@ -34,6 +34,7 @@
 #include "qasmtools/ast/replacer.hpp"
 #include "qasmtools/ast/traversal.hpp"
 #include "transformations/substitution.hpp"
+#include "transformations/desugar.hpp"
 #include "mapping/device.hpp"
 
 #include <cstddef>
@@ -53,7 +54,9 @@ namespace parser = qasmtools::parser;
  * accesses to addresses of physical qubits -- and rewrites
  * the AST so that all variable accesses refer to the
  * relevant address of a global register representing
- * the physical qubits
+ * the physical qubits. Statements applied to whole registers
+ * have no counterpart in the global register, so they are
+ * first expanded to one statement per qubit
  */
 class LayoutTransformer final : public ast::Replacer {
   public:
@@ -71,8 +74,10 @@ class LayoutTransformer final : public ast::Replacer {
 
     /** \brief Main transformation method */
     void run(ast::Program& prog, const layout& l, const Device& d) {
-        // Visit entire program, removing register declarations, then
-        // add the physical register & apply substitutions
+        // Expand register-wide statements, visit entire program removing
+        // register declarations, then add the physical register & apply
+        // substitutions
+        transformations::desugar(prog);
         prog.accept(*this);
 
         // Physical register declaration
@@ -32,9 +32,13 @@
 #pragma once
 
 #include "qasmtools/ast/traversal.hpp"
+#include "qasmtools/ast/numbering.hpp"
 #include "mapping/device.hpp"
 
-#include <map>
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
 
 namespace staq {
 namespace mapping {
@@ -58,6 +62,7 @@ class BestFit final : public ast::Traverse {
     layout generate(ast::Program& prog) {
         allocated_ = std::vector<bool>(device_.qubits_, false);
         access_paths_.clear();
+        qubits_.clear();
         histogram_.clear();
 
         prog.accept(*this);
@@ -76,14 +81,17 @@ class BestFit final : public ast::Traverse {
     }
 
     void visit(ast::CNOTGate& gate) override {
-        histogram_[std::make_pair(gate.ctrl(), gate.tgt())] += 1;
+        auto ctrl = static_cast<std::uint64_t>(qubits_.index(gate.ctrl()));
+        auto tgt = static_cast<std::uint64_t>(qubits_.index(gate.tgt()));
+        histogram_[(ctrl << 32) | tgt] += 1;
     }
 
   private:
     Device device_;
     std::vector<bool> allocated_;
     std::set<ast::VarAccess> access_paths_;
-    std::map<std::pair<ast::VarAccess, ast::VarAccess>, int> histogram_;
+    ast::QubitNumbering qubits_; ///< dense IDs of CNOT arguments
+    std::unordered_map<std::uint64_t, int> histogram_; ///< keyed by ID pairs
 
     /**
      * \brief Assigns physical qubits based on the computed histogram of
@@ -92,15 +100,25 @@ class BestFit final : public ast::Traverse {
     layout fit_histogram() {
         layout ret;
 
-        // Sort in order of decreasing number of two-qubit gates
+        // Sort in order of decreasing number of two-qubit gates, breaking
+        // ties by the order of the arguments
         using mapping =
             std::pair<std::pair<ast::VarAccess, ast::VarAccess>, int>;
-        using comparator = std::function<bool(mapping, mapping)>;
-        comparator cmp = [](mapping a, mapping b) {
-            return a.second > b.second;
-        };
-        std::list<mapping> pairs(histogram_.begin(), histogram_.end());
-        pairs.sort(cmp);
+        std::vector<mapping> pairs;
+        pairs.reserve(histogram_.size());
+        for (auto& [key, val] : histogram_) {
+            pairs.emplace_back(
+                std::make_pair(qubits_.access(static_cast<int>(key >> 32)),
+                               qubits_.access(static_cast<int>(
+                                   key & 0xffffffff))),
+                val);
+        }
+        std::sort(pairs.begin(), pairs.end(),
+                  [](const mapping& a, const mapping& b) {
+                      if (a.second != b.second)
+                          return a.second > b.second;
+                      return a.first < b.first;
+                  });
 
         // For each pair with CNOT gates between them, try to assign a coupling
         auto couplings = device_.couplings();
@@ -161,7 +179,7 @@ class BestFit final : public ast::Traverse {
 };
 
 /** \brief Generates a best-fit layout for a program on a physical device */
-layout compute_bestfit_layout(Device& device, ast::Program& prog) {
+inline layout compute_bestfit_layout(Device& device, ast::Program& prog) {
     BestFit gen(device);
     return gen.generate(prog);
 }
@@ -0,0 +1,571 @@
+/*
+ * This file is part of staq.
+ *
+ * Copyright (c) 2019 - 2021 softwareQ Inc. All rights reserved.
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * \file mapping/mapping/sabre.hpp
+ * \brief Lookahead swap-inserting mapping
+ */
+
+#pragma once
+
+#include "qasmtools/ast/replacer.hpp"
+#include "qasmtools/ast/traversal.hpp"
+#include "transformations/desugar.hpp"
+#include "mapping/device.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <list>
+#include <map>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace staq {
+namespace mapping {
+
+namespace ast = qasmtools::ast;
+namespace parser = qasmtools::parser;
+
+/**
+ * \class staq::mapping::SabreMapper
+ * \brief SABRE-style swap-inserting mapping algorithm
+ * \note Assumes the circuit has a single global register with the configured
+ * name
+ *
+ * Maps an AST to a given device following Li, Ding and Xie, "Tackling the
+ * qubit mapping problem for NISQ-era quantum devices". The statements of the
+ * program are ordered by the qubits and classical registers they act on, and
+ * the front layer of this dependence graph is executed until only non-local
+ * CNOT gates remain. A swap is then chosen among the couplings touching the
+ * front layer, scoring the distance between the arguments of the front layer
+ * and of a lookahead set of upcoming CNOT gates, with a decay factor on
+ * recently swapped qubits to spread swaps out. Statements may therefore be
+ * reordered, but only past statements acting on different qubits and bits.
+ *
+ * Statements applied across whole registers are first expanded to one
+ * statement per qubit, so that every access can follow the placement.
+ *
+ * Before routing, backward and forward dry runs refine the starting
+ * placement, which is kept if it needs fewer swaps. As with the swap mapper,
+ * the result is the final permutation of the qubits.
+ */
+class SabreMapper final : public ast::Replacer {
+  public:
+    struct config {
+        std::string register_name = "q";
+        int extended_set_size = 20;        ///< CNOT gates in the lookahead
+        double extended_set_weight = 0.5;  ///< weight of the lookahead
+        double decay_delta = 0.001;        ///< decay added per swap
+        int decay_reset = 5;               ///< swaps between decay resets
+        int refinement_passes = 1;         ///< backward/forward dry runs
+    };
+
+    SabreMapper(Device& device) : SabreMapper(device, config()) {}
+    SabreMapper(Device& device, const config& params)
+        : Replacer(), device_(device), config_(params) {}
+
+    /**
+     * \brief Routes the program
+     * \return The final physical qubit of each qubit of the register
+     */
+    std::map<int, int> run(ast::Program& prog) {
+        auto n = device_.qubits_;
+        transformations::desugar(prog);
+        init_device();
+        build_dag(prog);
+
+        // Refine the starting placement with dry runs
+        std::vector<int> identity(n);
+        for (int i = 0; i < n; i++)
+            identity[i] = i;
+        auto start = identity;
+        auto refined = identity;
+        for (int i = 0; i < config_.refinement_passes; i++) {
+            refined = route(refined, false, nullptr).placement;
+            refined = route(refined, true, nullptr).placement;
+        }
+        if (config_.refinement_passes > 0 &&
+            route(refined, false, nullptr).swaps <
+                route(identity, false, nullptr).swaps)
+            start = refined;
+
+        std::vector<event> schedule;
+        auto result = route(start, false, &schedule);
+        emit(prog, start, schedule);
+
+        // Fix the direction of CNOT gates against the couplings
+        prog.accept(*this);
+
+        initial_.clear();
+        std::map<int, int> ret;
+        for (int i = 0; i < n; i++) {
+            initial_[i] = start[i];
+            ret[i] = result.placement[i];
+        }
+        return ret;
+    }
+
+    /** \brief The starting physical qubit of each qubit of the register */
+    const std::map<int, int>& initial_permutation() const { return initial_; }
+
+    // Ignore declarations if they were left in during inlining
+    void visit(ast::GateDecl&) override {}
+    void visit(ast::OracleDecl&) override {}
+
+    std::optional<std::list<ast::ptr<ast::Gate>>>
+    replace(ast::CNOTGate& gate) override {
+        auto ctrl = *(gate.ctrl().offset());
+        auto tgt = *(gate.tgt().offset());
+        if (device_.coupled(ctrl, tgt) || !device_.coupled(tgt, ctrl))
+            return std::nullopt;
+
+        std::list<ast::ptr<ast::Gate>> ret;
+        ret.emplace_back(generate_hadamard(ctrl, gate.pos()));
+        ret.emplace_back(generate_hadamard(tgt, gate.pos()));
+        ret.emplace_back(generate_cnot(tgt, ctrl, gate.pos()));
+        ret.emplace_back(generate_hadamard(ctrl, gate.pos()));
+        ret.emplace_back(generate_hadamard(tgt, gate.pos()));
+        return std::move(ret);
+    }
+
+  private:
+    // A statement of the program in the dependence graph
+    struct node {
+        int ctrl = -1, tgt = -1; // arguments of a CNOT gate, if any
+        std::vector<int> preds, succs;
+    };
+    // A statement (node, -1, -1) or a swap (-1, i, j) of the schedule
+    struct event {
+        int node, i, j;
+    };
+    struct route_result {
+        std::vector<int> placement;
+        int swaps = 0;
+    };
+
+    Device device_;
+    config config_;
+    std::map<int, int> initial_;
+
+    std::vector<std::vector<int>> neighbours_; ///< undirected couplings
+    std::vector<std::vector<int>> hops_;       ///< undirected distances
+    std::vector<node> dag_;
+    std::vector<ast::ptr<ast::Stmt>> stmts_;
+
+    // Collects the qubits, classical registers and CNOT arguments of a
+    // statement
+    class Resources final : public ast::Traverse {
+      public:
+        Resources(const std::string& qreg, int qubits,
+                  std::unordered_map<std::string, int>& cregs)
+            : qreg_(qreg), qubits_(qubits), cregs_(cregs) {}
+
+        std::vector<int> ids;
+        int ctrl = -1, tgt = -1;
+
+        void visit(ast::GateDecl&) override {}
+        void visit(ast::RegisterDecl& decl) override {
+            if (decl.is_quantum() && decl.id() == qreg_)
+                all_qubits();
+            else if (!decl.is_quantum())
+                creg(decl.id());
+        }
+        void visit(ast::VarAccess& va) override {
+            if (va.var() != qreg_)
+                creg(va.var());
+            else if (va.offset() && 0 <= *va.offset() &&
+                     *va.offset() < qubits_)
+                ids.push_back(*va.offset());
+            else if (va.offset())
+                throw std::logic_error("Qubit out of device bounds!");
+            else
+                all_qubits();
+        }
+        void visit(ast::IfStmt& stmt) override {
+            creg(stmt.var());
+            Traverse::visit(stmt);
+        }
+        void visit(ast::CNOTGate& gate) override {
+            Traverse::visit(gate);
+            if (gate.ctrl().offset() && gate.tgt().offset()) {
+                ctrl = *gate.ctrl().offset();
+                tgt = *gate.tgt().offset();
+            }
+        }
+
+      private:
+        const std::string& qreg_;
+        int qubits_;
+        std::unordered_map<std::string, int>& cregs_;
+
+        void all_qubits() {
+            for (int i = 0; i < qubits_; i++)
+                ids.push_back(i);
+        }
+        void creg(const std::string& name) {
+            auto it = cregs_.emplace(name, static_cast<int>(cregs_.size()));
+            ids.push_back(qubits_ + it.first->second);
+        }
+    };
+
+    // Relabels the qubits of a statement with their current placement
+    class Relabel final : public ast::Replacer {
+      public:
+        Relabel(const std::string& qreg, const std::vector<int>& placement)
+            : qreg_(qreg), placement_(placement) {}
+
+        std::optional<ast::VarAccess> replace(ast::VarAccess& va) override {
+            if (va.var() != qreg_)
+                return std::nullopt;
+            if (!va.offset())
+                throw std::logic_error("Register-wide access to " + qreg_ +
+                                       " in SABRE mapping");
+            return ast::VarAccess(va.pos(), va.var(),
+                                  placement_[*va.offset()]);
+        }
+
+      private:
+        const std::string& qreg_;
+        const std::vector<int>& placement_;
+    };
+
+    void init_device() {
+        auto n = device_.qubits_;
+        neighbours_.assign(n, {});
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                if (i != j &&
+                    (device_.coupled(i, j) || device_.coupled(j, i)))
+                    neighbours_[i].push_back(j);
+            }
+        }
+
+        // Breadth-first search from each qubit
+        hops_.assign(n, std::vector<int>(n, n));
+        for (int i = 0; i < n; i++) {
+            std::vector<int> queue{i};
+            hops_[i][i] = 0;
+            for (std::size_t k = 0; k < queue.size(); k++) {
+                auto u = queue[k];
+                for (auto v : neighbours_[u]) {
+                    if (hops_[i][v] == n) {
+                        hops_[i][v] = hops_[i][u] + 1;
+                        queue.push_back(v);
+                    }
+                }
+            }
+        }
+    }
+
+    void build_dag(ast::Program& prog) {
+        auto n = device_.qubits_;
+        dag_.clear();
+        stmts_.clear();
+
+        std::unordered_map<std::string, int> cregs;
+        std::vector<int> last;
+        std::vector<int> seen;
+        for (auto& stmt : prog.body()) {
+            int id = static_cast<int>(dag_.size());
+            Resources res(config_.register_name, n, cregs);
+            stmt->accept(res);
+
+            node v;
+            if (res.ctrl != -1 && res.ctrl != res.tgt) {
+                v.ctrl = res.ctrl;
+                v.tgt = res.tgt;
+            }
+            for (auto r : res.ids) {
+                if (static_cast<std::size_t>(r) >= last.size())
+                    last.resize(r + 1, -1);
+                auto pred = last[r];
+                last[r] = id;
+                if (pred == -1)
+                    continue;
+                if (static_cast<std::size_t>(pred) >= seen.size())
+                    seen.resize(pred + 1, -1);
+                if (seen[pred] == id)
+                    continue;
+                seen[pred] = id;
+                v.preds.push_back(pred);
+                dag_[pred].succs.push_back(id);
+            }
+
+            dag_.emplace_back(std::move(v));
+            stmts_.emplace_back(std::move(stmt));
+        }
+        prog.body().clear();
+    }
+
+    int distance(const node& v, const std::vector<int>& placement) const {
+        return hops_[placement[v.ctrl]][placement[v.tgt]];
+    }
+
+    // Routes the dependence graph from a placement, forwards or backwards,
+    // optionally recording the schedule
+    route_result route(std::vector<int> placement, bool backward,
+                       std::vector<event>* schedule) const {
+        auto n = device_.qubits_;
+        std::vector<int> occupant(n);
+        for (int i = 0; i < n; i++)
+            occupant[placement[i]] = i;
+
+        auto next = [backward](const node& v) -> const std::vector<int>& {
+            return backward ? v.preds : v.succs;
+        };
+        std::vector<int> waiting(dag_.size());
+        std::priority_queue<int, std::vector<int>, std::greater<int>> ready;
+        for (std::size_t k = 0; k < dag_.size(); k++) {
+            auto id = backward ? static_cast<int>(dag_.size() - 1 - k)
+                               : static_cast<int>(k);
+            waiting[id] = static_cast<int>(backward ? dag_[id].succs.size()
+                                                    : dag_[id].preds.size());
+            if (waiting[id] == 0)
+                ready.push(static_cast<int>(k));
+        }
+        auto node_of = [&](int k) {
+            return backward ? static_cast<int>(dag_.size() - 1 - k) : k;
+        };
+        auto key_of = node_of;
+
+        std::vector<double> decay(n, 1.0);
+        std::vector<int> stamp(dag_.size(), -1);
+        std::vector<int> front, extended;
+        std::vector<std::pair<int, int>> candidates;
+        route_result ret;
+        int round = 0;
+        int swaps_since_reset = 0;
+        int stalled = 0;
+
+        auto apply_swap = [&](int i, int j) {
+            std::swap(occupant[i], occupant[j]);
+            placement[occupant[i]] = i;
+            placement[occupant[j]] = j;
+            if (schedule)
+                schedule->push_back({-1, i, j});
+            ret.swaps++;
+        };
+
+        while (!ready.empty() || !front.empty()) {
+            // Execute everything executable
+            for (auto id : front)
+                ready.push(key_of(id));
+            front.clear();
+            bool progress = false;
+            while (!ready.empty()) {
+                auto id = node_of(ready.top());
+                ready.pop();
+                auto& v = dag_[id];
+                if (v.ctrl != -1 && distance(v, placement) > 1) {
+                    front.push_back(id);
+                    continue;
+                }
+
+                if (schedule)
+                    schedule->push_back({id, -1, -1});
+                progress = true;
+                for (auto s : next(v)) {
+                    if (--waiting[s] == 0)
+                        ready.push(key_of(s));
+                }
+            }
+            if (front.empty())
+                break;
+
+            if (progress) {
+                std::fill(decay.begin(), decay.end(), 1.0);
+                swaps_since_reset = 0;
+                stalled = 0;
+            }
+
+            // Without progress for too long, route the first gate of the
+            // front layer along a shortest path
+            if (++stalled > 10 * n) {
+                auto& v = dag_[front.front()];
+                while (distance(v, placement) > 1) {
+                    auto i = placement[v.ctrl];
+                    auto t = placement[v.tgt];
+                    if (hops_[i][t] == n)
+                        throw std::logic_error(
+                            "Could not find a connection between qubits");
+                    for (auto j : neighbours_[i]) {
+                        if (hops_[j][t] < hops_[i][t]) {
+                            apply_swap(i, j);
+                            break;
+                        }
+                    }
+                }
+                stalled = 0;
+                continue;
+            }
+
+            // Lookahead set of upcoming CNOT gates
+            extended.clear();
+            round++;
+            std::vector<int> queue(front);
+            for (std::size_t k = 0;
+                 k < queue.size() &&
+                 extended.size() <
+                     static_cast<std::size_t>(config_.extended_set_size);
+                 k++) {
+                for (auto s : next(dag_[queue[k]])) {
+                    if (stamp[s] == round)
+                        continue;
+                    stamp[s] = round;
+                    queue.push_back(s);
+                    if (dag_[s].ctrl != -1)
+                        extended.push_back(s);
+                }
+            }
+
+            // Candidate swaps on the couplings touching the front layer
+            candidates.clear();
+            for (auto id : front) {
+                for (auto q : {dag_[id].ctrl, dag_[id].tgt}) {
+                    auto i = placement[q];
+                    for (auto j : neighbours_[i])
+                        candidates.emplace_back(std::min(i, j),
+                                                std::max(i, j));
+                }
+            }
+            std::sort(candidates.begin(), candidates.end());
+            candidates.erase(
+                std::unique(candidates.begin(), candidates.end()),
+                candidates.end());
+
+            auto best = candidates.front();
+            auto best_score = std::numeric_limits<double>::infinity();
+            for (auto [i, j] : candidates) {
+                auto moved = [&placement, i = i, j = j](int q) {
+                    auto p = placement[q];
+                    return p == i ? j : p == j ? i : p;
+                };
+                auto cost = [this, &moved](const std::vector<int>& set) {
+                    double ret = 0;
+                    for (auto id : set) {
+                        auto& v = dag_[id];
+                        ret += hops_[moved(v.ctrl)][moved(v.tgt)];
+                    }
+                    return set.empty() ? 0.0 : ret / set.size();
+                };
+
+                auto score = cost(front) +
+                             config_.extended_set_weight * cost(extended);
+                score *= std::max(decay[i], decay[j]);
+                if (score < best_score) {
+                    best = {i, j};
+                    best_score = score;
+                }
+            }
+
+            apply_swap(best.first, best.second);
+            decay[best.first] += config_.decay_delta;
+            decay[best.second] += config_.decay_delta;
+            if (++swaps_since_reset == config_.decay_reset) {
+                std::fill(decay.begin(), decay.end(), 1.0);
+                swaps_since_reset = 0;
+            }
+        }
+
+        ret.placement = std::move(placement);
+        return ret;
+    }
+
+    // Rebuilds the program body from a schedule
+    void emit(ast::Program& prog, std::vector<int> placement,
+              const std::vector<event>& schedule) {
+        auto n = device_.qubits_;
+        std::vector<int> occupant(n);
+        for (int i = 0; i < n; i++)
+            occupant[placement[i]] = i;
+
+        Relabel relabel(config_.register_name, placement);
+        auto pos = prog.pos();
+        for (auto& e : schedule) {
+            if (e.node != -1) {
+                auto& stmt = stmts_[e.node];
+                stmt->accept(relabel);
+                prog.body().emplace_back(std::move(stmt));
+                continue;
+            }
+
+            // Swap, oriented so that two of the three gates are native
+            auto i = e.i;
+            auto j = e.j;
+            if (!device_.coupled(i, j))
+                std::swap(i, j);
+            prog.body().emplace_back(generate_cnot(i, j, pos));
+            prog.body().emplace_back(generate_cnot(j, i, pos));
+            prog.body().emplace_back(generate_cnot(i, j, pos));
+
+            std::swap(occupant[i], occupant[j]);
+            placement[occupant[i]] = i;
+            placement[occupant[j]] = j;
+        }
+        stmts_.clear();
+    }
+
+    ast::ptr<ast::CNOTGate> generate_cnot(int i, int j, parser::Position pos) {
+        auto ctrl = ast::VarAccess(pos, config_.register_name, i);
+        auto tgt = ast::VarAccess(pos, config_.register_name, j);
+        return std::make_unique<ast::CNOTGate>(
+            ast::CNOTGate(pos, std::move(ctrl), std::move(tgt)));
+    }
+
+    ast::ptr<ast::UGate> generate_hadamard(int i, parser::Position pos) {
+        auto tgt = ast::VarAccess(pos, config_.register_name, i);
+
+        auto tmp1 = std::make_unique<ast::PiExpr>(ast::PiExpr(pos));
+        auto tmp2 = std::make_unique<ast::IntExpr>(ast::IntExpr(pos, 2));
+        auto theta = std::make_unique<ast::BExpr>(ast::BExpr(
+            pos, std::move(tmp1), ast::BinaryOp::Divide, std::move(tmp2)));
+        auto phi = std::make_unique<ast::IntExpr>(ast::IntExpr(pos, 0));
+        auto lambda = std::make_unique<ast::PiExpr>(ast::PiExpr(pos));
+
+        return std::make_unique<ast::UGate>(
+            ast::UGate(pos, std::move(theta), std::move(phi), std::move(lambda),
+                       std::move(tgt)));
+    }
+};
+
+/** \brief Applies the SABRE mapper to an AST given a physical device */
+inline std::map<int, int> sabre_mapping(Device& device, ast::Program& prog) {
+    SabreMapper mapper(device);
+    return mapper.run(prog);
+}
+
+/** \brief Applies the SABRE mapper with configuration */
+inline std::map<int, int> sabre_mapping(Device& device, ast::Program& prog,
+                                        const SabreMapper::config& params) {
+    SabreMapper mapper(device, params);
+    return mapper.run(prog);
+}
+
+} // namespace mapping
+} // namespace staq
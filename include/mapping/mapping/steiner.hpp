@@ -36,7 +36,15 @@
 #include "synthesis/linear_reversible.hpp"
 #include "synthesis/cnot_dihedral.hpp"
 #include "mapping/device.hpp"
-
+#include "transformations/substitution.hpp"
+#include "tools/parallel.hpp"
+#include "qasmtools/ast/numbering.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace staq {
@@ -59,11 +67,14 @@ class SteinerMapper final : public ast::Replacer {
   public:
     struct config {
         std::string register_name = "q";
+        unsigned threads = 1; ///< synthesis threads, 0 = hardware concurrency
     };
 
-    SteinerMapper(Device& device) : Replacer(), device_(device) {
+    SteinerMapper(Device& device) : SteinerMapper(device, config()) {}
+    SteinerMapper(Device& device, const config& params)
+        : Replacer(), device_(device), config_(params) {
         permutation_ = synthesis::linear_op<bool>(
-            device.qubits_, std::vector<bool>(device.qubits_, false));
+            device.qubits_, synthesis::bit_vector(device.qubits_));
         for (auto i = 0; i < device.qubits_; i++) {
             permutation_[i][i] = true;
         }
@@ -77,31 +88,16 @@ class SteinerMapper final : public ast::Replacer {
         Replacer::visit(prog);
 
         // Synthesize the last leg
-        for (auto& gate :
-             synthesis::gray_steiner(phases_, permutation_, device_)) {
-            std::visit(
-                utils::overloaded{
-                    [this, &prog](std::pair<int, int>& cx) {
-                        if (device_.coupled(cx.first, cx.second)) {
-                            prog.body().emplace_back(
-                                generate_cnot(cx.first, cx.second, prog.pos()));
-                        } else if (device_.coupled(cx.second, cx.first)) {
-                            auto swapped_cnot = generate_swapped_cnot(
-                                cx.first, cx.second, prog.pos());
-                            prog.body().insert(prog.body().end(),
-                                std::make_move_iterator(swapped_cnot.begin()),
-                                std::make_move_iterator(swapped_cnot.end()));
-                        } else {
-                            throw std::logic_error(
-                                "CNOT between non-coupled vertices!");
-                        }
-                    },
-                    [this, &prog](std::pair<ast::ptr<ast::Expr>, int>& rz) {
-                        prog.body().emplace_back(generate_rz(
-                            std::move(rz.first), rz.second, prog.pos()));
-                    }},
-                gate);
+        if (config_.threads != 1) {
+            prog.body().emplace_back(capture(prog.pos()));
+            synthesize_captured(prog);
+        } else {
+            for (auto& gate : generate(
+                     synthesis::gray_steiner(phases_, permutation_, device_),
+                     prog.pos()))
+                prog.body().emplace_back(std::move(gate));
         }
+        phase_index_.clear();
     }
 
     std::optional<std::list<ast::ptr<ast::Gate>>>
@@ -110,7 +106,8 @@ class SteinerMapper final : public ast::Replacer {
         auto tgt = get_index(gate.tgt());
 
         if (in_bounds(ctrl) && in_bounds(tgt)) {
-            synthesis::operator^=(permutation_[tgt], permutation_[ctrl]);
+            permutation_[tgt] ^= permutation_[ctrl];
+            touched_.push_back(tgt);
         } else {
             throw std::logic_error("CNOT argument(s) out of device bounds!");
         }
@@ -140,82 +137,40 @@ class SteinerMapper final : public ast::Replacer {
     }
     std::optional<std::list<ast::ptr<ast::Gate>>>
     replace(ast::DeclaredGate& gate) override {
-        auto name = gate.name();
-
-        if (name == "rz" || name == "u1") {
-            auto angle = ast::object::clone(gate.carg(0));
-            auto idx = get_index(gate.qarg(0));
-            if (in_bounds(idx)) {
-                add_phase(permutation_[idx], std::move(angle));
-            } else {
-                throw std::logic_error(
-                    "Unitary argument out of device bounds!");
-            }
-
-            return std::list<ast::ptr<ast::Gate>>();
-        } else if (name == "z") {
-            auto angle = ast::angle_to_expr(utils::angles::pi);
-            auto idx = get_index(gate.qarg(0));
-
-            if (in_bounds(idx)) {
-                add_phase(permutation_[idx], std::move(angle));
-            } else {
-                throw std::logic_error(
-                    "Unitary argument out of device bounds!");
-            }
-
-            return std::list<ast::ptr<ast::Gate>>();
-        } else if (name == "s") {
-            auto angle = ast::angle_to_expr(utils::angles::pi_half);
-            auto idx = get_index(gate.qarg(0));
-
-            if (in_bounds(idx)) {
-                add_phase(permutation_[idx], std::move(angle));
-            } else {
-                throw std::logic_error(
-                    "Unitary argument out of device bounds!");
-            }
-
-            return std::list<ast::ptr<ast::Gate>>();
-        } else if (name == "sdg") {
-            auto angle = ast::angle_to_expr(-utils::angles::pi_half);
-            auto idx = get_index(gate.qarg(0));
-
-            if (in_bounds(idx)) {
-                add_phase(permutation_[idx], std::move(angle));
-            } else {
-                throw std::logic_error(
-                    "Unitary argument out of device bounds!");
-            }
-
-            return std::list<ast::ptr<ast::Gate>>();
-        } else if (name == "t") {
-            auto angle = ast::angle_to_expr(utils::angles::pi_quarter);
-            auto idx = get_index(gate.qarg(0));
-
-            if (in_bounds(idx)) {
-                add_phase(permutation_[idx], std::move(angle));
-            } else {
-                throw std::logic_error(
-                    "Unitary argument out of device bounds!");
-            }
-
-            return std::list<ast::ptr<ast::Gate>>();
-        } else if (name == "tdg") {
-            auto angle = ast::angle_to_expr(-utils::angles::pi_quarter);
-            auto idx = get_index(gate.qarg(0));
-
-            if (in_bounds(idx)) {
-                add_phase(permutation_[idx], std::move(angle));
-            } else {
-                throw std::logic_error(
-                    "Unitary argument out of device bounds!");
-            }
+        ast::ptr<ast::Expr> angle;
+
+        switch (gate.op()) {
+            case ast::GateOp::RZ:
+            case ast::GateOp::U1:
+                angle = ast::object::clone(gate.carg(0));
+                break;
+            case ast::GateOp::Z:
+                angle = ast::angle_to_expr(utils::angles::pi);
+                break;
+            case ast::GateOp::S:
+                angle = ast::angle_to_expr(utils::angles::pi_half);
+                break;
+            case ast::GateOp::Sdg:
+                angle = ast::angle_to_expr(-utils::angles::pi_half);
+                break;
+            case ast::GateOp::T:
+                angle = ast::angle_to_expr(utils::angles::pi_quarter);
+                break;
+            case ast::GateOp::Tdg:
+                angle = ast::angle_to_expr(-utils::angles::pi_quarter);
+                break;
+            default:
+                return flush<ast::Gate>(gate);
+        }
 
-            return std::list<ast::ptr<ast::Gate>>();
+        auto idx = get_index(gate.qarg(0));
+        if (in_bounds(idx)) {
+            add_phase(permutation_[idx], std::move(angle));
         } else {
-            return flush<ast::Gate>(gate);
+            throw std::logic_error("Unitary argument out of device bounds!");
         }
+
+        return std::list<ast::ptr<ast::Gate>>();
     }
 
     // Always generate a synthesis event
@@ -241,65 +196,125 @@ class SteinerMapper final : public ast::Replacer {
     config config_;
 
     // Accumulating data
-    std::list<synthesis::phase_term> phases_;
+    std::list<synthesis::phase_term> phases_; ///< in order of first use
+    std::unordered_map<synthesis::bit_vector,
+                       std::list<synthesis::phase_term>::iterator>
+        phase_index_; ///< phases_ by parity
     synthesis::linear_op<bool> permutation_;
-
-    void add_phase(std::vector<bool> parity, ast::ptr<ast::Expr> angle) {
-        for (auto it = phases_.begin(); it != phases_.end(); it++) {
-            if (it->first == parity) {
-                auto tmp = angle->pos();
-                it->second =
-                    ast::BExpr::create(tmp, std::move(it->second),
-                                       ast::BinaryOp::Plus, std::move(angle));
-                return;
-            }
+    std::vector<int> touched_; ///< rows of permutation_ changed, with repeats
+
+    void add_phase(synthesis::bit_vector parity, ast::ptr<ast::Expr> angle) {
+        if (auto it = phase_index_.find(parity); it != phase_index_.end()) {
+            auto tmp = angle->pos();
+            auto& acc = it->second->second;
+            acc = ast::BExpr::create(tmp, std::move(acc), ast::BinaryOp::Plus,
+                                     std::move(angle));
+            return;
         }
 
         phases_.push_back(std::make_pair(parity, std::move(angle)));
+        phase_index_.emplace(std::move(parity), std::prev(phases_.end()));
     }
 
+    // Blocks captured for synthesis on worker threads, and their
+    // placeholders in the circuit
+    std::vector<synthesis::dihedral_block> blocks_;
+    std::vector<std::pair<const ast::Gate*, parser::Position>> placeholders_;
+
     // Flushes a cnot-dihedral operator (i.e. phases + permutation) to the
     // circuit before the given node
     template <typename T>
     std::list<ast::ptr<T>> flush(T& node) {
         std::list<ast::ptr<T>> ret;
 
-        // Synthesize circuit
-        for (auto& gate :
-             synthesis::gray_steiner(phases_, permutation_, device_)) {
+        if (config_.threads != 1) {
+            ret.emplace_back(capture(node.pos()));
+        } else {
+            for (auto& gate : generate(
+                     synthesis::gray_steiner(phases_, permutation_, device_),
+                     node.pos()))
+                ret.emplace_back(std::move(gate));
+            reset_block();
+        }
+        ret.emplace_back(ast::object::clone(node));
+
+        return ret;
+    }
+
+    // Captures the cnot-dihedral operator for later synthesis, returning
+    // a placeholder to stand in for it in the circuit
+    ast::ptr<ast::Gate> capture(parser::Position pos) {
+        auto placeholder = std::make_unique<ast::BarrierGate>(
+            ast::BarrierGate(pos, std::vector<ast::VarAccess>()));
+        placeholders_.emplace_back(placeholder.get(), pos);
+        blocks_.push_back({std::move(phases_), permutation_});
+        reset_block();
+
+        return placeholder;
+    }
+
+    // Synthesizes the captured blocks and substitutes them for their
+    // placeholders
+    void synthesize_captured(ast::Program& prog) {
+        auto circuits = synthesis::synthesize_blocks(
+            blocks_,
+            [device = device_](std::list<synthesis::indexed_phase_term>& phases,
+                               synthesis::linear_op<bool> permutation) mutable {
+                return synthesis::gray_steiner(phases, permutation, device);
+            },
+            config_.threads);
+
+        transformations::SubstGate::substitution subst;
+        for (std::size_t i = 0; i < circuits.size(); i++) {
+            auto& [placeholder, pos] = placeholders_[i];
+            subst.emplace(placeholder, generate(std::move(circuits[i]), pos));
+        }
+        transformations::subst_gates(subst, prog);
+
+        blocks_.clear();
+        placeholders_.clear();
+    }
+
+    // Resets the cnot-dihedral circuit. Synthesis already leaves the
+    // permutation as the identity, but capturing a block does not
+    void reset_block() {
+        phases_.clear();
+        phase_index_.clear();
+        for (auto i : touched_) {
+            permutation_[i].reset();
+            permutation_[i].set(i);
+        }
+        touched_.clear();
+    }
+
+    // Generates gates for a synthesized cnot-dihedral circuit
+    std::list<ast::ptr<ast::Gate>>
+    generate(std::list<synthesis::cx_dihedral> circuit, parser::Position pos) {
+        std::list<ast::ptr<ast::Gate>> ret;
+
+        for (auto& gate : circuit) {
             std::visit(
                 utils::overloaded{
-                    [&ret, this, &node](std::pair<int, int>& cx) {
+                    [&ret, this, &pos](std::pair<int, int>& cx) {
                         if (device_.coupled(cx.first, cx.second)) {
                             ret.emplace_back(
-                                generate_cnot(cx.first, cx.second, node.pos()));
+                                generate_cnot(cx.first, cx.second, pos));
                         } else if (device_.coupled(cx.second, cx.first)) {
-                            auto swapped_cnot = generate_swapped_cnot(
-                                cx.first, cx.second, node.pos());
-                            ret.insert(ret.end(),
-                                std::make_move_iterator(swapped_cnot.begin()),
-                                std::make_move_iterator(swapped_cnot.end()));
+                            ret.splice(ret.end(),
+                                       generate_swapped_cnot(cx.first,
+                                                             cx.second, pos));
                         } else {
                             throw std::logic_error(
                                 "CNOT between non-coupled vertices!");
                         }
                     },
                     [&ret, this,
-                     &node](std::pair<ast::ptr<ast::Expr>, int>& rz) {
-                        ret.emplace_back(generate_rz(std::move(rz.first),
-                                                     rz.second, node.pos()));
+                     &pos](std::pair<ast::ptr<ast::Expr>, int>& rz) {
+                        ret.emplace_back(
+                            generate_rz(std::move(rz.first), rz.second, pos));
                     }},
                 gate);
         }
-        ret.emplace_back(ast::object::clone(node));
-
-        // Reset the cnot-dihedral circuit
-        phases_.clear();
-        for (auto i = 0; i < device_.qubits_; i++) {
-            for (auto j = 0; j < device_.qubits_; j++) {
-                permutation_[i][j] = i == j ? true : false;
-            }
-        }
 
         return ret;
     }
@@ -367,256 +382,533 @@ class SteinerMapper final : public ast::Replacer {
 };
 
 /**
- * \class staq::mapping::SteinerDry
- * \brief Steiner mapper dry run
- * \note Utility class for optimizing over initial layouts
+ * \brief A cnot-dihedral block over the virtual qubits it acts on
  *
- * Does a dry run of the Steiner mapping algorithm (i.e. doesn't actually
- * change the ast) with a particular layout and collects information about
- * the number of CNOT gates the synthesized circuit would use.
+ * Parities and the permutation are over the block's support, so the block
+ * can be placed under any layout by relabelling.
  */
-class SteinerDry final : public ast::Traverse {
-  public:
-    SteinerDry(Device& device) : Traverse(), device_(device) {
-        permutation_ = synthesis::linear_op<bool>(
-            device.qubits_, std::vector<bool>(device.qubits_, false));
-        for (auto i = 0; i < device.qubits_; i++) {
-            permutation_[i][i] = true;
+struct steiner_block {
+    std::vector<int> support; ///< virtual qubits acted on, in order
+    std::vector<synthesis::bit_vector> parities; ///< distinct parities
+    synthesis::linear_op<bool> permutation;      ///< linear transformation
+};
+
+/**
+ * \brief Compact summary of a circuit for the Steiner mapper
+ *
+ * All the Steiner mapper needs of a circuit: its CNOT gates and z-rotations
+ * over virtual qubit indices, in program order, with the ends of the
+ * cnot-dihedral blocks marked. A summary is extracted once and can then be
+ * replayed under any number of layouts without touching the AST.
+ */
+struct steiner_summary {
+    static constexpr int rotation = -1; ///< second index of a z-rotation
+    static constexpr int end = -2;      ///< both indices of a block end
+
+    /** \brief CNOTs (ctrl, tgt), z-rotations (qubit, rotation) and block
+     * ends (end, end) */
+    std::vector<std::pair<int, int>> ops;
+    std::vector<ast::VarAccess> qubits; ///< virtual qubit of each index
+
+    /** \brief Physical qubit of each virtual qubit under a layout */
+    std::vector<int> place(const layout& l) const {
+        std::vector<int> ret(qubits.size(), 0);
+        for (std::size_t v = 0; v < qubits.size(); v++) {
+            if (auto it = l.find(qubits[v]); it != l.end())
+                ret[v] = it->second;
         }
+        return ret;
     }
 
-    int get_cnot_count(ast::Program& prog, const layout& l) {
-        layout_ = l;
-        cnots_ = 0;
-        visit(prog);
-        return cnots_;
+    /** \brief Collects the ops of each block over the block's support */
+    std::vector<steiner_block> blocks() const {
+        std::vector<steiner_block> ret;
+
+        auto begin = ops.begin();
+        for (auto it = ops.begin(); it != ops.end(); it++) {
+            if (it->first == end) {
+                ret.emplace_back(block(begin, it));
+                begin = std::next(it);
+            }
+        }
+
+        return ret;
+    }
+
+  private:
+    using iterator = std::vector<std::pair<int, int>>::const_iterator;
+
+    static steiner_block block(iterator first, iterator last) {
+        steiner_block ret;
+        for (auto it = first; it != last; it++) {
+            ret.support.push_back(it->first);
+            if (it->second != rotation)
+                ret.support.push_back(it->second);
+        }
+        std::sort(ret.support.begin(), ret.support.end());
+        ret.support.erase(std::unique(ret.support.begin(), ret.support.end()),
+                          ret.support.end());
+
+        auto local = [&ret](int i) {
+            return static_cast<int>(std::lower_bound(ret.support.begin(),
+                                                     ret.support.end(), i) -
+                                    ret.support.begin());
+        };
+
+        auto k = ret.support.size();
+        ret.permutation =
+            synthesis::linear_op<bool>(k, synthesis::bit_vector(k));
+        for (std::size_t i = 0; i < k; i++)
+            ret.permutation[i].set(i);
+
+        std::unordered_set<synthesis::bit_vector> seen;
+        for (auto it = first; it != last; it++) {
+            if (it->second != rotation) {
+                ret.permutation[local(it->second)] ^=
+                    ret.permutation[local(it->first)];
+            } else {
+                auto& parity = ret.permutation[local(it->first)];
+                if (seen.insert(parity).second)
+                    ret.parities.push_back(parity);
+            }
+        }
+
+        return ret;
+    }
+};
+
+/**
+ * \class staq::mapping::SteinerCapture
+ * \brief Extracts the Steiner summary of a circuit
+ *
+ * Breaks a circuit into the same cnot-dihedral blocks as the Steiner mapper,
+ * numbering the virtual qubits with a QubitNumbering. Empty blocks, which
+ * synthesize to nothing, are left out.
+ */
+class SteinerCapture final : public ast::Traverse {
+  public:
+    SteinerCapture() = default;
+    ~SteinerCapture() = default;
+
+    steiner_summary run(ast::Program& prog) {
+        summary_ = steiner_summary();
+        prog.accept(*this);
+        return std::move(summary_);
     }
 
     void visit(ast::GateDecl&) override {}
     void visit(ast::OracleDecl&) override {}
 
     void visit(ast::Program& prog) override {
+        ast::QubitNumbering qubits(prog);
+        std::swap(qubits_, qubits);
         Traverse::visit(prog);
 
-        // Synthesize the last leg
-        for (auto& gate :
-             synthesis::gray_steiner(phases_, permutation_, device_)) {
-            std::visit(
-                utils::overloaded{
-                    [this, &prog](std::pair<int, int>& cx) {
-                        if (device_.coupled(cx.first, cx.second) ||
-                            device_.coupled(cx.second, cx.first)) {
-                            cnots_++;
-                        } else {
-                            throw std::logic_error(
-                                "CNOT between non-coupled vertices!");
-                        }
-                    },
-                    [this, &prog](std::pair<ast::ptr<ast::Expr>, int>& rz) {}},
-                gate);
-        }
+        // The last leg
+        flush();
 
-        // Reset the cnot-dihedral circuit
-        phases_.clear();
-        for (auto i = 0; i < device_.qubits_; i++) {
-            for (auto j = 0; j < device_.qubits_; j++) {
-                permutation_[i][j] = i == j ? true : false;
-            }
-        }
+        for (int i = 0; i < qubits_.size(); i++)
+            summary_.qubits.push_back(qubits_.access(i));
     }
 
     void visit(ast::CNOTGate& gate) override {
-        auto ctrl = layout_[gate.ctrl()];
-        auto tgt = layout_[gate.tgt()];
+        summary_.ops.emplace_back(qubits_.index(gate.ctrl()),
+                                  qubits_.index(gate.tgt()));
+    }
 
-        if (in_bounds(ctrl) && in_bounds(tgt)) {
-            synthesis::operator^=(permutation_[tgt], permutation_[ctrl]);
-        } else {
-            throw std::logic_error("CNOT argument(s) out of device bounds!");
+    void visit(ast::UGate& gate) override {
+        if (is_zero(gate.theta()) && is_zero(gate.phi()))
+            rotate(gate.arg());
+        else
+            flush();
+    }
+
+    void visit(ast::DeclaredGate& gate) override {
+        switch (gate.op()) {
+            case ast::GateOp::RZ:
+            case ast::GateOp::U1:
+            case ast::GateOp::Z:
+            case ast::GateOp::S:
+            case ast::GateOp::Sdg:
+            case ast::GateOp::T:
+            case ast::GateOp::Tdg:
+                rotate(gate.qarg(0));
+                break;
+            default:
+                flush();
+                break;
         }
     }
 
-    void visit(ast::UGate& gate) override {
-        if (is_zero(gate.theta()) && is_zero(gate.phi())) {
-            // It's a z-axis rotation
-            auto angle = nullptr;
-            auto idx = layout_[gate.arg()];
+    // Always generate a synthesis event
+    void visit(ast::IfStmt&) override { flush(); }
+    void visit(ast::BarrierGate&) override { flush(); }
+    void visit(ast::MeasureStmt&) override { flush(); }
+    void visit(ast::ResetStmt&) override { flush(); }
 
-            if (in_bounds(idx)) {
-                add_phase(permutation_[idx], angle);
-            } else {
-                throw std::logic_error(
-                    "Unitary argument out of device bounds!");
-            }
+  private:
+    ast::QubitNumbering qubits_;
+    steiner_summary summary_;
 
-        } else {
-            flush<ast::Gate>(gate);
-        }
+    void rotate(const ast::VarAccess& va) {
+        summary_.ops.emplace_back(qubits_.index(va),
+                                  steiner_summary::rotation);
     }
 
-    void visit(ast::DeclaredGate& gate) override {
-        auto name = gate.name();
+    void flush() {
+        auto& ops = summary_.ops;
+        if (!ops.empty() && ops.back().first != steiner_summary::end)
+            ops.emplace_back(steiner_summary::end, steiner_summary::end);
+    }
 
-        if (name == "rz" || name == "u1") {
-            auto angle = nullptr;
-            auto idx = layout_[gate.qarg(0)];
-            if (in_bounds(idx)) {
-                add_phase(permutation_[idx], angle);
-            } else {
-                throw std::logic_error(
-                    "Unitary argument out of device bounds!");
-            }
-        } else if (name == "z") {
-            auto angle = nullptr;
-            auto idx = layout_[gate.qarg(0)];
+    bool is_zero(ast::Expr& expr) {
+        auto val = expr.constant_eval();
+        return val && (*val == 0);
+    }
+};
 
-            if (in_bounds(idx)) {
-                add_phase(permutation_[idx], angle);
-            } else {
-                throw std::logic_error(
-                    "Unitary argument out of device bounds!");
-            }
-        } else if (name == "s") {
-            auto angle = nullptr;
-            auto idx = layout_[gate.qarg(0)];
+/** \brief Extracts the Steiner summary of a circuit */
+inline steiner_summary summarize_steiner(ast::Program& prog) {
+    SteinerCapture alg;
+    return alg.run(prog);
+}
 
-            if (in_bounds(idx)) {
-                add_phase(permutation_[idx], angle);
-            } else {
-                throw std::logic_error(
-                    "Unitary argument out of device bounds!");
-            }
-        } else if (name == "sdg") {
-            auto angle = nullptr;
-            auto idx = layout_[gate.qarg(0)];
+/**
+ * \class staq::mapping::SteinerDry
+ * \brief Steiner mapper dry run
+ * \note Utility class for optimizing over initial layouts
+ *
+ * Does a dry run of the Steiner mapping algorithm (i.e. doesn't actually
+ * change the ast) with a particular layout and collects information about
+ * the number of CNOT gates the synthesized circuit would use. The run
+ * replays a Steiner summary, which may be extracted once and reused.
+ */
+class SteinerDry final {
+  public:
+    SteinerDry(Device& device) : device_(device) {
+        permutation_ = synthesis::linear_op<bool>(
+            device.qubits_, synthesis::bit_vector(device.qubits_));
+        for (auto i = 0; i < device.qubits_; i++) {
+            permutation_[i][i] = true;
+        }
+    }
 
-            if (in_bounds(idx)) {
-                add_phase(permutation_[idx], angle);
-            } else {
-                throw std::logic_error(
-                    "Unitary argument out of device bounds!");
-            }
-        } else if (name == "t") {
-            auto angle = nullptr;
-            auto idx = layout_[gate.qarg(0)];
+    int get_cnot_count(ast::Program& prog, const layout& l) {
+        return get_cnot_count(summarize_steiner(prog), l);
+    }
 
-            if (in_bounds(idx)) {
-                add_phase(permutation_[idx], angle);
-            } else {
-                throw std::logic_error(
-                    "Unitary argument out of device bounds!");
-            }
-        } else if (name == "tdg") {
-            auto angle = nullptr;
-            auto idx = layout_[gate.qarg(0)];
+    int get_cnot_count(const steiner_summary& summary, const layout& l) {
+        auto phys = summary.place(l);
+        cnots_ = 0;
 
-            if (in_bounds(idx)) {
-                add_phase(permutation_[idx], angle);
+        for (auto& [i, j] : summary.ops) {
+            if (i == steiner_summary::end) {
+                flush();
+            } else if (j == steiner_summary::rotation) {
+                if (in_bounds(phys[i])) {
+                    add_phase(permutation_[phys[i]]);
+                } else {
+                    throw std::logic_error(
+                        "Unitary argument out of device bounds!");
+                }
             } else {
-                throw std::logic_error(
-                    "Unitary argument out of device bounds!");
+                if (in_bounds(phys[i]) && in_bounds(phys[j])) {
+                    permutation_[phys[j]] ^= permutation_[phys[i]];
+                } else {
+                    throw std::logic_error(
+                        "CNOT argument(s) out of device bounds!");
+                }
             }
-        } else {
-            flush<ast::Gate>(gate);
         }
-    }
 
-    // Always generate a synthesis event
-    void visit(ast::IfStmt& stmt) override { return flush<ast::Stmt>(stmt); }
-    void visit(ast::BarrierGate& stmt) override {
-        return flush<ast::Gate>(stmt);
-    }
-    void visit(ast::MeasureStmt& stmt) override {
-        return flush<ast::Stmt>(stmt);
+        return cnots_;
     }
-    void visit(ast::ResetStmt& stmt) override { return flush<ast::Stmt>(stmt); }
 
   private:
     Device device_;
-    layout layout_;
     int cnots_ = 0;
 
     // Accumulating data
-    std::list<synthesis::phase_term> phases_;
+    std::list<synthesis::phase_term> phases_; ///< in order of first use
+    std::unordered_set<synthesis::bit_vector> phase_index_; ///< parities
     synthesis::linear_op<bool> permutation_;
 
-    void add_phase(std::vector<bool> parity, ast::ptr<ast::Expr> angle) {
-        for (auto it = phases_.begin(); it != phases_.end(); it++) {
-            if (it->first == parity) {
-                return;
-            }
-        }
-
-        phases_.push_back(std::make_pair(parity, std::move(angle)));
+    void add_phase(const synthesis::bit_vector& parity) {
+        if (phase_index_.insert(parity).second)
+            phases_.emplace_back(parity, nullptr);
     }
 
-    // Flushes a cnot-dihedral operator (i.e. phases + permutation) to the
-    // circuit before the given node
-    template <typename T>
-    void flush(T& node) {
-        // Synthesize circuit
+    // Synthesizes the cnot-dihedral operator, counting CNOT gates. Synthesis
+    // reduces the permutation back to the identity
+    void flush() {
         for (auto& gate :
              synthesis::gray_steiner(phases_, permutation_, device_)) {
-            std::visit(
-                utils::overloaded{
-                    [this, &node](std::pair<int, int>& cx) {
-                        if (device_.coupled(cx.first, cx.second) ||
-                            device_.coupled(cx.second, cx.first)) {
-                            cnots_++;
-                        } else {
-                            throw std::logic_error(
-                                "CNOT between non-coupled vertices!");
-                        }
-                    },
-                    [this, &node](std::pair<ast::ptr<ast::Expr>, int>& rz) {}},
-                gate);
+            if (auto cx = std::get_if<std::pair<int, int>>(&gate)) {
+                if (device_.coupled(cx->first, cx->second) ||
+                    device_.coupled(cx->second, cx->first)) {
+                    cnots_++;
+                } else {
+                    throw std::logic_error(
+                        "CNOT between non-coupled vertices!");
+                }
+            }
         }
 
         // Reset the cnot-dihedral circuit
         phases_.clear();
-        for (auto i = 0; i < device_.qubits_; i++) {
-            for (auto j = 0; j < device_.qubits_; j++) {
-                permutation_[i][j] = i == j ? true : false;
-            }
-        }
+        phase_index_.clear();
     }
 
     bool in_bounds(int i) { return 0 <= i && i < device_.qubits_; }
+};
 
-    bool is_zero(ast::Expr& expr) {
-        auto val = expr.constant_eval();
-        return val && (*val == 0);
+/**
+ * \brief Number of CNOT gates the Steiner mapper uses for a block
+ *
+ * The block is placed into a device-sized identity, which synthesis reduces
+ * back to the identity, so that one matrix serves any number of blocks.
+ *
+ * \param block The block
+ * \param phys The physical qubit of each virtual qubit
+ * \param device The device
+ * \param permutation The identity on the device's qubits, left as is
+ */
+inline int steiner_cost(const steiner_block& block,
+                        const std::vector<int>& phys, Device& device,
+                        synthesis::linear_op<bool>& permutation) {
+    auto n = static_cast<std::size_t>(device.qubits_);
+    auto k = block.support.size();
+
+    // Place the block on the device
+    for (std::size_t i = 0; i < k; i++) {
+        auto& row = permutation[phys[block.support[i]]];
+        row.reset();
+        for (std::size_t j = 0; j < k; j++) {
+            if (block.permutation[i][j])
+                row.set(phys[block.support[j]]);
+        }
     }
-};
+
+    std::list<synthesis::phase_term> phases;
+    for (auto& parity : block.parities) {
+        synthesis::bit_vector vec(n);
+        for (std::size_t j = 0; j < k; j++) {
+            if (parity[j])
+                vec.set(phys[block.support[j]]);
+        }
+        phases.emplace_back(std::move(vec), nullptr);
+    }
+
+    int ret = 0;
+    for (auto& gate : synthesis::gray_steiner(phases, permutation, device)) {
+        if (std::holds_alternative<std::pair<int, int>>(gate))
+            ret++;
+    }
+
+    return ret;
+}
+
+/** \brief Number of CNOT gates the Steiner mapper uses for a block */
+inline int steiner_cost(const steiner_block& block,
+                        const std::vector<int>& phys, Device& device) {
+    auto permutation = synthesis::identity(device.qubits_);
+    return steiner_cost(block, phys, device, permutation);
+}
 
 /**
+ * \class staq::mapping::SteinerLayoutOptimizer
  * \brief Layout optimization for the Steiner mapper via hill climb
  *
- * Repeatedly performs dry-runs, modifying the qubit mapping with a
- * single swap each time.
+ * Repeatedly tries swapping the physical qubits of two layout entries,
+ * keeping the first swap which lowers the CNOT count of the mapped circuit
+ * and starting over. The circuit's cnot-dihedral blocks are captured once,
+ * and a swap is scored by re-synthesizing only the blocks acting on either
+ * of the two qubits. Swaps are scored in batches on worker threads and the
+ * first improvement in scan order is kept, so the result does not depend on
+ * the number of threads.
  */
-void optimize_steiner_layout(Device& device, layout& init, ast::Program& prog) {
-    SteinerDry alg(device);
-    int current_min = alg.get_cnot_count(prog, init);
-
-outer:
-    for (auto it = init.begin(); it != init.end(); it++) {
-        for (auto ti = std::next(it); ti != init.end(); ti++) {
-            std::swap(it->second, ti->second);
-            auto cnot_count = alg.get_cnot_count(prog, init);
-            if (cnot_count < current_min) {
-                current_min = cnot_count;
-                goto outer;
+class SteinerLayoutOptimizer {
+  public:
+    struct config {
+        unsigned threads = 1;   ///< threads, 0 = hardware concurrency
+        double time_budget = 0; ///< wall-clock seconds, 0 = unlimited
+    };
+
+    SteinerLayoutOptimizer(Device& device)
+        : SteinerLayoutOptimizer(device, config()) {}
+    SteinerLayoutOptimizer(Device& device, const config& params)
+        : device_(device), config_(params) {}
+
+    void run(layout& init, ast::Program& prog) {
+        auto start = std::chrono::steady_clock::now();
+        auto out_of_time = [this, &start]() {
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+            return config_.time_budget > 0 &&
+                   elapsed.count() >= config_.time_budget;
+        };
+
+        auto summary = summarize_steiner(prog);
+        auto blocks = summary.blocks();
+
+        // Physical location of each virtual qubit
+        auto phys = summary.place(init);
+        for (auto i : phys) {
+            if (i < 0 || i >= device_.qubits_)
+                throw std::logic_error("Layout out of device bounds!");
+        }
+
+        // Blocks acting on each virtual qubit
+        std::vector<std::vector<std::size_t>> blocks_on(phys.size());
+        for (std::size_t b = 0; b < blocks.size(); b++) {
+            for (auto v : blocks[b].support)
+                blocks_on[v].push_back(b);
+        }
+
+        auto threads = tools::num_threads(config_.threads, blocks.size());
+        std::vector<Device> devices(threads, device_);
+        std::vector<synthesis::linear_op<bool>> identities(
+            threads, synthesis::identity(device_.qubits_));
+
+        std::vector<int> cost(blocks.size());
+        tools::parallel_for(blocks.size(), threads,
+                            [&](unsigned worker, std::size_t b) {
+                                cost[b] = steiner_cost(blocks[b], phys,
+                                                       devices[worker],
+                                                       identities[worker]);
+                            });
+
+        // Candidate swaps, in scan order, with the virtual qubit (or -1)
+        // of each entry
+        std::unordered_map<ast::VarAccess, int> virt;
+        for (std::size_t v = 0; v < summary.qubits.size(); v++)
+            virt.emplace(summary.qubits[v], static_cast<int>(v));
+        std::vector<std::pair<layout::iterator, int>> entries;
+        for (auto it = init.begin(); it != init.end(); it++) {
+            auto v = virt.find(it->first);
+            entries.emplace_back(it, v == virt.end() ? -1 : v->second);
+        }
+
+        struct candidate {
+            std::size_t i, j;                // entries swapped
+            std::vector<std::size_t> blocks; // blocks affected
+            std::vector<int> cost;           // their cost after the swap
+        };
+        auto batch_size = 4 * static_cast<std::size_t>(threads);
+
+        bool improved = true;
+        while (improved && !out_of_time()) {
+            improved = false;
+
+            // Scan the swaps in order, scoring a batch at a time
+            std::vector<candidate> batch;
+            auto scan = [&, i = std::size_t(0), j = std::size_t(1)]() mutable {
+                batch.clear();
+                for (; i < entries.size(); i++, j = i + 1) {
+                    for (; j < entries.size(); j++) {
+                        if (batch.size() == batch_size)
+                            return;
+
+                        auto affected = affected_blocks(
+                            blocks_on, entries[i].second, entries[j].second);
+                        if (!affected.empty())
+                            batch.push_back({i, j, std::move(affected), {}});
+                    }
+                }
+            };
+
+            for (scan(); !batch.empty() && !improved && !out_of_time();
+                 scan()) {
+                tools::parallel_for(
+                    batch.size(), threads,
+                    [&](unsigned worker, std::size_t c) {
+                        auto& cand = batch[c];
+                        auto local = phys;
+                        swap(local, entries[cand.i], entries[cand.j]);
+                        for (auto b : cand.blocks)
+                            cand.cost.push_back(
+                                steiner_cost(blocks[b], local, devices[worker],
+                                             identities[worker]));
+                    });
+
+                for (auto& cand : batch) {
+                    int delta = 0;
+                    for (std::size_t k = 0; k < cand.blocks.size(); k++)
+                        delta += cand.cost[k] - cost[cand.blocks[k]];
+
+                    if (delta < 0) {
+                        swap(phys, entries[cand.i], entries[cand.j]);
+                        std::swap(entries[cand.i].first->second,
+                                  entries[cand.j].first->second);
+                        for (std::size_t k = 0; k < cand.blocks.size(); k++)
+                            cost[cand.blocks[k]] = cand.cost[k];
+                        improved = true;
+                        break;
+                    }
+                }
             }
-            std::swap(it->second, ti->second);
         }
     }
+
+  private:
+    Device device_;
+    config config_;
+
+    // Swaps the physical qubits of two layout entries in phys
+    static void swap(std::vector<int>& phys,
+                     const std::pair<layout::iterator, int>& a,
+                     const std::pair<layout::iterator, int>& b) {
+        if (a.second != -1)
+            phys[a.second] = b.first->second;
+        if (b.second != -1)
+            phys[b.second] = a.first->second;
+    }
+
+    // The blocks acting on either of two virtual qubits, in order
+    static std::vector<std::size_t>
+    affected_blocks(const std::vector<std::vector<std::size_t>>& blocks_on,
+                    int u, int v) {
+        std::vector<std::size_t> ret;
+        if (u != -1 && v != -1) {
+            std::set_union(blocks_on[u].begin(), blocks_on[u].end(),
+                           blocks_on[v].begin(), blocks_on[v].end(),
+                           std::back_inserter(ret));
+        } else if (u != -1) {
+            ret = blocks_on[u];
+        } else if (v != -1) {
+            ret = blocks_on[v];
+        }
+
+        return ret;
+    }
+};
+
+/** \brief Layout optimization for the Steiner mapper via hill climb */
+inline void optimize_steiner_layout(Device& device, layout& init,
+                                    ast::Program& prog) {
+    SteinerLayoutOptimizer alg(device);
+    alg.run(init, prog);
+}
+
+/** \brief Layout optimization for the Steiner mapper with configuration */
+inline void
+optimize_steiner_layout(Device& device, layout& init, ast::Program& prog,
+                        const SteinerLayoutOptimizer::config& params) {
+    SteinerLayoutOptimizer alg(device, params);
+    alg.run(init, prog);
 }
 
 /** \brief Applies the Steiner mapper to an AST given a physical device */
-void steiner_mapping(Device& device, ast::Program& prog) {
+inline void steiner_mapping(Device& device, ast::Program& prog) {
     SteinerMapper mapper(device);
     prog.accept(mapper);
 }
+
+/** \brief Applies the Steiner mapper with configuration */
+inline void steiner_mapping(Device& device, ast::Program& prog,
+                            const SteinerMapper::config& params) {
+    SteinerMapper mapper(device, params);
+    prog.accept(mapper);
+}
 } // namespace mapping
 } // namespace staq
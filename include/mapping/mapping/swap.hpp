@@ -36,6 +36,7 @@
 #include "mapping/device.hpp"
 
 #include <map>
+#include <vector>
 
 // TODO: figure out what to do with if statements
 
@@ -49,7 +50,8 @@ namespace parser = qasmtools::parser;
  * \class staq::mapping::SwapMapper
  * \brief Simple swap-inserting mapping algorithm
  * \note Assumes the circuit has a single global register with the configured
- * name
+ * name, accessed only by index. Register-wide accesses, which should be
+ * desugared beforehand, throw std::logic_error
  *
  * Maps an AST to a given device by inserting swap gates along a shortest path
  * before each non-local CNOT gate. The mapper keeps track of the current qubit
@@ -61,15 +63,22 @@ class SwapMapper final : public ast::Replacer {
         std::string register_name = "q";
     };
 
-    SwapMapper(Device& device) : Replacer(), device_(device) {
+    SwapMapper(Device& device)
+        : Replacer(), device_(device), permutation_(device.qubits_),
+          inverse_(device.qubits_) {
         for (auto i = 0; i < device.qubits_; i++) {
             permutation_[i] = i;
+            inverse_[i] = i;
         }
     }
 
     std::map<int, int> run(ast::Program& prog) {
         prog.accept(*this);
-        return permutation_;
+
+        std::map<int, int> ret;
+        for (std::size_t i = 0; i < permutation_.size(); i++)
+            ret.emplace(static_cast<int>(i), permutation_[i]);
+        return ret;
     }
 
     // Ignore declarations if they were left in during inlining
@@ -77,11 +86,17 @@ class SwapMapper final : public ast::Replacer {
     void visit(ast::OracleDecl&) override {}
 
     std::optional<ast::VarAccess> replace(ast::VarAccess& va) override {
-        if (va.var() == config_.register_name)
-            return ast::VarAccess(va.pos(), va.var(),
-                                  permutation_[*va.offset()]);
-        else
+        if (va.var() != config_.register_name)
             return std::nullopt;
+        if (!va.offset())
+            throw std::logic_error("Register-wide access to " +
+                                   config_.register_name +
+                                   " in swap mapping");
+
+        auto i = *va.offset();
+        if (i < 0 || i >= device_.qubits_)
+            throw std::logic_error("Qubit out of device bounds!");
+        return ast::VarAccess(va.pos(), va.var(), permutation_[i]);
     }
 
     // Where the magic happens
@@ -144,12 +159,9 @@ class SwapMapper final : public ast::Replacer {
                     ret.emplace_back(generate_cnot(swap_i, swap_j, gate.pos()));
 
                     // Adjust permutation
-                    for (auto& [q_init, q] : permutation_) {
-                        if (q == i)
-                            q = j;
-                        else if (q == j)
-                            q = i;
-                    }
+                    std::swap(inverse_[i], inverse_[j]);
+                    permutation_[inverse_[i]] = i;
+                    permutation_[inverse_[j]] = j;
                 }
                 i = j;
             }
@@ -159,7 +171,8 @@ class SwapMapper final : public ast::Replacer {
 
   private:
     Device device_;
-    std::map<int, int> permutation_;
+    std::vector<int> permutation_; ///< physical qubit of each qubit
+    std::vector<int> inverse_;     ///< qubit on each physical qubit
     config config_;
 
     ast::ptr<ast::CNOTGate> generate_cnot(int i, int j, parser::Position pos) {
@@ -33,12 +33,15 @@
 
 #include "qasmtools/ast/visitor.hpp"
 #include "qasmtools/ast/replacer.hpp"
+#include "qasmtools/ast/numbering.hpp"
 #include "synthesis/cnot_dihedral.hpp"
+#include "transformations/substitution.hpp"
 
 #include <cstddef>
 #include <list>
 #include <sstream>
 #include <unordered_map>
+#include <vector>
 
 namespace staq {
 namespace optimization {
@@ -51,7 +54,12 @@ using namespace qasmtools;
  */
 class CNOTOptimizer final : public ast::Replacer {
   public:
-    struct config {};
+    struct config {
+        synthesis::LinearSynth linear_synth =
+            synthesis::LinearSynth::automatic; ///< linear synthesis algorithm
+        int section_size = 0; ///< Patel-Markov-Hayes section size, 0 = auto
+        unsigned threads = 1; ///< synthesis threads, 0 = hardware concurrency
+    };
 
     CNOTOptimizer() = default;
     CNOTOptimizer(const config& params) : Replacer(), config_(params) {}
@@ -60,6 +68,8 @@ class CNOTOptimizer final : public ast::Replacer {
     void run(ast::ASTNode& node) {
         reset();
         node.accept(*this);
+        if (!blocks_.empty())
+            synthesize_captured(node);
     }
 
     /* Statements */
@@ -106,7 +116,7 @@ class CNOTOptimizer final : public ast::Replacer {
         auto tgt = get_index(gate.tgt());
 
         // Add the CNOT
-        synthesis::operator^=(permutation_[tgt], permutation_[ctrl]);
+        permutation_[tgt] ^= permutation_[ctrl];
 
         // Delete the gate
         return std::list<ast::ptr<ast::Gate>>();
@@ -119,52 +129,61 @@ class CNOTOptimizer final : public ast::Replacer {
     }
     std::optional<std::list<ast::ptr<ast::Gate>>>
     replace(ast::DeclaredGate& gate) override {
-        auto name = gate.name();
+        switch (gate.op()) {
+            case ast::GateOp::RZ:
+            case ast::GateOp::U1: {
+                auto idx = get_index(gate.qarg(0));
+                add_phase(permutation_[idx], ast::object::clone(gate.carg(0)));
 
-        if (name == "rz" || name == "u1") {
-            auto idx = get_index(gate.qarg(0));
-            add_phase(permutation_[idx], ast::object::clone(gate.carg(0)));
-
-            return std::list<ast::ptr<ast::Gate>>();
-        } else if (name == "cx") {
-            auto ctrl = get_index(gate.qarg(0));
-            auto tgt = get_index(gate.qarg(1));
+                return std::list<ast::ptr<ast::Gate>>();
+            }
+            case ast::GateOp::CX: {
+                auto ctrl = get_index(gate.qarg(0));
+                auto tgt = get_index(gate.qarg(1));
 
-            synthesis::operator^=(permutation_[tgt], permutation_[ctrl]);
-            return std::list<ast::ptr<ast::Gate>>();
-        } else if (name == "z") {
-            auto idx = get_index(gate.qarg(0));
+                permutation_[tgt] ^= permutation_[ctrl];
+                return std::list<ast::ptr<ast::Gate>>();
+            }
+            case ast::GateOp::Z: {
+                auto idx = get_index(gate.qarg(0));
 
-            add_phase(permutation_[idx], ast::angle_to_expr(utils::angles::pi));
-            return std::list<ast::ptr<ast::Gate>>();
-        } else if (name == "s") {
-            auto idx = get_index(gate.qarg(0));
+                add_phase(permutation_[idx],
+                          ast::angle_to_expr(utils::angles::pi));
+                return std::list<ast::ptr<ast::Gate>>();
+            }
+            case ast::GateOp::S: {
+                auto idx = get_index(gate.qarg(0));
 
-            add_phase(permutation_[idx],
-                      ast::angle_to_expr(utils::angles::pi_half));
-            return std::list<ast::ptr<ast::Gate>>();
-        } else if (name == "sdg") {
-            auto idx = get_index(gate.qarg(0));
+                add_phase(permutation_[idx],
+                          ast::angle_to_expr(utils::angles::pi_half));
+                return std::list<ast::ptr<ast::Gate>>();
+            }
+            case ast::GateOp::Sdg: {
+                auto idx = get_index(gate.qarg(0));
 
-            add_phase(permutation_[idx],
-                      ast::angle_to_expr(-utils::angles::pi_half));
-            return std::list<ast::ptr<ast::Gate>>();
-        } else if (name == "t") {
-            auto idx = get_index(gate.qarg(0));
+                add_phase(permutation_[idx],
+                          ast::angle_to_expr(-utils::angles::pi_half));
+                return std::list<ast::ptr<ast::Gate>>();
+            }
+            case ast::GateOp::T: {
+                auto idx = get_index(gate.qarg(0));
 
-            add_phase(permutation_[idx],
-                      ast::angle_to_expr(utils::angles::pi_quarter));
-            return std::list<ast::ptr<ast::Gate>>();
-        } else if (name == "tdg") {
-            auto idx = get_index(gate.qarg(0));
+                add_phase(permutation_[idx],
+                          ast::angle_to_expr(utils::angles::pi_quarter));
+                return std::list<ast::ptr<ast::Gate>>();
+            }
+            case ast::GateOp::Tdg: {
+                auto idx = get_index(gate.qarg(0));
 
-            add_phase(permutation_[idx],
-                      ast::angle_to_expr(-utils::angles::pi_quarter));
-            return std::list<ast::ptr<ast::Gate>>();
-        } else {
-            auto tmp = flush<ast::Gate>();
-            tmp.emplace_back(ast::object::clone(gate));
-            return std::move(tmp);
+                add_phase(permutation_[idx],
+                          ast::angle_to_expr(-utils::angles::pi_quarter));
+                return std::list<ast::ptr<ast::Gate>>();
+            }
+            default: {
+                auto tmp = flush<ast::Gate>();
+                tmp.emplace_back(ast::object::clone(gate));
+                return std::move(tmp);
+            }
         }
     }
 
@@ -172,15 +191,19 @@ class CNOTOptimizer final : public ast::Replacer {
     void visit(ast::GateDecl& decl) override {
         // Initialize a new local state
 
-        std::unordered_map<ast::VarAccess, int> local_map;
-        std::unordered_map<int, ast::VarAccess> local_qubit;
+        ast::QubitNumbering local_qubits;
         std::list<synthesis::phase_term> local_phases;
+        phase_index local_phase_index;
         synthesis::linear_op<bool> local_permutation;
+        std::vector<synthesis::dihedral_block> local_blocks;
+        std::vector<const ast::Gate*> local_placeholders;
 
-        std::swap(qubit_map_, local_map);
-        std::swap(map_qubit_, local_qubit);
+        std::swap(qubits_, local_qubits);
         std::swap(phases_, local_phases);
+        std::swap(phase_index_, local_phase_index);
         std::swap(permutation_, local_permutation);
+        std::swap(blocks_, local_blocks);
+        std::swap(placeholders_, local_placeholders);
 
         for (auto& var : decl.q_params())
             get_index(ast::VarAccess(decl.pos(), var));
@@ -190,12 +213,16 @@ class CNOTOptimizer final : public ast::Replacer {
         // Flush remaining state
         for (auto& gate : flush<ast::Gate>())
             decl.body().emplace_back(std::move(gate));
+        if (!blocks_.empty())
+            synthesize_captured(decl);
 
         // Reset the state
-        std::swap(qubit_map_, local_map);
-        std::swap(map_qubit_, local_qubit);
+        std::swap(qubits_, local_qubits);
         std::swap(phases_, local_phases);
+        std::swap(phase_index_, local_phase_index);
         std::swap(permutation_, local_permutation);
+        std::swap(blocks_, local_blocks);
+        std::swap(placeholders_, local_placeholders);
     }
 
     void visit(ast::OracleDecl&) override {}
@@ -219,36 +246,48 @@ class CNOTOptimizer final : public ast::Replacer {
         // Synthesize the last leg
         for (auto& stmt : flush<ast::Stmt>())
             prog.body().emplace_back(std::move(stmt));
+        if (!blocks_.empty())
+            synthesize_captured(prog);
     }
 
   private:
     config config_;
 
+    using phase_index =
+        std::unordered_map<synthesis::bit_vector,
+                           std::list<synthesis::phase_term>::iterator>;
+
     /* Algorithm state */
-    std::unordered_map<ast::VarAccess, int> qubit_map_;
-    std::unordered_map<int, ast::VarAccess> map_qubit_;
-    std::list<synthesis::phase_term> phases_;
+    ast::QubitNumbering qubits_;
+    std::list<synthesis::phase_term> phases_; ///< in order of first use
+    phase_index phase_index_;                 ///< phases_ by parity
     synthesis::linear_op<bool> permutation_;
 
+    // Blocks captured for synthesis on worker threads, and their
+    // placeholders in the circuit
+    std::vector<synthesis::dihedral_block> blocks_;
+    std::vector<const ast::Gate*> placeholders_;
+
     void reset() {
-        qubit_map_.clear();
-        map_qubit_.clear();
+        qubits_.clear();
         phases_.clear();
+        phase_index_.clear();
         permutation_.clear();
+        blocks_.clear();
+        placeholders_.clear();
     }
 
-    void add_phase(std::vector<bool> parity, ast::ptr<ast::Expr> e) {
-        for (auto it = phases_.begin(); it != phases_.end(); it++) {
-            if (it->first == parity) {
-                parser::Position pos;
-                it->second =
-                    ast::BExpr::create(pos, std::move(it->second),
+    void add_phase(synthesis::bit_vector parity, ast::ptr<ast::Expr> e) {
+        if (auto it = phase_index_.find(parity); it != phase_index_.end()) {
+            parser::Position pos;
+            auto& angle = it->second->second;
+            angle = ast::BExpr::create(pos, std::move(angle),
                                        ast::BinaryOp::Plus, std::move(e));
-                return;
-            }
+            return;
         }
 
         phases_.push_back(std::make_pair(parity, std::move(e)));
+        phase_index_.emplace(std::move(parity), std::prev(phases_.end()));
     }
 
     // Flushes a cnot-dihedral operator (i.e. phases + permutation) to the
@@ -256,10 +295,71 @@ class CNOTOptimizer final : public ast::Replacer {
     template <typename T>
     std::list<ast::ptr<T>> flush() {
         std::list<ast::ptr<T>> ret;
+
+        if (config_.threads != 1) {
+            ret.emplace_back(capture());
+        } else {
+            for (auto& gate : generate(synthesis::gray_synth(
+                     phases_, permutation_, config_.linear_synth,
+                     config_.section_size)))
+                ret.emplace_back(std::move(gate));
+            reset_block();
+        }
+
+        return ret;
+    }
+
+    // Captures the cnot-dihedral operator for later synthesis, returning
+    // a placeholder to stand in for it in the circuit
+    ast::ptr<ast::Gate> capture() {
         parser::Position pos;
+        auto placeholder = std::make_unique<ast::BarrierGate>(
+            ast::BarrierGate(pos, std::vector<ast::VarAccess>()));
+        placeholders_.emplace_back(placeholder.get());
+        blocks_.push_back({std::move(phases_), permutation_});
+        reset_block();
+
+        return placeholder;
+    }
+
+    // Synthesizes the captured blocks and substitutes them for their
+    // placeholders
+    void synthesize_captured(ast::ASTNode& node) {
+        auto circuits = synthesis::synthesize_blocks(
+            blocks_,
+            [alg = config_.linear_synth, size = config_.section_size](
+                std::list<synthesis::indexed_phase_term>& phases,
+                synthesis::linear_op<bool> permutation) {
+                return synthesis::gray_synth(phases, std::move(permutation),
+                                             alg, size);
+            },
+            config_.threads);
+
+        transformations::SubstGate::substitution subst;
+        for (std::size_t i = 0; i < circuits.size(); i++)
+            subst.emplace(placeholders_[i], generate(std::move(circuits[i])));
+        transformations::subst_gates(subst, node);
+
+        blocks_.clear();
+        placeholders_.clear();
+    }
+
+    // Resets the cnot-dihedral circuit
+    void reset_block() {
+        phases_.clear();
+        phase_index_.clear();
+        for (std::size_t i = 0; i < permutation_.size(); i++) {
+            permutation_[i].reset();
+            permutation_[i].set(i);
+        }
+    }
+
+    // Generates gates for a synthesized cnot-dihedral circuit
+    std::list<ast::ptr<ast::Gate>>
+    generate(std::list<synthesis::cx_dihedral> circuit) {
+        std::list<ast::ptr<ast::Gate>> ret;
 
-        // Synthesize circuit
-        for (auto& gate : synthesis::gray_synth(phases_, permutation_)) {
+        for (auto& gate : circuit) {
             std::visit(
                 utils::overloaded{
                     [&ret, this](std::pair<int, int>& cx) {
@@ -272,14 +372,6 @@ class CNOTOptimizer final : public ast::Replacer {
                 gate);
         }
 
-        // Reset the cnot-dihedral circuit
-        phases_.clear();
-        for (std::size_t i = 0; i < qubit_map_.size(); i++) {
-            for (std::size_t j = 0; j < qubit_map_.size(); j++) {
-                permutation_[i][j] = i == j ? true : false;
-            }
-        }
-
         return ret;
     }
 
@@ -289,23 +381,24 @@ class CNOTOptimizer final : public ast::Replacer {
     }
 
     int get_index(const ast::VarAccess& va) {
-        if (qubit_map_.find(va) != qubit_map_.end())
-            return qubit_map_[va];
+        if (auto id = qubits_.find(va))
+            return *id;
         else {
-            auto n = qubit_map_.size();
-            qubit_map_[va] = static_cast<int>(n);
-            map_qubit_.emplace(static_cast<int>(n), va);
+            auto n = static_cast<std::size_t>(qubits_.index(va));
 
             // Extend the current permutation
-            permutation_.emplace_back(std::vector<bool>(n + 1, false));
+            permutation_.emplace_back(n + 1);
             for (std::size_t i = 0; i < n; i++) {
-                permutation_[i].emplace_back(false);
+                permutation_[i].push_back(false);
             }
             permutation_[n][n] = true;
 
-            // Extend all other vectors
-            for (auto& [vec, angle] : phases_)
-                vec.emplace_back(false);
+            // Extend all other vectors, re-keying the index
+            phase_index_.clear();
+            for (auto it = phases_.begin(); it != phases_.end(); it++) {
+                it->first.push_back(false);
+                phase_index_.emplace(it->first, it);
+            }
 
             return static_cast<int>(n);
         }
@@ -320,7 +413,7 @@ class CNOTOptimizer final : public ast::Replacer {
 
         std::string name;
         std::vector<ast::ptr<ast::Expr>> cargs;
-        std::vector<ast::VarAccess> qargs{(map_qubit_.find(i))->second};
+        std::vector<ast::VarAccess> qargs{qubits_.access(i)};
 
         // Determine the name & classical arguments
         if (!c) {
@@ -359,8 +452,8 @@ class CNOTOptimizer final : public ast::Replacer {
         parser::Position pos;
         std::string name = "cx";
         std::vector<ast::ptr<ast::Expr>> cargs;
-        std::vector<ast::VarAccess> qargs{(map_qubit_.find(i))->second,
-                                          (map_qubit_.find(j))->second};
+        std::vector<ast::VarAccess> qargs{qubits_.access(i),
+                                          qubits_.access(j)};
 
         return std::make_unique<ast::DeclaredGate>(pos, name, std::move(cargs),
                                                    std::move(qargs));
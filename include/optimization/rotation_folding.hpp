@@ -33,11 +33,14 @@
 
 #include "qasmtools/ast/visitor.hpp"
 #include "qasmtools/ast/replacer.hpp"
+#include "qasmtools/ast/numbering.hpp"
 #include "gates/channel.hpp"
 
+#include <algorithm>
 #include <list>
 #include <sstream>
 #include <unordered_map>
+#include <vector>
 
 namespace staq {
 namespace optimization {
@@ -51,7 +54,7 @@ using namespace qasmtools;
  * Returns a replacement list giving the nodes to the be replaced (or erased)
  */
 class RotationOptimizer final : public ast::Visitor {
-    using Gatelib = gates::ChannelRepr<ast::VarAccess>;
+    using Gatelib = gates::ChannelRepr<int>;
 
   public:
     struct config {
@@ -82,10 +85,10 @@ class RotationOptimizer final : public ast::Visitor {
 
     /* Statements */
     void visit(ast::MeasureStmt& stmt) {
-        push_uninterp(Gatelib::Uninterp({stmt.q_arg()}));
+        push_uninterp(uninterp({stmt.q_arg()}));
     }
     void visit(ast::ResetStmt& stmt) {
-        push_uninterp(Gatelib::Uninterp({stmt.arg()}));
+        push_uninterp(uninterp({stmt.arg()}));
     }
     void visit(ast::IfStmt& stmt) {
         mergeable_ = false;
@@ -95,11 +98,11 @@ class RotationOptimizer final : public ast::Visitor {
 
     /* Gates */
     void visit(ast::UGate& gate) {
-        push_uninterp(Gatelib::Uninterp({gate.arg()}));
+        push_uninterp(uninterp({gate.arg()}));
     }
     void visit(ast::CNOTGate& gate) {
-        auto ctrl = gate.ctrl();
-        auto tgt = gate.tgt();
+        auto ctrl = qubits_.index(gate.ctrl());
+        auto tgt = qubits_.index(gate.tgt());
         if (mergeable_) {
             current_clifford_ *= Gatelib::Clifford::cnot(ctrl, tgt);
         } else {
@@ -107,82 +110,109 @@ class RotationOptimizer final : public ast::Visitor {
         }
     }
     void visit(ast::BarrierGate& gate) {
-        push_uninterp(Gatelib::Uninterp({gate.args()}));
+        push_uninterp(uninterp(gate.args()));
     }
     void visit(ast::DeclaredGate& gate) {
-        auto name = gate.name();
+        if (!mergeable_) {
+            push_uninterp(uninterp(gate.qargs()));
+            return;
+        }
 
-        if (mergeable_) {
-            if (name == "cx")
+        switch (gate.op()) {
+            case ast::GateOp::CX:
+                current_clifford_ *= Gatelib::Clifford::cnot(
+                    qubits_.index(gate.qarg(0)), qubits_.index(gate.qarg(1)));
+                break;
+            case ast::GateOp::H:
+                current_clifford_ *=
+                    Gatelib::Clifford::h(qubits_.index(gate.qarg(0)));
+                break;
+            case ast::GateOp::X:
+                current_clifford_ *=
+                    Gatelib::Clifford::x(qubits_.index(gate.qarg(0)));
+                break;
+            case ast::GateOp::Y:
+                current_clifford_ *=
+                    Gatelib::Clifford::y(qubits_.index(gate.qarg(0)));
+                break;
+            case ast::GateOp::Z:
+                current_clifford_ *=
+                    Gatelib::Clifford::z(qubits_.index(gate.qarg(0)));
+                break;
+            case ast::GateOp::S:
                 current_clifford_ *=
-                    Gatelib::Clifford::cnot(gate.qarg(0), gate.qarg(1));
-            else if (name == "h")
-                current_clifford_ *= Gatelib::Clifford::h(gate.qarg(0));
-            else if (name == "x")
-                current_clifford_ *= Gatelib::Clifford::x(gate.qarg(0));
-            else if (name == "y")
-                current_clifford_ *= Gatelib::Clifford::y(gate.qarg(0));
-            else if (name == "z")
-                current_clifford_ *= Gatelib::Clifford::z(gate.qarg(0));
-            else if (name == "s")
-                current_clifford_ *= Gatelib::Clifford::sdg(gate.qarg(0));
-            else if (name == "sdg")
-                current_clifford_ *= Gatelib::Clifford::s(gate.qarg(0));
-            else if (name == "t") {
-                auto rot = Gatelib::Rotation::t(gate.qarg(0));
+                    Gatelib::Clifford::sdg(qubits_.index(gate.qarg(0)));
+                break;
+            case ast::GateOp::Sdg:
+                current_clifford_ *=
+                    Gatelib::Clifford::s(qubits_.index(gate.qarg(0)));
+                break;
+            case ast::GateOp::T: {
+                auto rot =
+                    Gatelib::Rotation::t(qubits_.index(gate.qarg(0)));
                 rotation_info info{gate.uid(), rotation_info::axis::z,
                                    gate.qarg(0)};
                 accum_.push_back(
                     std::make_pair(info, rot.commute_left(current_clifford_)));
-            } else if (name == "tdg") {
-                auto rot = Gatelib::Rotation::tdg(gate.qarg(0));
+                break;
+            }
+            case ast::GateOp::Tdg: {
+                auto rot =
+                    Gatelib::Rotation::tdg(qubits_.index(gate.qarg(0)));
                 rotation_info info{gate.uid(), rotation_info::axis::z,
                                    gate.qarg(0)};
                 accum_.push_back(
                     std::make_pair(info, rot.commute_left(current_clifford_)));
-            } else if (name == "rz") {
+                break;
+            }
+            case ast::GateOp::RZ: {
                 auto angle = gate.carg(0).constant_eval();
 
                 if (angle) {
-                    auto rot = Gatelib::Rotation::rz(utils::Angle(*angle),
-                                                     gate.qarg(0));
+                    auto rot = Gatelib::Rotation::rz(
+                        utils::Angle(*angle), qubits_.index(gate.qarg(0)));
                     rotation_info info{gate.uid(), rotation_info::axis::z,
                                        gate.qarg(0)};
                     accum_.push_back(std::make_pair(
                         info, rot.commute_left(current_clifford_)));
                 } else {
-                    push_uninterp(Gatelib::Uninterp(gate.qargs()));
+                    push_uninterp(uninterp(gate.qargs()));
                 }
-            } else if (name == "rx") {
+                break;
+            }
+            case ast::GateOp::RX: {
                 auto angle = gate.carg(0).constant_eval();
 
                 if (angle) {
-                    auto rot = Gatelib::Rotation::rx(utils::Angle(*angle),
-                                                     gate.qarg(0));
+                    auto rot = Gatelib::Rotation::rx(
+                        utils::Angle(*angle), qubits_.index(gate.qarg(0)));
                     rotation_info info{gate.uid(), rotation_info::axis::x,
                                        gate.qarg(0)};
                     accum_.push_back(std::make_pair(
                         info, rot.commute_left(current_clifford_)));
                 } else {
-                    push_uninterp(Gatelib::Uninterp(gate.qargs()));
+                    push_uninterp(uninterp(gate.qargs()));
                 }
-            } else if (name == "ry") {
+                break;
+            }
+            case ast::GateOp::RY: {
                 auto angle = gate.carg(0).constant_eval();
 
                 if (angle) {
-                    auto rot = Gatelib::Rotation::ry(utils::Angle(*angle),
-                                                     gate.qarg(0));
+                    auto rot = Gatelib::Rotation::ry(
+                        utils::Angle(*angle), qubits_.index(gate.qarg(0)));
                     rotation_info info{gate.uid(), rotation_info::axis::y,
                                        gate.qarg(0)};
                     accum_.push_back(std::make_pair(
                         info, rot.commute_left(current_clifford_)));
                 } else {
-                    push_uninterp(Gatelib::Uninterp(gate.qargs()));
+                    push_uninterp(uninterp(gate.qargs()));
                 }
-            } else
-                push_uninterp(Gatelib::Uninterp(gate.qargs()));
-        } else {
-            push_uninterp(Gatelib::Uninterp(gate.qargs()));
+                break;
+            }
+            default:
+                push_uninterp(uninterp(gate.qargs()));
+                break;
         }
     }
 
@@ -191,8 +221,10 @@ class RotationOptimizer final : public ast::Visitor {
         // Initialize a new local state
         circuit_callback local_state;
         Gatelib::Clifford local_clifford;
+        ast::QubitNumbering local_qubits;
         std::swap(accum_, local_state);
         std::swap(current_clifford_, local_clifford);
+        std::swap(qubits_, local_qubits);
 
         // Process gate body
         decl.foreach_stmt([this](auto& stmt) { stmt.accept(*this); });
@@ -204,6 +236,7 @@ class RotationOptimizer final : public ast::Visitor {
         // Reset the state
         std::swap(accum_, local_state);
         std::swap(current_clifford_, local_clifford);
+        std::swap(qubits_, local_qubits);
     }
     void visit(ast::OracleDecl&) {}
     void visit(ast::RegisterDecl&) {}
@@ -229,8 +262,74 @@ class RotationOptimizer final : public ast::Visitor {
     };
 
     using circuit_callback =
-        std::list<std::variant<Gatelib::Uninterp, Gatelib::Clifford,
-                               std::pair<rotation_info, Gatelib::Rotation>>>;
+        std::vector<std::variant<Gatelib::Uninterp, Gatelib::Clifford,
+                                 std::pair<rotation_info, Gatelib::Rotation>>>;
+
+    // Positions of the accumulated ops acting on each qubit, so that a
+    // rotation being folded only visits the ops whose support meets its own
+    class support_index {
+      public:
+        explicit support_index(const circuit_callback& circuit)
+            : erased_(circuit.size(), false) {
+            for (int i = 0; i < static_cast<int>(circuit.size()); i++) {
+                auto add = [this, i](int q) {
+                    if (q >= static_cast<int>(ops_.size()))
+                        ops_.resize(q + 1);
+                    ops_[q].push_back(i);
+                };
+
+                auto visitor = utils::overloaded{
+                    [&add](const std::pair<rotation_info, Gatelib::Rotation>&
+                               P) {
+                        P.second.pauli().foreach (
+                            [&add](auto& p) { add(p.first); });
+                    },
+                    [&add](const Gatelib::Clifford& C) {
+                        C.foreach_qubit(add);
+                    },
+                    [&add](const Gatelib::Uninterp& U) {
+                        U.foreach_qubit(add);
+                    }};
+
+                std::visit(visitor, circuit[i]);
+            }
+        }
+
+        bool erased(int i) const { return erased_[i]; }
+        void erase(int i) { erased_[i] = true; }
+
+        // The last op before pos, or -1 if none
+        int prev(int pos) const {
+            for (--pos; pos >= 0 && erased_[pos]; --pos) {
+            }
+            return pos;
+        }
+
+        // The last op before pos acting on a qubit of P, or -1 if none
+        int prev(const Gatelib::Pauli& P, int pos) const {
+            int ret = -1;
+            P.foreach ([this, pos, &ret](auto& p) {
+                if (p.first >= static_cast<int>(ops_.size()))
+                    return;
+
+                auto& ops = ops_[p.first];
+                auto it = std::lower_bound(ops.begin(), ops.end(), pos);
+                while (it != ops.begin() && *std::prev(it) > ret) {
+                    --it;
+                    if (!erased_[*it]) {
+                        ret = *it;
+                        break;
+                    }
+                }
+            });
+
+            return ret;
+        }
+
+      private:
+        std::vector<std::vector<int>> ops_; // op positions, by qubit
+        std::vector<bool> erased_;          // ops merged into a later one
+    };
 
     config config_;
     std::unordered_map<int, std::list<ast::ptr<ast::Gate>>> replacement_list_;
@@ -241,6 +340,7 @@ class RotationOptimizer final : public ast::Visitor {
     bool mergeable_ =
         true; // Whether we're in a context where a gate can be merged
     Gatelib::Clifford current_clifford_; // The current clifford operator
+    ast::QubitNumbering qubits_; // Dense indices of the qubits in scope
     // Note: current clifford is stored as the dagger of the actual Clifford
     // gate this is so that left commutation (i.e. conjugation) actually
     // right-commutes the rotation gate, allowing us to walk the circuit
@@ -255,6 +355,7 @@ class RotationOptimizer final : public ast::Visitor {
         accum_.clear();
         mergeable_ = true;
         current_clifford_ = Gatelib::Clifford();
+        qubits_.clear();
     }
 
     /* Phase two of the algorithm */
@@ -263,39 +364,36 @@ class RotationOptimizer final : public ast::Visitor {
         ast::VarAccess* tgt = nullptr;
         std::list<ast::ptr<ast::Gate>>* subst_ref = nullptr;
 
-        for (auto it = circuit.rbegin(); it != circuit.rend(); it++) {
-            auto& op = *it;
+        support_index index(circuit);
+        for (int i = static_cast<int>(circuit.size()) - 1; i > 0; i--) {
+            if (index.erased(i))
+                continue;
+
             if (auto tmp =
                     std::get_if<std::pair<rotation_info, Gatelib::Rotation>>(
-                        &op)) {
-
-                auto it_next = std::next(it);
-                if (it_next != circuit.rend()) {
-                    auto [new_phase, new_R] =
-                        fold_forward(circuit, it_next, tmp->second);
-
-                    global_phase += new_phase;
-                    if (!(new_R == tmp->second)) {
-                        std::list<ast::ptr<ast::Gate>> subst;
-
-                        auto rot =
-                            alloc_rot(tmp->first, new_R.rotation_angle());
-                        if (rot)
-                            subst.emplace_back(rot);
-                        replacement_list_[tmp->first.uid] = std::move(subst);
-
-                        // WARNING: this is a massive hack so that the global
-                        // phase correction can be performed by the replacement
-                        // engine. We append the final phase correction to the
-                        // last gate substitution in-place in the replacement
-                        // list. Since we need a qubit to apply the phase
-                        // correction on, we select the qubit on which the
-                        // rotation itself was applied.
-                        tgt = &(tmp->first.arg);
-                        subst_ref = &(replacement_list_[tmp->first.uid]);
-                    }
-                } else
-                    break;
+                        &circuit[i])) {
+                auto [new_phase, new_R] =
+                    fold_forward(circuit, index, i, tmp->second);
+
+                global_phase += new_phase;
+                if (!(new_R == tmp->second)) {
+                    std::list<ast::ptr<ast::Gate>> subst;
+
+                    auto rot = alloc_rot(tmp->first, new_R.rotation_angle());
+                    if (rot)
+                        subst.emplace_back(rot);
+                    replacement_list_[tmp->first.uid] = std::move(subst);
+
+                    // WARNING: this is a massive hack so that the global
+                    // phase correction can be performed by the replacement
+                    // engine. We append the final phase correction to the
+                    // last gate substitution in-place in the replacement
+                    // list. Since we need a qubit to apply the phase
+                    // correction on, we select the qubit on which the
+                    // rotation itself was applied.
+                    tgt = &(tmp->first.arg);
+                    subst_ref = &(replacement_list_[tmp->first.uid]);
+                }
             }
         }
 
@@ -364,19 +462,42 @@ class RotationOptimizer final : public ast::Visitor {
     }
 
     std::pair<utils::Angle, Gatelib::Rotation>
-    fold_forward(circuit_callback& circuit,
-                 circuit_callback::reverse_iterator it, Gatelib::Rotation R) {
+    fold_forward(circuit_callback& circuit, support_index& index, int pos,
+                 Gatelib::Rotation R) {
         // Tries to commute op backward as much as possible, merging with
         // applicable gates and deleting them as it goes Note: We go backwards
         // so that we only commute **left** past C^*/**right** past C
+        //
+        // Ops acting only on qubits outside the support of R commute with it
+        // and leave it unchanged. Once we have walked past as many of those
+        // in a row as R has qubits, finding the next op on one of them costs
+        // about the same as walking further, so we jump straight there
 
         auto phase = utils::angles::zero;
         bool cont = true;
+        std::size_t weight = R.pauli().weight();
+        std::size_t disjoint = 0;
+
+        while (cont) {
+            if (disjoint < weight) {
+                pos = index.prev(pos);
+            } else {
+                pos = index.prev(R.pauli(), pos);
+                disjoint = 0;
+            }
+
+            if (pos < 0)
+                break;
 
-        for (; cont && it != circuit.rend(); it++) {
             auto visitor = utils::overloaded{
-                [this, it, &R, &phase,
-                 &circuit](std::pair<rotation_info, Gatelib::Rotation>& P) {
+                [this, pos, &R, &phase, &index,
+                 &disjoint](std::pair<rotation_info, Gatelib::Rotation>& P) {
+                    if (!R.pauli().overlaps(P.second.pauli())) {
+                        disjoint++;
+                        return true;
+                    }
+
+                    disjoint = 0;
                     auto res = R.try_merge(P.second);
                     if (res) {
                         auto& [new_phase, new_R] = res.value();
@@ -386,10 +507,7 @@ class RotationOptimizer final : public ast::Visitor {
                         // Delete R in circuit & the node
                         replacement_list_[P.first.uid] =
                             std::move(std::list<ast::ptr<ast::Gate>>());
-
-                        auto it_next = std::next(it);
-                        if (it_next != circuit.rend())
-                            circuit.erase(std::next(it).base());
+                        index.erase(pos);
 
                         return false;
                     } else if (R.commutes_with(P.second)) {
@@ -398,24 +516,35 @@ class RotationOptimizer final : public ast::Visitor {
                         return false;
                     }
                 },
-                [&R](Gatelib::Clifford& C) {
+                [&R, &weight, &disjoint](Gatelib::Clifford& C) {
                     R = R.commute_left(C);
+                    weight = R.pauli().weight();
+                    disjoint = 0;
                     return true;
                 },
-                [&R](Gatelib::Uninterp& U) {
+                [&R, &disjoint](Gatelib::Uninterp& U) {
                     if (!R.commutes_with(U))
                         return false;
-                    else
-                        return true;
+
+                    disjoint++;
+                    return true;
                 }};
 
-            cont = std::visit(visitor, *it);
+            cont = std::visit(visitor, circuit[pos]);
         }
 
         return std::make_pair(phase, R);
     }
 
     /* Utilities */
+    Gatelib::Uninterp uninterp(const std::vector<ast::VarAccess>& args) {
+        std::vector<int> qubits;
+        qubits.reserve(args.size());
+        for (auto& arg : args)
+            qubits.push_back(qubits_.index(arg));
+        return Gatelib::Uninterp(qubits);
+    }
+
     void push_uninterp(Gatelib::Uninterp op) {
         accum_.push_back(current_clifford_);
         accum_.push_back(op);
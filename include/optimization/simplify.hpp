@@ -33,8 +33,11 @@
 
 #include "qasmtools/ast/visitor.hpp"
 #include "qasmtools/ast/replacer.hpp"
+#include "qasmtools/ast/numbering.hpp"
+#include "ir/circuit.hpp"
 
-#include <tuple>
+#include <algorithm>
+#include <vector>
 
 namespace staq {
 namespace optimization {
@@ -45,13 +48,30 @@ namespace ast = qasmtools::ast;
  * \brief Basic adjacent gate cancellation algorithm
  *
  *  Returns a replacement list giving the nodes to the be erased
+ *
+ *  In fixpoint mode, a stack of the gates applied so far is kept for each
+ *  qubit. When a gate cancels with the top of its qubits' stacks, the stacks
+ *  are popped, so the gates which become adjacent as a result are compared
+ *  when the next gate arrives. Nested cancellations such as h x z z x h are
+ *  thus found in a single pass over the program.
+ *
+ *  In commutation mode, an incoming gate may also cancel with a gate further
+ *  down the stacks, provided every gate above it commutes with the incoming
+ *  gate. The search is bounded by a window on each qubit. Since erasing a
+ *  gate can unblock an earlier pair, the pass is repeated until no more
+ *  gates are erased.
+ *
+ *  The pass runs either over a syntax tree or over a flat circuit, where it
+ *  erases operations in place rather than rebuilding statement lists.
  */
 
 // TODO: add option for global phase correction
 class Simplifier final : public ast::Visitor {
   public:
     struct config {
-        bool fixpoint = true;
+        bool fixpoint = true; ///< cancel gates made adjacent by cancellations
+        bool commute = false; ///< cancel gates across commuting gates
+        int window = 16;      ///< per-qubit search depth for commutation
     };
 
     Simplifier() = default;
@@ -59,11 +79,45 @@ class Simplifier final : public ast::Visitor {
     ~Simplifier() = default;
 
     void run(ast::ASTNode& node) {
+        bool changed;
         do {
-            replace_gates(node, std::move(erasures_));
             reset();
             node.accept(*this);
-        } while (!erasures_.empty());
+            changed = !erasures_.empty();
+            replace_gates(node, std::move(erasures_));
+        } while (config_.commute && config_.fixpoint && changed);
+    }
+
+    /**
+     * \brief Simplifies a flat circuit
+     *
+     * Operation i is tracked with id i + 1, as 0 marks an empty history entry.
+     * Gate declarations are opaque to the circuit, so their bodies are
+     * simplified as syntax trees.
+     */
+    void run(ir::Circuit& circuit) {
+        for (std::size_t i = 0; i < circuit.size(); i++) {
+            if (circuit.opcode(i) != ir::Opcode::Opaque)
+                continue;
+            if (auto decl = dynamic_cast<ast::GateDecl*>(&circuit.opaque(i)))
+                run(*decl);
+        }
+
+        bool changed;
+        do {
+            reset();
+            for (std::size_t i = 0; i < circuit.size(); i++) {
+                mergeable_ = !circuit.condition(i);
+                visit_op(circuit, i);
+            }
+            mergeable_ = true;
+
+            changed = !erasures_.empty();
+            for (auto& [id, replacement] : erasures_)
+                circuit.erase(id - 1);
+        } while (config_.commute && config_.fixpoint && changed);
+
+        circuit.compact();
     }
 
     /* Variables */
@@ -79,10 +133,12 @@ class Simplifier final : public ast::Visitor {
 
     /* Statements */
     void visit(ast::MeasureStmt& stmt) {
-        last_[stmt.q_arg()] = {"measure", {stmt.q_arg()}, stmt.uid()};
+        int q = qubits_.index(stmt.q_arg());
+        record(q, {ast::GateOp::Other, {q}, stmt.uid()});
     }
     void visit(ast::ResetStmt& stmt) {
-        last_[stmt.arg()] = {"reset", {stmt.arg()}, stmt.uid()};
+        int q = qubits_.index(stmt.arg());
+        record(q, {ast::GateOp::Other, {q}, stmt.uid()});
     }
     void visit(ast::IfStmt& stmt) {
         mergeable_ = false;
@@ -100,252 +156,60 @@ class Simplifier final : public ast::Visitor {
             return;
         }
 
-        last_[gate.arg()] = {"U", {gate.arg()}, gate.uid()};
+        int q = qubits_.index(gate.arg());
+        record(q, {ast::GateOp::Other, {q}, gate.uid()});
     }
     void visit(ast::CNOTGate& gate) {
-        auto ctrl = gate.ctrl();
-        auto tgt = gate.tgt();
-
-        if (mergeable_) {
-            auto [name1, args1, uid1] = last_[ctrl];
-            auto [name2, args2, uid2] = last_[tgt];
-
-            if (uid1 == uid2 && name1 == "cx" &&
-                args1 == std::vector<ast::VarAccess>({ctrl, tgt})) {
-                erasures_[uid1] = std::move(std::list<ast::ptr<ast::Gate>>());
-                erasures_[gate.uid()] =
-                    std::move(std::list<ast::ptr<ast::Gate>>());
+        std::vector<int> args{qubits_.index(gate.ctrl()),
+                              qubits_.index(gate.tgt())};
 
-                last_.erase(ctrl);
-                last_.erase(tgt);
-
-                return;
-            }
-        }
+        if (mergeable_ && try_cancel(gate.uid(), ast::GateOp::CX, args))
+            return;
 
-        last_[ctrl] = {"cx", {ctrl, tgt}, gate.uid()};
-        last_[tgt] = {"cx", {ctrl, tgt}, gate.uid()};
+        for (auto q : args)
+            record(q, {ast::GateOp::CX, args, gate.uid()});
     }
     void visit(ast::BarrierGate& gate) {
-        gate.foreach_arg([this, &gate](auto& arg) {
-            last_[arg] = {"barrier", gate.args(), gate.uid()};
-        });
+        auto args = indices(gate.args());
+        for (auto q : args)
+            record(q, {ast::GateOp::Other, args, gate.uid()});
     }
     void visit(ast::DeclaredGate& gate) {
-        auto name = gate.name();
-
-        if (name == "u3") {
-            auto theta = gate.carg(0).constant_eval();
-            auto phi = gate.carg(1).constant_eval();
-            auto lambda = gate.carg(2).constant_eval();
-            if (theta && phi && lambda && (*theta == 0) &&
-                (*phi + *lambda == 0)) {
-                erasures_[gate.uid()] =
-                    std::move(std::list<ast::ptr<ast::Gate>>());
-                return;
-            }
-        } else if (name == "u1" || name == "rx" || name == "ry" ||
-                   name == "rz" || name == "crz" || name == "cu1") {
-            auto lambda = gate.carg(0).constant_eval();
-            if (lambda && (*lambda == 0)) {
-                erasures_[gate.uid()] =
-                    std::move(std::list<ast::ptr<ast::Gate>>());
-                return;
-            }
-        } else if (name == "id" || name == "u0") {
+        auto params = [&gate](int j) { return gate.carg(j).constant_eval(); };
+        if (is_identity(gate.op(), params)) {
             erasures_[gate.uid()] = std::move(std::list<ast::ptr<ast::Gate>>());
             return;
-        } else if (name == "cu3") {
-            auto theta = gate.carg(0).constant_eval();
-            auto phi = gate.carg(1).constant_eval();
-            auto lambda = gate.carg(2).constant_eval();
-            if (theta && phi && lambda && (*theta == 0) && (*phi == 0) &&
-                (*lambda == 0)) {
-                erasures_[gate.uid()] =
-                    std::move(std::list<ast::ptr<ast::Gate>>());
-                return;
-            }
         }
 
-        if (mergeable_) {
-            if (name == "cx") {
-                auto ctrl = gate.qarg(0);
-                auto tgt = gate.qarg(1);
-                auto [name1, args1, uid1] = last_[ctrl];
-                auto [name2, args2, uid2] = last_[tgt];
-
-                if (uid1 == uid2 && name1 == "cx" &&
-                    args1 == std::vector<ast::VarAccess>({ctrl, tgt})) {
-                    erasures_[uid1] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-                    erasures_[gate.uid()] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-
-                    last_.erase(ctrl);
-                    last_.erase(tgt);
-
-                    return;
-                }
-            } else if (name == "ccx") {
-                auto ctrl1 = gate.qarg(0);
-                auto ctrl2 = gate.qarg(1);
-                auto tgt = gate.qarg(2);
-                auto [name1, args1, uid1] = last_[ctrl1];
-                auto [name2, args2, uid2] = last_[ctrl2];
-                auto [name3, args3, uid3] = last_[tgt];
-
-                if (uid1 == uid2 && uid1 == uid3 && name1 == "ccx" &&
-                    args1 == std::vector<ast::VarAccess>({ctrl1, ctrl2, tgt})) {
-                    erasures_[uid1] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-                    erasures_[gate.uid()] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-
-                    last_.erase(ctrl1);
-                    last_.erase(ctrl2);
-                    last_.erase(tgt);
-
-                    return;
-                }
-            } else if (name == "h") {
-                auto arg = gate.qarg(0);
-                auto [name, args, uid] = last_[arg];
-
-                if (name == "h" && args == std::vector<ast::VarAccess>({arg})) {
-                    erasures_[uid] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-                    erasures_[gate.uid()] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-
-                    last_.erase(arg);
-
-                    return;
-                }
-            } else if (name == "x") {
-                auto arg = gate.qarg(0);
-                auto [name, args, uid] = last_[arg];
-
-                if (name == "x" && args == std::vector<ast::VarAccess>({arg})) {
-                    erasures_[uid] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-                    erasures_[gate.uid()] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-
-                    last_.erase(arg);
-
-                    return;
-                }
-            } else if (name == "y") {
-                auto arg = gate.qarg(0);
-                auto [name, args, uid] = last_[arg];
-
-                if (name == "y" && args == std::vector<ast::VarAccess>({arg})) {
-                    erasures_[uid] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-                    erasures_[gate.uid()] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-
-                    last_.erase(arg);
-
-                    return;
-                }
-            } else if (name == "z") {
-                auto arg = gate.qarg(0);
-                auto [name, args, uid] = last_[arg];
-
-                if (name == "z" && args == std::vector<ast::VarAccess>({arg})) {
-                    erasures_[uid] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-                    erasures_[gate.uid()] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-
-                    last_.erase(arg);
-
-                    return;
-                }
-            } else if (name == "s") {
-                auto arg = gate.qarg(0);
-                auto [name, args, uid] = last_[arg];
-
-                if (name == "sdg" &&
-                    args == std::vector<ast::VarAccess>({arg})) {
-                    erasures_[uid] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-                    erasures_[gate.uid()] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
+        auto args = indices(gate.qargs());
 
-                    last_.erase(arg);
-
-                    return;
-                }
-            } else if (name == "sdg") {
-                auto arg = gate.qarg(0);
-                auto [name, args, uid] = last_[arg];
-
-                if (name == "s" && args == std::vector<ast::VarAccess>({arg})) {
-                    erasures_[uid] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-                    erasures_[gate.uid()] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-
-                    last_.erase(arg);
-
-                    return;
-                }
-            } else if (name == "t") {
-                auto arg = gate.qarg(0);
-                auto [name, args, uid] = last_[arg];
-
-                if (name == "tdg" &&
-                    args == std::vector<ast::VarAccess>({arg})) {
-                    erasures_[uid] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-                    erasures_[gate.uid()] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-
-                    last_.erase(arg);
-
-                    return;
-                }
-            } else if (name == "tdg") {
-                auto arg = gate.qarg(0);
-                auto [name, args, uid] = last_[arg];
-
-                if (name == "t" && args == std::vector<ast::VarAccess>({arg})) {
-                    erasures_[uid] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-                    erasures_[gate.uid()] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-
-                    last_.erase(arg);
-
-                    return;
-                }
-            }
-        }
+        if (mergeable_ && try_cancel(gate.uid(), gate.op(), args))
+            return;
 
-        gate.foreach_qarg([this, &gate, &name](auto& arg) {
-            last_[arg] = {name, gate.qargs(), gate.uid()};
-        });
+        for (auto q : args)
+            record(q, {gate.op(), args, gate.uid()});
     }
 
     /* Declarations */
     void visit(ast::GateDecl& decl) {
         // Initialize a new local state
-        std::unordered_map<
-            ast::VarAccess,
-            std::tuple<std::string, std::vector<ast::VarAccess>, int>>
-            local_state;
+        ast::QubitNumbering local_qubits;
+        std::vector<std::vector<gate_info>> local_state;
+        std::swap(qubits_, local_qubits);
         std::swap(last_, local_state);
 
         // Process gate body
         decl.foreach_stmt([this](auto& stmt) { stmt.accept(*this); });
 
         // Reset the state
+        std::swap(qubits_, local_qubits);
         std::swap(last_, local_state);
     }
     void visit(ast::OracleDecl&) {}
-    void visit(ast::RegisterDecl&) {}
+    void visit(ast::RegisterDecl& decl) {
+        if (decl.is_quantum())
+            qubits_.add_register(decl.id(), decl.size());
+    }
     void visit(ast::AncillaDecl&) {}
 
     /* Program */
@@ -354,19 +218,288 @@ class Simplifier final : public ast::Visitor {
     }
 
   private:
+    /**
+     * \brief The last gate applied to a qubit
+     */
+    struct gate_info {
+        ast::GateOp op = ast::GateOp::Other; ///< standard gate, if any
+        std::vector<int> args;               ///< qubit arguments
+        int uid = 0;                         ///< uid of the gate, or flat id
+        bool conditional = false;            ///< whether the gate is guarded
+    };
+
     config config_;
     bool mergeable_;
     std::unordered_map<int, std::list<ast::ptr<ast::Gate>>> erasures_;
-    std::unordered_map<
-        ast::VarAccess,
-        std::tuple<std::string, std::vector<ast::VarAccess>, int>>
-        last_;
+    ast::QubitNumbering qubits_; ///< dense qubit IDs
+    std::vector<std::vector<gate_info>> last_; ///< gates on each qubit, by ID
+
+    /**
+     * \brief Whether a standard gate is the identity for its parameters
+     *
+     * \param op The gate
+     * \param param Returns the constant value of the jth parameter, if any
+     */
+    template <typename Param>
+    static bool is_identity(ast::GateOp op, Param&& param) {
+        switch (op) {
+            case ast::GateOp::U3: {
+                auto theta = param(0);
+                auto phi = param(1);
+                auto lambda = param(2);
+                return theta && phi && lambda && (*theta == 0) &&
+                       (*phi + *lambda == 0);
+            }
+            case ast::GateOp::U1:
+            case ast::GateOp::RX:
+            case ast::GateOp::RY:
+            case ast::GateOp::RZ:
+            case ast::GateOp::CRZ:
+            case ast::GateOp::CU1: {
+                auto lambda = param(0);
+                return lambda && (*lambda == 0);
+            }
+            case ast::GateOp::Id:
+            case ast::GateOp::U0:
+                return true;
+            case ast::GateOp::CU3: {
+                auto theta = param(0);
+                auto phi = param(1);
+                auto lambda = param(2);
+                return theta && phi && lambda && (*theta == 0) &&
+                       (*phi == 0) && (*lambda == 0);
+            }
+            default:
+                return false;
+        }
+    }
+
+    /**
+     * \brief Processes operation i of a flat circuit, as the visitor does
+     * the corresponding statement
+     */
+    void visit_op(const ir::Circuit& circuit, std::size_t i) {
+        int id = static_cast<int>(i) + 1;
+        auto params = [&circuit, i](int j) { return circuit.value(i, j); };
+
+        // Whole registers are tracked apart from their elements, after them
+        std::vector<int> args;
+        for (int q : circuit.qargs(i)) {
+            args.push_back(ir::Circuit::is_register(q)
+                               ? circuit.num_qubits() +
+                                     ir::Circuit::register_of(q)
+                               : q);
+        }
+
+        auto op = ast::GateOp::Other;
+        switch (circuit.opcode(i)) {
+            case ir::Opcode::U:
+                if (is_identity(ast::GateOp::U3, params)) {
+                    erasures_[id] = std::list<ast::ptr<ast::Gate>>();
+                    return;
+                }
+                break;
+            case ir::Opcode::CX:
+                op = ast::GateOp::CX;
+                break;
+            case ir::Opcode::Gate:
+                op = ast::gate_op(circuit.gate_name(i));
+                if (is_identity(op, params)) {
+                    erasures_[id] = std::list<ast::ptr<ast::Gate>>();
+                    return;
+                }
+                break;
+            case ir::Opcode::Barrier:
+            case ir::Opcode::Measure:
+            case ir::Opcode::Reset:
+                break;
+            default:
+                return;
+        }
+
+        if (mergeable_ && try_cancel(id, op, args))
+            return;
+
+        for (auto q : args)
+            record(q, {op, args, id});
+    }
 
     void reset() {
         erasures_.clear();
+        qubits_.clear();
         last_.clear();
         mergeable_ = true;
     }
+
+    std::vector<gate_info>& history(int q) {
+        if (q >= static_cast<int>(last_.size()))
+            last_.resize(q + 1);
+        return last_[q];
+    }
+
+    /**
+     * \brief Records a gate applied to a qubit
+     */
+    void record(int q, gate_info&& info) {
+        info.conditional = !mergeable_;
+        auto& gates = history(q);
+        if (!config_.fixpoint && !gates.empty())
+            gates.back() = std::move(info);
+        else
+            gates.emplace_back(std::move(info));
+    }
+
+    /**
+     * \brief Removes a gate from a qubit's history, exposing the one before
+     * it if running to a fixpoint
+     *
+     * \param q The qubit
+     * \param depth The position of the gate, counting back from the last
+     */
+    void erase(int q, std::size_t depth) {
+        auto& gates = history(q);
+        if (config_.fixpoint)
+            gates.erase(gates.end() - 1 - depth);
+        else
+            gates.back() = gate_info{};
+    }
+
+    /**
+     * \brief Cancels an incoming gate with an earlier copy of its inverse
+     *
+     * The inverse must be the last gate on each argument, or in commutation
+     * mode be separated from the incoming gate only by gates commuting with it.
+     * Gates under a classical condition are never taken as the inverse
+     *
+     * \param uid The uid of the incoming gate
+     * \param op The incoming gate
+     * \param args The qubit arguments of the incoming gate
+     * \return True if the gate was cancelled
+     */
+    bool try_cancel(int uid, ast::GateOp op, const std::vector<int>& args) {
+        auto inv = inverse(op);
+        if (inv == ast::GateOp::Other || args.empty())
+            return false;
+
+        std::size_t window =
+            config_.commute ? static_cast<std::size_t>(config_.window) : 1;
+        int match = 0;
+        std::vector<std::size_t> depths;
+
+        for (std::size_t i = 0; i < args.size(); i++) {
+            auto& gates = history(args[i]);
+            auto limit = std::min(window, gates.size());
+
+            std::size_t depth = 0;
+            for (; depth < limit; depth++) {
+                auto& prev = gates[gates.size() - 1 - depth];
+                if (match == 0 && !prev.conditional && prev.op == inv &&
+                    prev.args == args)
+                    match = prev.uid;
+                if (match != 0 && prev.uid == match)
+                    break;
+                if (!commutes(prev, args[i], op, i))
+                    return false;
+            }
+
+            if (depth == limit)
+                return false;
+            depths.push_back(depth);
+        }
+
+        erasures_[match] = std::move(std::list<ast::ptr<ast::Gate>>());
+        erasures_[uid] = std::move(std::list<ast::ptr<ast::Gate>>());
+        for (std::size_t i = 0; i < args.size(); i++)
+            erase(args[i], depths[i]);
+
+        return true;
+    }
+
+    /**
+     * \brief The action of a standard gate on its ith argument
+     */
+    enum class action { None, Z, X };
+    static action action_on(ast::GateOp op, std::size_t i) {
+        switch (op) {
+            case ast::GateOp::Z:
+            case ast::GateOp::S:
+            case ast::GateOp::Sdg:
+            case ast::GateOp::T:
+            case ast::GateOp::Tdg:
+            case ast::GateOp::RZ:
+            case ast::GateOp::U1:
+            case ast::GateOp::CZ:
+            case ast::GateOp::CRZ:
+            case ast::GateOp::CU1:
+                return action::Z;
+            case ast::GateOp::X:
+            case ast::GateOp::RX:
+                return action::X;
+            case ast::GateOp::CX:
+                return i == 0 ? action::Z : action::X;
+            case ast::GateOp::CCX:
+                return i < 2 ? action::Z : action::X;
+            case ast::GateOp::CY:
+            case ast::GateOp::CH:
+            case ast::GateOp::CU3:
+                return i == 0 ? action::Z : action::None;
+            default:
+                return action::None;
+        }
+    }
+
+    /**
+     * \brief Whether an earlier gate commutes with an incoming gate on a qubit
+     *
+     * Gates commute on a qubit if both act diagonally in the Z basis, or
+     * both in the X basis, on it
+     *
+     * \param prev The earlier gate
+     * \param q The qubit
+     * \param op The incoming gate
+     * \param i The position of q in the arguments of the incoming gate
+     */
+    static bool commutes(const gate_info& prev, int q, ast::GateOp op,
+                         std::size_t i) {
+        auto it = std::find(prev.args.begin(), prev.args.end(), q);
+        auto a = action_on(prev.op, it - prev.args.begin());
+        return a != action::None && a == action_on(op, i);
+    }
+
+    /**
+     * \brief The inverse of a self-cancelling standard gate
+     *
+     * \return The inverse gate, or GateOp::Other if none is tracked
+     */
+    static ast::GateOp inverse(ast::GateOp op) {
+        switch (op) {
+            case ast::GateOp::CX:
+            case ast::GateOp::CCX:
+            case ast::GateOp::H:
+            case ast::GateOp::X:
+            case ast::GateOp::Y:
+            case ast::GateOp::Z:
+                return op;
+            case ast::GateOp::S:
+                return ast::GateOp::Sdg;
+            case ast::GateOp::Sdg:
+                return ast::GateOp::S;
+            case ast::GateOp::T:
+                return ast::GateOp::Tdg;
+            case ast::GateOp::Tdg:
+                return ast::GateOp::T;
+            default:
+                return ast::GateOp::Other;
+        }
+    }
+
+    std::vector<int> indices(const std::vector<ast::VarAccess>& args) {
+        std::vector<int> ret;
+        ret.reserve(args.size());
+        for (auto& arg : args)
+            ret.push_back(qubits_.index(arg));
+        return ret;
+    }
 };
 
 inline void simplify(ast::ASTNode& node) {
@@ -379,5 +512,15 @@ inline void simplify(ast::ASTNode& node, const Simplifier::config& params) {
     optimizer.run(node);
 }
 
+inline void simplify(ir::Circuit& circuit) {
+    Simplifier optimizer;
+    optimizer.run(circuit);
+}
+
+inline void simplify(ir::Circuit& circuit, const Simplifier::config& params) {
+    Simplifier optimizer(params);
+    optimizer.run(circuit);
+}
+
 } // namespace optimization
 } // namespace staq
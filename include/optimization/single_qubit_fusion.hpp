@@ -0,0 +1,372 @@
+/*
+ * This file is part of staq.
+ *
+ * Copyright (c) 2019 - 2021 softwareQ Inc. All rights reserved.
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * \file optimization/single_qubit_fusion.hpp
+ * \brief Single-qubit gate fusion
+ */
+
+#pragma once
+
+#include "qasmtools/ast/visitor.hpp"
+#include "qasmtools/ast/replacer.hpp"
+#include "qasmtools/ast/numbering.hpp"
+
+#include <array>
+#include <cmath>
+#include <complex>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace staq {
+namespace optimization {
+
+using namespace qasmtools;
+
+/**
+ * \class staq::optimization::SingleQubitFuser
+ * \brief Fuses runs of single-qubit gates into a single U gate
+ *
+ * Consecutive single-qubit gates with constant parameters on the same qubit
+ * are multiplied together as 2x2 matrices. A run of two or more gates is
+ * replaced with one U gate at the position of its last gate, or erased if
+ * the product is the identity up to global phase within the tolerance.
+ *
+ * Returns a replacement list giving the nodes to the be replaced (or erased)
+ */
+class SingleQubitFuser final : public ast::Visitor {
+    using matrix = std::array<std::complex<double>, 4>; ///< row-major 2x2
+
+  public:
+    struct config {
+        double tolerance = 1e-10;
+    };
+
+    SingleQubitFuser() = default;
+    SingleQubitFuser(const config& params) : Visitor(), config_(params) {}
+    ~SingleQubitFuser() = default;
+
+    std::unordered_map<int, std::list<ast::ptr<ast::Gate>>>
+    run(ast::ASTNode& node) {
+        reset();
+        node.accept(*this);
+        return std::move(replacement_list_);
+    }
+
+    /* Variables */
+    void visit(ast::VarAccess&) {}
+
+    /* Expressions */
+    void visit(ast::BExpr&) {}
+    void visit(ast::UExpr&) {}
+    void visit(ast::PiExpr&) {}
+    void visit(ast::IntExpr&) {}
+    void visit(ast::RealExpr&) {}
+    void visit(ast::VarExpr&) {}
+
+    /* Statements */
+    void visit(ast::MeasureStmt& stmt) { flush(stmt.q_arg()); }
+    void visit(ast::ResetStmt& stmt) { flush(stmt.arg()); }
+    void visit(ast::IfStmt& stmt) {
+        mergeable_ = false;
+        stmt.then().accept(*this);
+        mergeable_ = true;
+    }
+
+    /* Gates */
+    void visit(ast::UGate& gate) {
+        auto theta = gate.theta().constant_eval();
+        auto phi = gate.phi().constant_eval();
+        auto lambda = gate.lambda().constant_eval();
+
+        if (theta && phi && lambda)
+            push(gate.uid(), gate.arg(), u(*theta, *phi, *lambda));
+        else
+            flush(gate.arg());
+    }
+    void visit(ast::CNOTGate& gate) {
+        flush(gate.ctrl());
+        flush(gate.tgt());
+    }
+    void visit(ast::BarrierGate& gate) {
+        gate.foreach_arg([this](auto& arg) { flush(arg); });
+    }
+    void visit(ast::DeclaredGate& gate) {
+        if (auto mat = to_matrix(gate))
+            push(gate.uid(), gate.qarg(0), *mat);
+        else
+            gate.foreach_qarg([this](auto& arg) { flush(arg); });
+    }
+
+    /* Declarations */
+    void visit(ast::GateDecl& decl) {
+        // Initialize a new local state
+        ast::QubitNumbering local_qubits;
+        std::vector<fusion_run> local_runs;
+        std::swap(qubits_, local_qubits);
+        std::swap(runs_, local_runs);
+        in_decl_ = true;
+
+        // Process gate body
+        decl.foreach_stmt([this](auto& stmt) { stmt.accept(*this); });
+        flush_all();
+
+        // Reset the state
+        in_decl_ = false;
+        std::swap(qubits_, local_qubits);
+        std::swap(runs_, local_runs);
+    }
+    void visit(ast::OracleDecl&) {}
+    void visit(ast::RegisterDecl&) {}
+    void visit(ast::AncillaDecl&) {}
+
+    /* Program */
+    void visit(ast::Program& prog) {
+        prog.foreach_stmt([this](auto& stmt) { stmt.accept(*this); });
+        flush_all();
+    }
+
+  private:
+    /**
+     * \brief A run of fusible gates on a single qubit
+     */
+    struct fusion_run {
+        std::vector<int> uids; ///< uids of the gates, in order
+        matrix product;        ///< product of the gates
+    };
+
+    config config_;
+    std::unordered_map<int, std::list<ast::ptr<ast::Gate>>> replacement_list_;
+
+    /* Algorithm state */
+    ast::QubitNumbering qubits_;  ///< dense qubit IDs
+    std::vector<fusion_run> runs_; ///< current run on each qubit, by ID
+    bool mergeable_ = true;        ///< whether gates can be fused here
+    bool in_decl_ = false;         ///< whether inside a gate declaration
+
+    void reset() {
+        replacement_list_.clear();
+        qubits_.clear();
+        runs_.clear();
+        mergeable_ = true;
+        in_decl_ = false;
+    }
+
+    /**
+     * \brief Extends the run on a qubit with a gate
+     */
+    void push(int uid, const ast::VarAccess& arg, const matrix& mat) {
+        if (!mergeable_ || (!in_decl_ && !arg.offset())) {
+            flush(arg);
+            return;
+        }
+
+        auto q = static_cast<std::size_t>(qubits_.index(arg));
+        if (q >= runs_.size())
+            runs_.resize(q + 1);
+
+        auto& run = runs_[q];
+        if (run.uids.empty())
+            run.product = mat;
+        else
+            run.product = multiply(mat, run.product);
+        run.uids.push_back(uid);
+    }
+
+    /**
+     * \brief Ends the run on a qubit, generating its replacement
+     *
+     * An access to a whole register ends every run
+     */
+    void flush(const ast::VarAccess& arg) {
+        if (!in_decl_ && !arg.offset()) {
+            flush_all();
+            return;
+        }
+
+        if (auto q = qubits_.find(arg)) {
+            if (static_cast<std::size_t>(*q) < runs_.size())
+                flush_run(*q);
+        }
+    }
+
+    void flush_all() {
+        for (std::size_t q = 0; q < runs_.size(); q++)
+            flush_run(static_cast<int>(q));
+    }
+
+    void flush_run(int q) {
+        auto& run = runs_[q];
+        if (run.uids.empty())
+            return;
+
+        auto [theta, phi, lambda] = angles(run.product);
+        bool identity = std::abs(std::sin(theta / 2)) < config_.tolerance &&
+                        std::abs(std::sin((phi + lambda) / 2)) <
+                            config_.tolerance;
+
+        if (identity || run.uids.size() > 1) {
+            for (auto uid : run.uids)
+                replacement_list_[uid] = std::list<ast::ptr<ast::Gate>>();
+
+            if (!identity) {
+                parser::Position pos;
+                replacement_list_[run.uids.back()].emplace_back(
+                    new ast::UGate(pos, to_expr(theta), to_expr(phi),
+                                   to_expr(lambda),
+                                   ast::VarAccess(qubits_.access(q))));
+            }
+        }
+
+        run.uids.clear();
+    }
+
+    /**
+     * \brief Expression for an angle, symbolic if it is a multiple of pi/8
+     */
+    ast::ptr<ast::Expr> to_expr(double angle) const {
+        for (int d : {1, 2, 4, 8}) {
+            auto n = std::round(angle * d / utils::pi);
+            if (std::abs(angle - n * utils::pi / d) < config_.tolerance)
+                return ast::angle_to_expr(
+                    utils::Angle(static_cast<int>(n), d));
+        }
+
+        return ast::angle_to_expr(utils::Angle(angle));
+    }
+
+    /* Matrix utilities */
+    static matrix u(double theta, double phi, double lambda) {
+        using namespace std::complex_literals;
+        auto c = std::cos(theta / 2);
+        auto s = std::sin(theta / 2);
+        return {c, -std::exp(1i * lambda) * s, std::exp(1i * phi) * s,
+                std::exp(1i * (phi + lambda)) * c};
+    }
+
+    static matrix multiply(const matrix& a, const matrix& b) {
+        return {a[0] * b[0] + a[1] * b[2], a[0] * b[1] + a[1] * b[3],
+                a[2] * b[0] + a[3] * b[2], a[2] * b[1] + a[3] * b[3]};
+    }
+
+    /**
+     * \brief Euler angles of a single-qubit unitary, up to global phase
+     *
+     * \return (theta, phi, lambda) such that U(theta, phi, lambda) is
+     * equal to the matrix up to a global phase
+     */
+    static std::array<double, 3> angles(const matrix& m) {
+        double theta = 2 * std::atan2(std::abs(m[2]), std::abs(m[0]));
+
+        // Fix the global phase by the top-left entry, then read phi and
+        // lambda off whichever entries are best conditioned
+        double phase = std::abs(m[0]) > 0 ? std::arg(m[0]) : std::arg(-m[1]);
+        double phi = std::abs(m[2]) > 0 ? std::arg(m[2]) - phase : 0;
+        double lambda = std::abs(m[1]) >= std::abs(m[0])
+                            ? std::arg(-m[1]) - phase
+                            : std::arg(m[3]) - phase - phi;
+
+        return {theta, normalize(phi), normalize(lambda)};
+    }
+
+    static double normalize(double angle) {
+        angle = std::remainder(angle, 2 * utils::pi);
+        return std::abs(angle) < 1e-15 ? 0 : angle;
+    }
+
+    /**
+     * \brief The matrix of a single-qubit standard gate, if it is one and has
+     * constant arguments
+     */
+    static std::optional<matrix> to_matrix(ast::DeclaredGate& gate) {
+        const auto pi = utils::pi;
+
+        std::vector<double> cargs;
+        for (int i = 0; i < gate.num_cargs(); i++) {
+            auto val = gate.carg(i).constant_eval();
+            if (!val)
+                return std::nullopt;
+            cargs.push_back(*val);
+        }
+
+        switch (gate.op()) {
+            case ast::GateOp::U3:
+                return u(cargs[0], cargs[1], cargs[2]);
+            case ast::GateOp::U2:
+                return u(pi / 2, cargs[0], cargs[1]);
+            case ast::GateOp::U1:
+            case ast::GateOp::RZ:
+                return u(0, 0, cargs[0]);
+            case ast::GateOp::Id:
+            case ast::GateOp::U0:
+                return u(0, 0, 0);
+            case ast::GateOp::X:
+                return u(pi, 0, pi);
+            case ast::GateOp::Y:
+                return u(pi, pi / 2, pi / 2);
+            case ast::GateOp::Z:
+                return u(0, 0, pi);
+            case ast::GateOp::H:
+                return u(pi / 2, 0, pi);
+            case ast::GateOp::S:
+                return u(0, 0, pi / 2);
+            case ast::GateOp::Sdg:
+                return u(0, 0, -pi / 2);
+            case ast::GateOp::T:
+                return u(0, 0, pi / 4);
+            case ast::GateOp::Tdg:
+                return u(0, 0, -pi / 4);
+            case ast::GateOp::RX:
+                return u(cargs[0], -pi / 2, pi / 2);
+            case ast::GateOp::RY:
+                return u(cargs[0], 0, 0);
+            default:
+                return std::nullopt;
+        }
+    }
+};
+
+/** \brief Fuses runs of single-qubit gates */
+inline void fuse_single_qubit_gates(ast::ASTNode& node) {
+    SingleQubitFuser optimizer;
+
+    auto res = optimizer.run(node);
+    replace_gates(node, std::move(res));
+}
+
+/** \brief Fuses runs of single-qubit gates with configuration */
+inline void fuse_single_qubit_gates(ast::ASTNode& node,
+                                    const SingleQubitFuser::config& params) {
+    SingleQubitFuser optimizer(params);
+
+    auto res = optimizer.run(node);
+    replace_gates(node, std::move(res));
+}
+
+} // namespace optimization
+} // namespace staq
@@ -0,0 +1,232 @@
+/*
+ * This file is part of staq.
+ *
+ * Copyright (c) 2019 - 2021 softwareQ Inc. All rights reserved.
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * \file synthesis/bit_vector.hpp
+ * \brief Packed bit vectors over GF(2)
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+namespace staq {
+namespace synthesis {
+
+/**
+ * \class staq::synthesis::bit_vector
+ * \brief Packed vector of bits, 64 to a machine word
+ *
+ * Used for the rows of linear operators over GF(2) and for parity vectors,
+ * so that adding one row to another is a word-wide XOR. Bits past the end
+ * of the vector are kept zero.
+ */
+class bit_vector {
+  public:
+    using word = std::uint64_t;
+    static constexpr std::size_t word_bits = 64;
+
+    /**
+     * \class staq::synthesis::bit_vector::reference
+     * \brief Proxy for a single bit, as with std::vector<bool>
+     */
+    class reference {
+      public:
+        reference(word& w, word mask) : w_(w), mask_(mask) {}
+
+        operator bool() const { return (w_ & mask_) != 0; }
+        reference& operator=(bool b) {
+            w_ = b ? (w_ | mask_) : (w_ & ~mask_);
+            return *this;
+        }
+        reference& operator=(const reference& r) { return *this = bool(r); }
+        reference& operator^=(bool b) {
+            if (b)
+                w_ ^= mask_;
+            return *this;
+        }
+
+      private:
+        word& w_;
+        word mask_;
+    };
+
+    /** @name Constructors */
+    /**@{*/
+    /** \brief Constructs an empty vector */
+    bit_vector() = default;
+    /** \brief Constructs a vector of n copies of a bit */
+    explicit bit_vector(std::size_t n, bool b = false)
+        : words_((n + word_bits - 1) / word_bits, b ? ~word(0) : 0),
+          size_(n) {
+        clear_tail();
+    }
+    /** \brief Constructs a vector from a list of bits */
+    bit_vector(std::initializer_list<bool> bits) : bit_vector(bits.size()) {
+        std::size_t i = 0;
+        for (auto b : bits)
+            set(i++, b);
+    }
+    /** \brief Constructs a vector from a std::vector<bool> */
+    bit_vector(const std::vector<bool>& bits) : bit_vector(bits.size()) {
+        for (std::size_t i = 0; i < bits.size(); i++)
+            set(i, bits[i]);
+    }
+    /**@}*/
+
+    /** @name Accessors */
+    /**@{*/
+    /** \brief Returns the number of bits */
+    std::size_t size() const { return size_; }
+    /** \brief Returns bit i */
+    bool test(std::size_t i) const {
+        return (words_[i / word_bits] & mask(i)) != 0;
+    }
+    /** \brief Returns bit i */
+    bool operator[](std::size_t i) const { return test(i); }
+    /** \brief Returns a reference to bit i */
+    reference operator[](std::size_t i) {
+        return reference(words_[i / word_bits], mask(i));
+    }
+    /** \brief Returns the number of set bits */
+    std::size_t count() const {
+        std::size_t ret = 0;
+        for (auto w : words_)
+            ret += std::bitset<word_bits>(w).count();
+        return ret;
+    }
+    /** \brief Returns the number of set bits that are also set in a mask of
+     * the same size */
+    std::size_t count(const bit_vector& mask) const {
+        std::size_t ret = 0;
+        for (std::size_t i = 0; i < words_.size(); i++)
+            ret += std::bitset<word_bits>(words_[i] & mask.words_[i]).count();
+        return ret;
+    }
+    /** \brief Checks whether any bit is set */
+    bool any() const {
+        for (auto w : words_) {
+            if (w != 0)
+                return true;
+        }
+        return false;
+    }
+    /** \brief Returns the packed words, least significant bit first */
+    const std::vector<word>& words() const { return words_; }
+    /**@}*/
+
+    /** @name Modifiers */
+    /**@{*/
+    /** \brief Sets bit i to b */
+    void set(std::size_t i, bool b = true) {
+        if (b)
+            words_[i / word_bits] |= mask(i);
+        else
+            words_[i / word_bits] &= ~mask(i);
+    }
+    /** \brief Clears bit i */
+    void reset(std::size_t i) { words_[i / word_bits] &= ~mask(i); }
+    /** \brief Flips bit i */
+    void flip(std::size_t i) { words_[i / word_bits] ^= mask(i); }
+    /** \brief Clears every bit */
+    void reset() { std::fill(words_.begin(), words_.end(), 0); }
+    /** \brief Appends a bit */
+    void push_back(bool b) {
+        if (size_ % word_bits == 0)
+            words_.push_back(0);
+        set(size_++, b);
+    }
+    /** \brief Swaps contents with another vector */
+    void swap(bit_vector& v) {
+        words_.swap(v.words_);
+        std::swap(size_, v.size_);
+    }
+    /**@}*/
+
+    /** @name Operators */
+    /**@{*/
+    /** \brief XOR-assigns another vector of the same size */
+    bit_vector& operator^=(const bit_vector& v) {
+        for (std::size_t i = 0; i < words_.size(); i++)
+            words_[i] ^= v.words_[i];
+        return *this;
+    }
+    /** \brief XOR of two vectors of the same size */
+    bit_vector operator^(const bit_vector& v) const {
+        auto ret(*this);
+        ret ^= v;
+        return ret;
+    }
+    /** \brief Equality of vectors */
+    bool operator==(const bit_vector& v) const {
+        return size_ == v.size_ && words_ == v.words_;
+    }
+    /** \brief Inequality of vectors */
+    bool operator!=(const bit_vector& v) const { return !(*this == v); }
+    /**@}*/
+
+    /** \brief Hash of the packed words */
+    std::size_t hash() const {
+        std::size_t ret = std::hash<std::size_t>{}(size_);
+        for (auto w : words_)
+            ret ^= std::hash<word>{}(w) + 0x9e3779b9 + (ret << 6) + (ret >> 2);
+        return ret;
+    }
+
+  private:
+    std::vector<word> words_; ///< packed bits
+    std::size_t size_ = 0;    ///< number of bits
+
+    static word mask(std::size_t i) { return word(1) << (i % word_bits); }
+
+    void clear_tail() {
+        if (size_ % word_bits != 0)
+            words_.back() &= mask(size_) - 1;
+    }
+};
+
+} // namespace synthesis
+} // namespace staq
+
+namespace std {
+/**
+ * \brief Hash function for bit vectors, so they can key unordered containers
+ */
+template <>
+struct hash<staq::synthesis::bit_vector> {
+    std::size_t operator()(const staq::synthesis::bit_vector& v) const {
+        return v.hash();
+    }
+};
+} // namespace std
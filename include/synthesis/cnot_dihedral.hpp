@@ -33,10 +33,14 @@
 
 #include "mapping/device.hpp"
 #include "synthesis/linear_reversible.hpp"
+#include "tools/parallel.hpp"
 #include "qasmtools/ast/expr.hpp"
 
 #include <cstddef>
 #include <list>
+#include <optional>
+#include <set>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -46,20 +50,79 @@ namespace synthesis {
 namespace ast = qasmtools::ast;
 
 using namespace mapping;
-using phase_term = std::pair<std::vector<bool>, ast::ptr<ast::Expr>>;
-using cx_dihedral =
-    std::variant<std::pair<int, int>, std::pair<ast::ptr<ast::Expr>, int>>;
+
+/** \brief A phase term, i.e. a parity and an angle of some type */
+template <typename Angle>
+using basic_phase_term = std::pair<bit_vector, Angle>;
+/** \brief A CNOT (ctrl, tgt) or a z-rotation (angle, qubit) */
+template <typename Angle>
+using basic_cx_dihedral =
+    std::variant<std::pair<int, int>, std::pair<Angle, int>>;
+
+using phase_term = basic_phase_term<ast::ptr<ast::Expr>>;
+using cx_dihedral = basic_cx_dihedral<ast::ptr<ast::Expr>>;
+/** \brief A phase term whose angle is its index in a list of angles */
+using indexed_phase_term = basic_phase_term<int>;
+
+/**
+ * \brief Phase terms stored column-major
+ *
+ * Column i packs bit i of the parity of every term, so that a CNOT acts on
+ * all terms at once with a single column XOR, and the ones in column i
+ * among a set of terms can be counted with popcounts.
+ */
+struct phase_columns {
+    std::vector<bit_vector> cols; ///< cols[i][t] = bit i of term t
+    std::size_t terms = 0;        ///< number of terms
+
+    /**
+     * \brief Takes the phase terms, moving their angles out by term
+     * \param f The phase terms, consumed
+     * \param n The number of qubits
+     * \param angles The angles of the terms
+     */
+    template <typename Angle>
+    phase_columns(std::list<basic_phase_term<Angle>>& f, std::size_t n,
+                  std::vector<Angle>& angles)
+        : cols(n, bit_vector(f.size())), terms(f.size()) {
+        angles.reserve(f.size());
+        for (auto& [vec, angle] : f) {
+            auto t = angles.size();
+            for (std::size_t i = 0; i < n; i++) {
+                if (vec[i])
+                    cols[i].set(t);
+            }
+            angles.emplace_back(std::move(angle));
+        }
+        f.clear();
+    }
+
+    /** \brief Number of terms */
+    std::size_t size() const { return terms; }
+    /** \brief Bit i of the parity of term t */
+    bool test(int t, int i) const { return cols[i][t]; }
+    /** \brief The parity of term t */
+    bit_vector parity(int t) const {
+        bit_vector ret(cols.size());
+        for (std::size_t i = 0; i < cols.size(); i++) {
+            if (cols[i][t])
+                ret.set(i);
+        }
+        return ret;
+    }
+};
 
 struct partition {
     std::optional<int> target;
     std::set<int> remaining_indices;
-    std::list<phase_term> terms;
+    std::vector<int> terms; ///< indices into the phase columns
 
-    partition(std::optional<int> t, std::set<int> r, std::list<phase_term>&& tm)
+    partition(std::optional<int> t, std::set<int> r, std::vector<int>&& tm)
         : target(t), remaining_indices(r), terms(std::move(tm)) {}
 };
 
-static void print_partition(const partition& part) {
+static void print_partition(const partition& part,
+                            const phase_columns& columns) {
     std::cout << "{";
     if (part.target)
         std::cout << *(part.target);
@@ -69,24 +132,20 @@ static void print_partition(const partition& part) {
     for (auto i : part.remaining_indices)
         std::cout << i << ",";
     std::cout << "], {";
-    for (auto& [vec, angle] : part.terms) {
-        std::cout << *angle << "*(";
-        for (std::size_t i = 0; i < vec.size(); i++)
-            std::cout << (vec[i] ? "1" : "0");
+    for (auto t : part.terms) {
+        std::cout << t << "*(";
+        for (std::size_t i = 0; i < columns.cols.size(); i++)
+            std::cout << (columns.test(t, static_cast<int>(i)) ? "1" : "0");
         std::cout << "), ";
     }
     std::cout << "}}\n";
 }
 
 /**
- * \brief Adjusts a list of partitions according to a CNOT between ctrl and tgt
+ * \brief Adjusts the phase terms according to a CNOT between ctrl and tgt
  */
-static void adjust_vectors(int ctrl, int tgt, std::list<partition>& stack) {
-    for (auto& part : stack) {
-        for (auto& [vec, angle] : part.terms) {
-            vec[ctrl] = vec[ctrl] ^ vec[tgt];
-        }
-    }
+static void adjust_vectors(int ctrl, int tgt, phase_columns& columns) {
+    columns.cols[ctrl] ^= columns.cols[tgt];
 }
 
 /**
@@ -94,35 +153,46 @@ static void adjust_vectors(int ctrl, int tgt, std::list<partition>& stack) {
  *        indices, necessary for steiner synthesis
  */
 static void adjust_vectors_and_indices(int ctrl, int tgt,
+                                       phase_columns& columns,
                                        std::list<partition>& stack) {
-    for (auto& part : stack) {
-        for (auto& [vec, angle] : part.terms) {
-            vec[ctrl] = vec[ctrl] ^ vec[tgt];
-        }
+    adjust_vectors(ctrl, tgt, columns);
 
-        // Index adjustment
+    // Index adjustment
+    for (auto& part : stack) {
         if (part.remaining_indices.find(tgt) != part.remaining_indices.end())
             part.remaining_indices.insert(ctrl);
     }
 }
 
 /**
- * \brief Finds the best index to split on given a list of phase terms
+ * \brief Finds the best index to split on given a set of phase terms
+ *
+ * Large sets are counted a word at a time against a mask of the set; small
+ * ones a term at a time
  */
-static int find_best_split(const std::list<phase_term>& terms,
-                           const std::set<int>& indices) {
+static int find_best_split(const std::vector<int>& terms,
+                           const std::set<int>& indices,
+                           const phase_columns& columns) {
+    auto words = (columns.size() + bit_vector::word_bits - 1) /
+                 bit_vector::word_bits;
+    std::optional<bit_vector> mask;
+    if (terms.size() > 4 * words) {
+        mask.emplace(columns.size());
+        for (auto t : terms)
+            mask->set(t);
+    }
+
     int max = -1;
     int max_i = -1;
     for (auto i : indices) {
-        auto num_zeros = 0;
-        auto num_ones = 0;
-
-        for (auto& [vec, angle] : terms) {
-            if (vec[i])
-                num_ones++;
-            else
-                num_zeros++;
+        int num_ones = 0;
+        if (mask) {
+            num_ones = static_cast<int>(columns.cols[i].count(*mask));
+        } else {
+            for (auto t : terms)
+                num_ones += columns.test(t, i);
         }
+        int num_zeros = static_cast<int>(terms.size()) - num_ones;
 
         if (max_i == -1 || num_zeros > max || num_ones > max) {
             max = num_zeros > num_ones ? num_zeros : num_ones;
@@ -134,19 +204,42 @@ static int find_best_split(const std::list<phase_term>& terms,
 }
 
 /**
- * \brief Splits a list of phase terms into those which are 0 and 1 in
+ * \brief Drops the indices at which every one of a set of phase terms is 0
+ *
+ * Such an index is a best split which leaves the terms as they are, so
+ * gray-synth would otherwise drop them one partition at a time. On a large
+ * device most qubits are idle in any one block, and this keeps the
+ * partitions to the active ones.
+ */
+static void drop_zero_indices(const std::vector<int>& terms,
+                              std::set<int>& indices,
+                              const phase_columns& columns) {
+    bit_vector mask(columns.size());
+    for (auto t : terms)
+        mask.set(t);
+
+    for (auto it = indices.begin(); it != indices.end();) {
+        if (columns.cols[*it].count(mask) == 0)
+            it = indices.erase(it);
+        else
+            it++;
+    }
+}
+
+/**
+ * \brief Splits a set of phase terms into those which are 0 and 1 in
  * entry i, respectively
  */
-static std::pair<std::list<phase_term>, std::list<phase_term>>
-split(std::list<phase_term>& terms, int i) {
-    std::list<phase_term> zeros;
-    std::list<phase_term> ones;
-
-    while (!terms.empty()) {
-        if (terms.front().first[i])
-            ones.splice(ones.end(), terms, terms.begin());
+static std::pair<std::vector<int>, std::vector<int>>
+split(const std::vector<int>& terms, int i, const phase_columns& columns) {
+    std::vector<int> zeros;
+    std::vector<int> ones;
+
+    for (auto t : terms) {
+        if (columns.test(t, i))
+            ones.push_back(t);
         else
-            zeros.splice(zeros.end(), terms, terms.begin());
+            zeros.push_back(t);
     }
 
     return std::make_pair(std::move(zeros), std::move(ones));
@@ -154,18 +247,32 @@ split(std::list<phase_term>& terms, int i) {
 
 /**
  * \brief The gray-synth algorith of arXiv:1712.01859
+ *
+ * \param f The phase terms
+ * \param A The overall linear transformation
+ * \param alg Algorithm used to synthesize the remaining linear transformation
+ * \param section_size Section size for Patel-Markov-Hayes synthesis, or 0
+ * for the default
  */
-static std::list<cx_dihedral> gray_synth(std::list<phase_term>& f,
-                                         linear_op<bool> A) {
+template <typename Angle>
+static std::list<basic_cx_dihedral<Angle>>
+gray_synth(std::list<basic_phase_term<Angle>>& f, linear_op<bool> A,
+           LinearSynth alg = LinearSynth::gauss_jordan, int section_size = 0) {
     // Initialize
-    std::list<cx_dihedral> ret;
+    std::list<basic_cx_dihedral<Angle>> ret;
     std::list<partition> stack;
 
+    std::vector<Angle> angles;
+    phase_columns columns(f, A.size(), angles);
+    std::vector<int> terms(columns.size());
+    for (std::size_t t = 0; t < terms.size(); t++)
+        terms[t] = static_cast<int>(t);
+
     std::set<int> indices;
     for (std::size_t i = 0; i < A.size(); i++)
         indices.insert(static_cast<int>(i));
 
-    stack.emplace_front(partition(std::nullopt, indices, std::move(f)));
+    stack.emplace_front(partition(std::nullopt, indices, std::move(terms)));
 
     while (!stack.empty()) {
         auto part = std::move(stack.front());
@@ -176,27 +283,33 @@ static std::list<cx_dihedral> gray_synth(std::list<phase_term>& f,
         else if (part.terms.size() == 1 && part.target) {
             // This case allows us to shortcut a lot of partitions
 
+            // The remaining terms are adjusted in place, so keep a copy of
+            // this one
             auto tgt = *(part.target);
-            auto& [vec, angle] = part.terms.front();
+            auto vec = columns.parity(part.terms.front());
+            auto& angle = angles[part.terms.front()];
 
             for (std::size_t ctrl = 0; ctrl < vec.size(); ctrl++) {
                 if (ctrl != tgt && vec[ctrl]) {
-                    ret.emplace_back(std::make_pair((int) ctrl, (int) tgt));
+                    ret.emplace_back(std::in_place_index<0>, (int) ctrl,
+                                     (int) tgt);
 
                     // Adjust remaining vectors & output function
                     adjust_vectors(static_cast<int>(ctrl),
-                                   static_cast<int>(tgt), stack);
+                                   static_cast<int>(tgt), columns);
                     for (std::size_t i = 0; i < A.size(); i++) {
-                        A[i][ctrl] = A[i][ctrl] ^ A[i][tgt];
+                        if (A[i][tgt])
+                            A[i].flip(ctrl);
                     }
                 }
             }
 
-            ret.emplace_back(std::make_pair(std::move(angle), tgt));
+            ret.emplace_back(std::in_place_index<1>, std::move(angle), tgt);
         } else if (!part.remaining_indices.empty()) {
             // Divide into the zeros and ones of some row
-            auto i = find_best_split(part.terms, part.remaining_indices);
-            auto [zeros, ones] = split(part.terms, i);
+            auto i =
+                find_best_split(part.terms, part.remaining_indices, columns);
+            auto [zeros, ones] = split(part.terms, i, columns);
 
             // Remove i from the remaining indices
             part.remaining_indices.erase(i);
@@ -218,27 +331,36 @@ static std::list<cx_dihedral> gray_synth(std::list<phase_term>& f,
     }
 
     // Synthesize the overall linear transformation
-    auto linear_trans = gauss_jordan(A);
+    auto linear_trans = synthesize_linear(std::move(A), alg, section_size);
     for (auto gate : linear_trans)
-        ret.emplace_back(gate);
+        ret.emplace_back(std::in_place_index<0>, gate);
 
     return ret;
 }
 
 /**
  * \brief Gray-synth with topological constraints
+ * \note Like steiner_gauss, reduces A in place to the identity
  */
-static std::list<cx_dihedral> gray_steiner(std::list<phase_term>& f,
-                                           linear_op<bool> A, Device& d) {
+template <typename Angle>
+static std::list<basic_cx_dihedral<Angle>>
+gray_steiner(std::list<basic_phase_term<Angle>>& f, linear_op<bool>& A,
+             Device& d) {
     // Initialize
-    std::list<cx_dihedral> ret;
+    std::list<basic_cx_dihedral<Angle>> ret;
     std::list<partition> stack;
 
+    std::vector<Angle> angles;
+    phase_columns columns(f, A.size(), angles);
+    std::vector<int> terms(columns.size());
+    for (std::size_t t = 0; t < terms.size(); t++)
+        terms[t] = static_cast<int>(t);
+
     std::set<int> indices;
     for (std::size_t i = 0; i < A.size(); i++)
         indices.insert(static_cast<int>(i));
 
-    stack.emplace_front(partition(std::nullopt, indices, std::move(f)));
+    stack.emplace_front(partition(std::nullopt, indices, std::move(terms)));
 
     while (!stack.empty()) {
         auto part = std::move(stack.front());
@@ -246,11 +368,17 @@ static std::list<cx_dihedral> gray_steiner(std::list<phase_term>& f,
 
         if (part.terms.empty())
             continue;
-        else if (part.terms.size() == 1 && part.target) {
+        if (part.terms.size() > 1 || !part.target)
+            drop_zero_indices(part.terms, part.remaining_indices, columns);
+
+        if (part.terms.size() == 1 && part.target) {
             // This case allows us to shortcut a lot of partitions
 
+            // The remaining terms are adjusted in place, so keep a copy of
+            // this one
             auto tgt = *(part.target);
-            auto& [vec, angle] = part.terms.front();
+            auto vec = columns.parity(part.terms.front());
+            auto& angle = angles[part.terms.front()];
 
             std::list<int> terminals;
             for (std::size_t ctrl = 0; ctrl < vec.size(); ctrl++) {
@@ -263,30 +391,33 @@ static std::list<cx_dihedral> gray_steiner(std::list<phase_term>& f,
             // Fill each steiner point with a one
             for (auto it = s_tree.begin(); it != s_tree.end(); it++) {
                 if (vec[it->second] == 0) {
-                    ret.emplace_back(
-                        std::make_pair((int) (it->second), (int) (it->first)));
-                    adjust_vectors(it->second, it->first, stack);
+                    ret.emplace_back(std::in_place_index<0>,
+                                     (int) (it->second), (int) (it->first));
+                    adjust_vectors(it->second, it->first, columns);
                     for (std::size_t i = 0; i < A.size(); i++) {
-                        A[i][it->second] = A[i][it->second] ^ A[i][it->first];
+                        if (A[i][it->first])
+                            A[i].flip(it->second);
                     }
                 }
             }
 
             // Zero out each row except for the root
             for (auto it = s_tree.rbegin(); it != s_tree.rend(); it++) {
-                ret.emplace_back(
-                    std::make_pair((int) (it->second), (int) (it->first)));
-                adjust_vectors(it->second, it->first, stack);
+                ret.emplace_back(std::in_place_index<0>, (int) (it->second),
+                                 (int) (it->first));
+                adjust_vectors(it->second, it->first, columns);
                 for (std::size_t i = 0; i < A.size(); i++) {
-                    A[i][it->second] = A[i][it->second] ^ A[i][it->first];
+                    if (A[i][it->first])
+                        A[i].flip(it->second);
                 }
             }
 
-            ret.emplace_back(std::make_pair(std::move(angle), tgt));
+            ret.emplace_back(std::in_place_index<1>, std::move(angle), tgt);
         } else if (!part.remaining_indices.empty()) {
             // Divide into the zeros and ones of some row
-            auto i = find_best_split(part.terms, part.remaining_indices);
-            auto [zeros, ones] = split(part.terms, i);
+            auto i =
+                find_best_split(part.terms, part.remaining_indices, columns);
+            auto [zeros, ones] = split(part.terms, i, columns);
 
             // Remove i from the remaining indices
             part.remaining_indices.erase(i);
@@ -313,7 +444,73 @@ static std::list<cx_dihedral> gray_steiner(std::list<phase_term>& f,
     // Synthesize the overall linear transformation
     auto linear_trans = steiner_gauss(A, d);
     for (auto gate : linear_trans)
-        ret.emplace_back(gate);
+        ret.emplace_back(std::in_place_index<0>, gate);
+
+    return ret;
+}
+
+/**
+ * \brief A cnot-dihedral operator captured for later synthesis
+ */
+struct dihedral_block {
+    std::list<phase_term> phases; ///< phase terms, in order of first use
+    linear_op<bool> permutation;  ///< overall linear transformation
+};
+
+/**
+ * \brief Synthesizes independent cnot-dihedral blocks on worker threads
+ *
+ * Each worker takes blocks in turn and applies its own copy of synth,
+ * called as synth(phases, permutation) like gray_synth, so results do not
+ * depend on the scheduling. Syntax tree nodes may only be created and
+ * freed on the thread owning their arena, so the workers synthesize over
+ * indexed phase terms and the angles are moved back in by the caller.
+ *
+ * \param blocks The blocks, whose phase terms are consumed
+ * \param synth The synthesis algorithm
+ * \param threads Number of threads, 0 for the hardware concurrency
+ * \return The synthesized circuits, in block order
+ */
+template <typename Synth>
+std::vector<std::list<cx_dihedral>>
+synthesize_blocks(std::vector<dihedral_block>& blocks, const Synth& synth,
+                  unsigned threads = 0) {
+    // Set the angles aside, replacing them by their index in the block
+    std::vector<std::vector<ast::ptr<ast::Expr>>> angles(blocks.size());
+    std::vector<std::list<indexed_phase_term>> terms(blocks.size());
+    for (std::size_t b = 0; b < blocks.size(); b++) {
+        for (auto& [vec, angle] : blocks[b].phases) {
+            terms[b].emplace_back(std::move(vec), angles[b].size());
+            angles[b].emplace_back(std::move(angle));
+        }
+        blocks[b].phases.clear();
+    }
+
+    std::vector<std::list<basic_cx_dihedral<int>>> circuits(blocks.size());
+    threads = tools::num_threads(threads, blocks.size());
+    std::vector<Synth> local(threads, synth);
+    tools::parallel_for(
+        blocks.size(), threads,
+        [&blocks, &terms, &local, &circuits](unsigned worker, std::size_t b) {
+            circuits[b] =
+                local[worker](terms[b], std::move(blocks[b].permutation));
+        });
+
+    // Move the angles back in
+    std::vector<std::list<cx_dihedral>> ret(blocks.size());
+    for (std::size_t b = 0; b < blocks.size(); b++) {
+        for (auto& gate : circuits[b]) {
+            // Both alternatives are pairs of ints here, so go by index
+            if (gate.index() == 0) {
+                ret[b].emplace_back(std::in_place_index<0>,
+                                    std::get<0>(gate));
+            } else {
+                auto [t, i] = std::get<1>(gate);
+                ret[b].emplace_back(std::in_place_index<1>,
+                                    std::move(angles[b][t]), i);
+            }
+        }
+    }
 
     return ret;
 }
@@ -32,26 +32,28 @@
 #pragma once
 
 #include "mapping/device.hpp"
+#include "synthesis/bit_vector.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
+#include <iostream>
 #include <list>
+#include <type_traits>
 #include <vector>
 
 namespace staq {
 namespace synthesis {
 
+/**
+ * \brief Linear operators given by their rows
+ *
+ * Boolean operators store each row as a packed bit_vector, so that row
+ * operations are word-wide
+ */
 template <typename T>
-using linear_op = std::vector<std::vector<T>>;
-
-// TODO: replace vector<bool> with a custom packed bitvector that supports
-// faster bitwise operations
-inline std::vector<bool>& operator^=(std::vector<bool>& A,
-                                     const std::vector<bool>& B) {
-    for (std::size_t i = 0; i < A.size(); i++) {
-        A[i] = B[i] ^ A[i];
-    }
-    return A;
-}
+using linear_op = std::vector<
+    std::conditional_t<std::is_same_v<T, bool>, bit_vector, std::vector<T>>>;
 
 static void print_linop(const linear_op<bool>& mat) {
     for (std::size_t i = 0; i < mat.size(); i++) {
@@ -158,6 +160,179 @@ static std::list<std::pair<int, int>> gaussian_elim(linear_op<bool> mat) {
     return ret;
 }
 
+/**
+ * \brief The identity operator on n bits
+ */
+static linear_op<bool> identity(std::size_t n) {
+    linear_op<bool> ret(n, bit_vector(n));
+    for (std::size_t i = 0; i < n; i++)
+        ret[i].set(i);
+    return ret;
+}
+
+/**
+ * \brief Transpose of a linear operator
+ */
+static linear_op<bool> transpose(const linear_op<bool>& mat) {
+    linear_op<bool> ret(mat.empty() ? 0 : mat[0].size(),
+                        bit_vector(mat.size()));
+    for (std::size_t i = 0; i < mat.size(); i++) {
+        for (std::size_t j = 0; j < mat[i].size(); j++) {
+            if (mat[i][j])
+                ret[j].set(i);
+        }
+    }
+    return ret;
+}
+
+/**
+ * \brief Default section size for Patel-Markov-Hayes synthesis
+ */
+static int pmh_section_size(std::size_t n) {
+    return std::max(1, static_cast<int>(std::round(std::log2(n) / 2)));
+}
+
+/**
+ * \brief Lower triangular pass of Patel-Markov-Hayes synthesis
+ *
+ * Reduces mat to upper triangular form with row additions, appending each
+ * addition to ret as (ctrl, tgt). Columns are processed in sections of
+ * section_size; within a section, rows sharing the same sub-row pattern are
+ * first cancelled against one another, so that each distinct pattern is
+ * eliminated only once.
+ *
+ * \return False if mat is not invertible
+ */
+static bool pmh_lower(linear_op<bool>& mat, int section_size,
+                      std::list<std::pair<int, int>>& ret) {
+    auto n = static_cast<int>(mat.size());
+
+    for (int sec = 0; sec < n; sec += section_size) {
+        int end = std::min(n, sec + section_size);
+
+        // Cancel duplicate sub-row patterns
+        std::vector<int> patterns(std::size_t(1) << (end - sec), -1);
+        for (int row = sec; row < n; row++) {
+            std::size_t pattern = 0;
+            for (int col = sec; col < end; col++) {
+                if (mat[row][col])
+                    pattern |= std::size_t(1) << (col - sec);
+            }
+
+            if (pattern == 0)
+                continue;
+            else if (patterns[pattern] == -1)
+                patterns[pattern] = row;
+            else {
+                mat[row] ^= mat[patterns[pattern]];
+                ret.emplace_back(patterns[pattern], row);
+            }
+        }
+
+        // Gaussian elimination below the diagonal of the section
+        for (int col = sec; col < end; col++) {
+            bool diag_one = mat[col][col];
+            for (int row = col + 1; row < n; row++) {
+                if (mat[row][col]) {
+                    if (!diag_one) {
+                        mat[col] ^= mat[row];
+                        ret.emplace_back(row, col);
+                        diag_one = true;
+                    }
+                    mat[row] ^= mat[col];
+                    ret.emplace_back(col, row);
+                }
+            }
+
+            if (!diag_one)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * \brief Linear reversible synthesis from Patel-Markov-Hayes block
+ * elimination
+ *
+ * Asymptotically optimal synthesis of arXiv:quant-ph/0302002, using
+ * O(n^2/log n) CNOTs. The matrix is reduced to upper triangular form,
+ * transposed, and reduced again; the CNOTs of the second pass are applied
+ * with control and target exchanged.
+ *
+ * \param mat The linear operator
+ * \param section_size Number of columns per section, or 0 for a default of
+ * about log(n)/2
+ */
+static std::list<std::pair<int, int>> patel_markov_hayes(linear_op<bool> mat,
+                                                         int section_size = 0) {
+    std::list<std::pair<int, int>> lower;
+    std::list<std::pair<int, int>> upper;
+
+    if (mat.size() == 0)
+        return lower;
+
+    if (section_size <= 0)
+        section_size = pmh_section_size(mat.size());
+    section_size = std::min(section_size, 16);
+
+    if (!pmh_lower(mat, section_size, lower)) {
+        std::cerr << "Error: linear operator is not invertible\n";
+        return lower;
+    }
+
+    mat = transpose(mat);
+    pmh_lower(mat, section_size, upper);
+
+    for (auto& [ctrl, tgt] : upper)
+        std::swap(ctrl, tgt);
+
+    lower.reverse();
+    upper.splice(upper.end(), lower);
+    return upper;
+}
+
+/**
+ * \brief Linear reversible synthesis algorithms
+ */
+enum class LinearSynth {
+    gauss_jordan,
+    gaussian_elim,
+    pmh,
+    automatic,
+};
+
+/**
+ * \brief Operators at least this wide use Patel-Markov-Hayes synthesis when
+ * the algorithm is chosen automatically
+ */
+static constexpr std::size_t pmh_threshold = 64;
+
+/**
+ * \brief Linear reversible synthesis with a given algorithm
+ *
+ * \param mat The linear operator
+ * \param alg The synthesis algorithm
+ * \param section_size Section size for Patel-Markov-Hayes synthesis, or 0
+ * for the default
+ */
+static std::list<std::pair<int, int>>
+synthesize_linear(linear_op<bool> mat, LinearSynth alg, int section_size = 0) {
+    if (alg == LinearSynth::automatic)
+        alg = mat.size() >= pmh_threshold ? LinearSynth::pmh
+                                          : LinearSynth::gauss_jordan;
+
+    switch (alg) {
+        case LinearSynth::gaussian_elim:
+            return gaussian_elim(std::move(mat));
+        case LinearSynth::pmh:
+            return patel_markov_hayes(std::move(mat), section_size);
+        default:
+            return gauss_jordan(std::move(mat));
+    }
+}
+
 /**
  * \brief Steiner tree based device constrained CNOT synthesis
  *
@@ -188,8 +363,11 @@ static std::list<std::pair<int, int>> gaussian_elim(linear_op<bool> mat) {
    00101            00101             10001             00011
    00010            00010             00010             00010
    \endverbatim
+ *
+ * \note Reduces mat in place, leaving the identity if it is invertible, so
+ * callers synthesizing many operators can reuse a single matrix
  */
-static std::list<std::pair<int, int>> steiner_gauss(linear_op<bool> mat,
+static std::list<std::pair<int, int>> steiner_gauss(linear_op<bool>& mat,
                                                     mapping::Device& d) {
     std::list<std::pair<int, int>> ret;
 
@@ -198,6 +376,13 @@ static std::list<std::pair<int, int>> steiner_gauss(linear_op<bool> mat,
 
     for (std::size_t i = 0; i < mat[0].size(); i++) {
 
+        // Columns which are already reduced need no gates
+        bool reduced = mat[i][i];
+        for (std::size_t j = 0; reduced && j < mat.size(); j++)
+            reduced = j == i || !mat[j][i];
+        if (reduced)
+            continue;
+
         std::fill(above_diagonal_dep.begin(), above_diagonal_dep.end(), false);
 
         // Phase 0: Find a pivot
@@ -205,10 +390,10 @@ static std::list<std::pair<int, int>> steiner_gauss(linear_op<bool> mat,
         int dist;
         for (std::size_t j = i; j < mat.size(); j++) {
             if (mat[j][i] == true) {
-                if (pivot == -1 || d.distance(static_cast<int>(j),
-                                              static_cast<int>(i)) < dist) {
+                auto tmp = d.distance(static_cast<int>(j), static_cast<int>(i));
+                if (pivot == -1 || tmp < dist) {
                     pivot = static_cast<int>(j);
-                    dist = d.distance(static_cast<int>(j), static_cast<int>(i));
+                    dist = tmp;
                 }
             }
         }
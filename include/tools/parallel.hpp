@@ -0,0 +1,99 @@
+/*
+ * This file is part of staq.
+ *
+ * Copyright (c) 2019 - 2021 softwareQ Inc. All rights reserved.
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * \file tools/parallel.hpp
+ * \brief Simple data parallelism
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace staq {
+namespace tools {
+
+/**
+ * \brief Resolves a requested number of threads
+ *
+ * \param threads Number of threads, 0 for the hardware concurrency
+ * \param n Number of work items, bounding the number of useful threads
+ */
+inline unsigned num_threads(unsigned threads, std::size_t n) {
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    return static_cast<unsigned>(
+        std::min<std::size_t>(threads, std::max<std::size_t>(n, 1)));
+}
+
+/**
+ * \brief Calls f(worker, i) for every i in [0, n) on a pool of threads
+ *
+ * Indices are handed out in increasing order from a shared counter. The
+ * worker argument is the index of the calling thread, in [0, threads), so
+ * that callers can keep per-thread state; worker 0 is the calling thread.
+ * Once every thread has finished, the exception thrown for the smallest
+ * index, if any, is rethrown.
+ *
+ * \param n Number of work items
+ * \param threads Number of threads, as resolved by num_threads
+ * \param f The work
+ */
+template <typename F>
+void parallel_for(std::size_t n, unsigned threads, F&& f) {
+    std::vector<std::exception_ptr> errors(n);
+    std::atomic<std::size_t> next(0);
+
+    auto work = [n, &f, &errors, &next](unsigned worker) {
+        for (auto i = next++; i < n; i = next++) {
+            try {
+                f(worker, i);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned worker = 1; worker < threads; worker++)
+        pool.emplace_back(work, worker);
+    work(0);
+    for (auto& thread : pool)
+        thread.join();
+
+    for (auto& error : errors) {
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+
+} // namespace tools
+} // namespace staq
@@ -69,15 +69,8 @@ class ResourceEstimator final : public ast::Visitor {
         // Unboxing the running estimate
         auto& [counts, depths] = running_estimate_;
 
-        // Get maximum critical path length
-        int depth = 0;
-        for (auto& [id, length] : depths) {
-            if (length > depth)
-                depth = length;
-        }
-
-        // Set depth and return
-        counts["depth"] = depth;
+        // Set depth to the maximum critical path length and return
+        counts["depth"] = depths.max();
         return counts;
     }
 
@@ -100,7 +93,8 @@ class ResourceEstimator final : public ast::Visitor {
         counts["measurement"] += 1;
 
         // Depth
-        int in_depth = std::max(depths[stmt.c_arg()], depths[stmt.q_arg()]);
+        int c_depth = depths[stmt.c_arg()];
+        int in_depth = std::max(c_depth, depths[stmt.q_arg()]);
         depths[stmt.c_arg()] = in_depth + 1;
         depths[stmt.q_arg()] = in_depth + 1;
     }
@@ -142,7 +136,8 @@ class ResourceEstimator final : public ast::Visitor {
         counts["CX"] += 1;
 
         // Depth
-        int in_depth = std::max(depths[gate.ctrl()], depths[gate.tgt()]);
+        int ctrl_depth = depths[gate.ctrl()];
+        int in_depth = std::max(ctrl_depth, depths[gate.tgt()]);
         depths[gate.ctrl()] = in_depth + 1;
         depths[gate.tgt()] = in_depth + 1;
     }
@@ -165,7 +160,7 @@ class ResourceEstimator final : public ast::Visitor {
         auto& [counts, depths] = running_estimate_;
 
         // Gate prefix, appropriately stripped of daggers
-        auto tmp = gate.name();
+        std::string tmp = gate.name();
         if (config_.merge_dagger)
             strip_dagger(tmp);
 
@@ -237,16 +232,9 @@ class ResourceEstimator final : public ast::Visitor {
 
         decl.foreach_stmt([this](auto& gate) { gate.accept(*this); });
 
-        // Get maximum critical path length
+        // Set depth to the maximum critical path length
         auto& [counts, depths] = running_estimate_;
-        int depth = 0;
-        for (auto& [id, length] : depths) {
-            if (length > depth)
-                depth = length;
-        }
-
-        // Set depth and return
-        counts["depth"] = depth;
+        counts["depth"] = depths.max();
 
         std::swap(running_estimate_, local_state);
     }
@@ -273,7 +261,34 @@ class ResourceEstimator final : public ast::Visitor {
     }
 
   private:
-    using depth_count = std::unordered_map<ast::VarAccess, int>;
+    /**
+     * \brief Critical path lengths, stored densely by (qu)bit
+     */
+    class depth_count {
+        ast::QubitNumbering ids_;
+        std::vector<int> depths_;
+
+      public:
+        int& operator[](const ast::VarAccess& va) {
+            auto id = static_cast<std::size_t>(ids_.index(va));
+            if (id >= depths_.size())
+                depths_.resize(id + 1, 0);
+            return depths_[id];
+        }
+
+        int max() const {
+            int ret = 0;
+            for (auto length : depths_)
+                ret = std::max(ret, length);
+            return ret;
+        }
+
+        void clear() {
+            ids_.clear();
+            depths_.clear();
+        }
+    };
+
     using resource_state = std::pair<resource_count, depth_count>;
 
     config config_;
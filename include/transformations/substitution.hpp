@@ -185,5 +185,53 @@ subst_ap_ap(std::unordered_map<ast::VarAccess, ast::VarAccess>& subst,
     node.accept(alg);
 }
 
+/**
+ * \class staq::transformations::SubstGate
+ * \brief Gate substitution
+ *
+ * Replaces particular gate nodes, identified by address, with lists of
+ * gates. Each replacement is moved out of the substitution when used.
+ */
+class SubstGate final : public ast::Replacer {
+  public:
+    using substitution =
+        std::unordered_map<const ast::Gate*, std::list<ast::ptr<ast::Gate>>>;
+
+    SubstGate(substitution& subst) : subst_(subst) {}
+    ~SubstGate() = default;
+
+    std::optional<std::list<ast::ptr<ast::Gate>>>
+    replace(ast::UGate& gate) override {
+        return lookup(gate);
+    }
+    std::optional<std::list<ast::ptr<ast::Gate>>>
+    replace(ast::CNOTGate& gate) override {
+        return lookup(gate);
+    }
+    std::optional<std::list<ast::ptr<ast::Gate>>>
+    replace(ast::BarrierGate& gate) override {
+        return lookup(gate);
+    }
+    std::optional<std::list<ast::ptr<ast::Gate>>>
+    replace(ast::DeclaredGate& gate) override {
+        return lookup(gate);
+    }
+
+  private:
+    substitution& subst_; // The substitution
+
+    std::optional<std::list<ast::ptr<ast::Gate>>> lookup(ast::Gate& gate) {
+        if (auto it = subst_.find(&gate); it != subst_.end())
+            return std::move(it->second);
+
+        return std::nullopt;
+    }
+};
+
+inline void subst_gates(SubstGate::substitution& subst, ast::ASTNode& node) {
+    SubstGate alg(subst);
+    node.accept(alg);
+}
+
 } // namespace transformations
 } // namespace staq
@@ -44,6 +44,7 @@
 #include "mapping/layout/eager.hpp"
 #include "mapping/layout/bestfit.hpp"
 #include "mapping/mapping/swap.hpp"
+#include "mapping/mapping/sabre.hpp"
 #include "mapping/mapping/steiner.hpp"
 
 #include "tools/resource_estimator.hpp"
@@ -112,6 +113,8 @@ class Program {
         // Mapping
         if (mapper == "swap") {
             mapping::map_onto_device(dev, *prog_);
+        } else if (mapper == "sabre") {
+            mapping::sabre_mapping(dev, *prog_);
         } else if (mapper == "steiner") {
             mapping::steiner_mapping(dev, *prog_);
         } else {
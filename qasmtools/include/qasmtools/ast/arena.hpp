@@ -0,0 +1,318 @@
+/*
+ * This file is part of qasmtools.
+ *
+ * Copyright (c) 2019 - 2021 softwareQ Inc. All rights reserved.
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * \file qasmtools/ast/arena.hpp
+ * \brief Arena allocation of syntax trees
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <vector>
+
+namespace qasmtools {
+namespace ast {
+
+/**
+ * \class qasmtools::ast::ArenaStats
+ * \brief Memory statistics of an arena
+ */
+struct ArenaStats {
+    std::size_t bytes_in_use = 0;   ///< bytes held by live nodes
+    std::size_t peak_bytes = 0;     ///< maximum of bytes_in_use
+    std::size_t bytes_reserved = 0; ///< total size of the arena's chunks
+    std::size_t live_nodes = 0;     ///< number of live nodes
+    std::size_t total_nodes = 0;    ///< number of nodes ever allocated
+};
+
+/**
+ * \class qasmtools::ast::Arena
+ * \brief Monotonic allocator for AST nodes
+ *
+ * While an arena is installed on the current thread with
+ * qasmtools::ast::ArenaScope, every AST node created on that thread -- by the
+ * parser, by passes or by cloning -- is allocated from the arena's chunks,
+ * behind a small header naming the arena. Freeing a node only updates the
+ * statistics; the chunks are released all at once when the last handle to
+ * the arena and the last node allocated from it are gone.
+ *
+ * Nodes created on threads without an arena are allocated on the heap as
+ * usual, with no header. The address ranges of all chunks are registered so
+ * that freeing a node can tell the two apart.
+ *
+ * An arena is not thread safe: it should only be installed on one thread at a
+ * time, and the nodes allocated from it should only be freed on that thread.
+ * Only the reference count and the chunk registry are synchronized.
+ */
+class Arena {
+    /**
+     * \brief Bookkeeping stored in front of each node
+     */
+    struct header {
+        Arena* arena;     ///< the owning arena
+        std::size_t size; ///< size of the node
+    };
+
+    static constexpr std::size_t align_ = alignof(std::max_align_t);
+    static constexpr std::size_t header_size_ =
+        (sizeof(header) + align_ - 1) / align_ * align_;
+    static constexpr std::size_t chunk_size_ = 1 << 16;
+
+    std::atomic<std::size_t> refs_{0}; ///< handles and live nodes
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    char* next_ = nullptr;     ///< next free byte in the current chunk
+    std::size_t remaining_ = 0; ///< free bytes in the current chunk
+    ArenaStats stats_;
+    std::function<void(const ArenaStats&)> hook_;
+
+    Arena() = default;
+    ~Arena() {
+        if (hook_)
+            hook_(stats_);
+
+        auto& registry = registry_();
+        std::unique_lock<std::shared_mutex> lock(registry.mutex);
+        for (auto& chunk : chunks_)
+            registry.ranges.erase(chunk.get());
+        registry.size.fetch_sub(chunks_.size(), std::memory_order_release);
+    }
+
+    static Arena*& current_() {
+        thread_local Arena* arena = nullptr;
+        return arena;
+    }
+
+    /**
+     * \brief Address ranges of the chunks of all arenas
+     */
+    struct chunk_registry {
+        std::shared_mutex mutex;
+        std::map<const char*, const char*> ranges; ///< chunk start to end
+        std::atomic<std::size_t> size{0};          ///< number of chunks
+    };
+
+    static chunk_registry& registry_() {
+        static chunk_registry registry;
+        return registry;
+    }
+
+    /**
+     * \brief Whether an address lies in the chunk of some arena
+     */
+    static bool in_arena(const void* p) {
+        auto& registry = registry_();
+        if (registry.size.load(std::memory_order_acquire) == 0)
+            return false;
+
+        auto addr = static_cast<const char*>(p);
+        std::shared_lock<std::shared_mutex> lock(registry.mutex);
+        auto it = registry.ranges.upper_bound(addr);
+        if (it == registry.ranges.begin())
+            return false;
+        --it;
+        return std::less<const char*>()(addr, it->second);
+    }
+
+    void retain() { refs_.fetch_add(1, std::memory_order_relaxed); }
+    void release(std::size_t n = 1) {
+        if (refs_.fetch_sub(n, std::memory_order_acq_rel) == n)
+            delete this;
+    }
+
+    void* allocate(std::size_t size) {
+        size = (size + align_ - 1) / align_ * align_;
+        if (size > remaining_) {
+            std::size_t len = std::max(size, chunk_size_);
+            chunks_.emplace_back(new char[len]);
+            next_ = chunks_.back().get();
+            remaining_ = len;
+            stats_.bytes_reserved += len;
+
+            auto& registry = registry_();
+            std::unique_lock<std::shared_mutex> lock(registry.mutex);
+            registry.ranges.emplace(next_, next_ + len);
+            registry.size.fetch_add(1, std::memory_order_release);
+        }
+
+        void* ret = next_;
+        next_ += size;
+        remaining_ -= size;
+        return ret;
+    }
+
+  public:
+    /**
+     * \class qasmtools::ast::Arena::handle
+     * \brief Shared reference to an arena
+     */
+    class handle {
+        Arena* arena_ = nullptr;
+
+      public:
+        handle() = default;
+        explicit handle(Arena* arena) : arena_(arena) {
+            if (arena_)
+                arena_->retain();
+        }
+        handle(const handle& h) : handle(h.arena_) {}
+        handle(handle&& h) : arena_(h.arena_) { h.arena_ = nullptr; }
+        ~handle() {
+            if (arena_)
+                arena_->release();
+        }
+        handle& operator=(handle h) {
+            std::swap(arena_, h.arena_);
+            return *this;
+        }
+
+        Arena* get() const { return arena_; }
+        Arena* operator->() const { return arena_; }
+        explicit operator bool() const { return arena_ != nullptr; }
+    };
+
+    /**
+     * \brief Creates a new arena
+     *
+     * \return Handle to the arena
+     */
+    static handle create() { return handle(new Arena()); }
+
+    /**
+     * \brief Get the arena installed on the current thread
+     *
+     * \return Pointer to the arena, or nullptr
+     */
+    static Arena* current() { return current_(); }
+
+    /**
+     * \brief Get the arena's statistics
+     *
+     * \return The current statistics
+     */
+    const ArenaStats& stats() const { return stats_; }
+
+    /**
+     * \brief Set a hook receiving the final statistics
+     *
+     * The hook is invoked when the arena's memory is released, or when a
+     * tree is discarded.
+     *
+     * \param hook Void function accepting the arena statistics
+     */
+    void set_stats_hook(std::function<void(const ArenaStats&)> hook) {
+        hook_ = std::move(hook);
+    }
+
+    /**
+     * \brief Abandons a tree without running destructors
+     *
+     * The nodes of the tree are never freed, so they keep the arena and its
+     * chunks alive until the process exits; nodes outside the tree may still
+     * be freed safely. The statistics hook, if any, is invoked now with the
+     * current statistics rather than when the memory is released. Heap memory
+     * owned by the nodes is not reclaimed either, so this is meant for
+     * tearing down the final program just before exit.
+     *
+     * \param root The root of the tree
+     */
+    template <typename T>
+    void discard(std::unique_ptr<T> root) {
+        root.release();
+        if (hook_) {
+            hook_(stats_);
+            hook_ = nullptr;
+        }
+    }
+
+    /** @name Node allocation */
+    /**@{*/
+    static void* allocate_node(std::size_t size) {
+        Arena* arena = current_();
+        if (!arena)
+            return ::operator new(size);
+
+        void* mem = arena->allocate(header_size_ + size);
+        new (mem) header{arena, size};
+        arena->retain();
+        arena->stats_.bytes_in_use += size;
+        arena->stats_.peak_bytes =
+            std::max(arena->stats_.peak_bytes, arena->stats_.bytes_in_use);
+        arena->stats_.live_nodes++;
+        arena->stats_.total_nodes++;
+
+        return static_cast<char*>(mem) + header_size_;
+    }
+
+    static void deallocate_node(void* p) {
+        if (p == nullptr)
+            return;
+        if (!in_arena(p)) {
+            ::operator delete(p);
+            return;
+        }
+
+        auto* h = reinterpret_cast<header*>(static_cast<char*>(p) -
+                                            header_size_);
+        Arena* arena = h->arena;
+        arena->stats_.bytes_in_use -= h->size;
+        arena->stats_.live_nodes--;
+        arena->release();
+    }
+    /**@}*/
+
+    friend class ArenaScope;
+};
+
+/**
+ * \class qasmtools::ast::ArenaScope
+ * \brief Installs an arena on the current thread for the scope's lifetime
+ */
+class ArenaScope {
+    Arena::handle arena_;
+    Arena* previous_;
+
+  public:
+    explicit ArenaScope(Arena::handle arena)
+        : arena_(std::move(arena)), previous_(Arena::current_()) {
+        Arena::current_() = arena_.get();
+    }
+    ~ArenaScope() { Arena::current_() = previous_; }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+};
+
+} // namespace ast
+} // namespace qasmtools
@@ -33,6 +33,7 @@
 #include "base.hpp"
 #include "decl.hpp"
 #include "expr.hpp"
+#include "numbering.hpp"
 #include "program.hpp"
 #include "semantic.hpp"
 #include "stmt.hpp"
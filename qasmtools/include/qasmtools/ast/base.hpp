@@ -32,11 +32,16 @@
 #pragma once
 
 #include "../parser/position.hpp"
+#include "arena.hpp"
 #include "cloneable.hpp"
 #include "visitor.hpp"
 
 #include <memory>
+#include <mutex>
 #include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 
 namespace qasmtools {
 namespace ast {
@@ -44,7 +49,121 @@ namespace ast {
 template <typename T>
 using ptr = std::unique_ptr<T>;
 
-using symbol = std::string;
+/**
+ * \class qasmtools::ast::symbol
+ * \brief Interned identifier
+ *
+ * A symbol is a handle to an entry in a global intern table, so copying and
+ * equality are pointer operations and the string's hash is computed only once.
+ * Hashing and ordering agree with those of the underlying strings, so
+ * containers of symbols (and of variable accesses) iterate in the same order
+ * as they would with plain strings.
+ */
+class symbol {
+    using entry = std::pair<const std::string, std::size_t>;
+
+    const entry* entry_; ///< the interned string and its hash
+
+    static const entry* intern(const std::string& str) {
+        static std::mutex mtx;
+        static std::unordered_map<std::string, std::size_t> table;
+
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = table.find(str);
+        if (it == table.end())
+            it = table.emplace(str, std::hash<std::string>{}(str)).first;
+        return &(*it);
+    }
+
+  public:
+    symbol() {
+        static const entry* empty = intern("");
+        entry_ = empty;
+    }
+    symbol(const std::string& str) : entry_(intern(str)) {}
+    symbol(const char* str) : entry_(intern(str)) {}
+
+    /**
+     * \brief Get the underlying string
+     *
+     * \return Const reference to the interned string
+     */
+    const std::string& str() const { return entry_->first; }
+    operator const std::string&() const { return entry_->first; }
+    operator std::string_view() const { return entry_->first; }
+
+    /**
+     * \brief Get the hash of the underlying string
+     *
+     * \return The value of std::hash<std::string> on the string
+     */
+    std::size_t hash() const { return entry_->second; }
+
+    const char* c_str() const { return str().c_str(); }
+    std::size_t size() const { return str().size(); }
+    bool empty() const { return str().empty(); }
+
+    /** @name Comparison */
+    /**@{*/
+    friend bool operator==(const symbol& a, const symbol& b) {
+        return a.entry_ == b.entry_;
+    }
+    friend bool operator==(const symbol& a, const std::string& b) {
+        return a.str() == b;
+    }
+    friend bool operator==(const std::string& a, const symbol& b) {
+        return a == b.str();
+    }
+    friend bool operator==(const symbol& a, const char* b) {
+        return a.str() == b;
+    }
+    friend bool operator==(const char* a, const symbol& b) {
+        return a == b.str();
+    }
+    template <typename T>
+    friend bool operator!=(const symbol& a, const T& b) {
+        return !(a == b);
+    }
+    friend bool operator!=(const std::string& a, const symbol& b) {
+        return !(a == b);
+    }
+    friend bool operator!=(const char* a, const symbol& b) {
+        return !(a == b);
+    }
+    friend bool operator<(const symbol& a, const symbol& b) {
+        return a.entry_ != b.entry_ && a.str() < b.str();
+    }
+    /**@}*/
+
+    /** @name Concatenation */
+    /**@{*/
+    friend std::string operator+(const symbol& a, const symbol& b) {
+        return a.str() + b.str();
+    }
+    friend std::string operator+(const symbol& a, const std::string& b) {
+        return a.str() + b;
+    }
+    friend std::string operator+(const std::string& a, const symbol& b) {
+        return a + b.str();
+    }
+    friend std::string operator+(const symbol& a, const char* b) {
+        return a.str() + b;
+    }
+    friend std::string operator+(const char* a, const symbol& b) {
+        return a + b.str();
+    }
+    friend std::string operator+(const symbol& a, char b) {
+        return a.str() + b;
+    }
+    friend std::string operator+(char a, const symbol& b) {
+        return a + b.str();
+    }
+    /**@}*/
+
+    friend std::ostream& operator<<(std::ostream& os, const symbol& sym) {
+        return os << sym.str();
+    }
+};
 
 /**
  * \class qasmtools::ast::ASTNode
@@ -64,6 +183,15 @@ class ASTNode : public object::cloneable<ASTNode> {
     ASTNode(parser::Position pos) : uid_(++max_uid_()), pos_(pos) {}
     virtual ~ASTNode() = default;
 
+    /**
+     * \brief Allocates nodes from the current thread's arena, if any
+     * \see qasmtools::ast::Arena
+     */
+    static void* operator new(std::size_t size) {
+        return Arena::allocate_node(size);
+    }
+    static void operator delete(void* p) { Arena::deallocate_node(p); }
+
     /**
      * \brief Get the ID of the node
      *
@@ -105,3 +233,17 @@ class ASTNode : public object::cloneable<ASTNode> {
 
 } // namespace ast
 } // namespace qasmtools
+
+namespace std {
+/**
+ * \brief Hash function for symbols
+ *
+ * Returns the hash cached in the intern table
+ */
+template <>
+struct hash<qasmtools::ast::symbol> {
+    std::size_t operator()(const qasmtools::ast::symbol& sym) const {
+        return sym.hash();
+    }
+};
+} // namespace std
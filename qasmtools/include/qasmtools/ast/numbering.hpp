@@ -0,0 +1,166 @@
+/*
+ * This file is part of qasmtools.
+ *
+ * Copyright (c) 2019 - 2021 softwareQ Inc. All rights reserved.
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * \file qasmtools/ast/numbering.hpp
+ * \brief Dense numbering of variable accesses
+ */
+
+#pragma once
+
+#include "traversal.hpp"
+
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace qasmtools {
+namespace ast {
+
+/**
+ * \class qasmtools::ast::QubitNumbering
+ * \brief Dense integer numbering of variable accesses
+ *
+ * Assigns consecutive IDs to variable accesses so that passes can keep
+ * per-qubit state in flat vectors rather than in hash maps keyed by
+ * variable accesses. Registers added up-front receive a contiguous block of
+ * IDs and are resolved by symbol and offset; any other access -- a whole
+ * register, a gate parameter, an access into an unregistered register -- is
+ * numbered on first use.
+ */
+class QubitNumbering {
+  public:
+    QubitNumbering() = default;
+
+    /**
+     * \brief Program-wide numbering
+     *
+     * Numbers the quantum registers of a program in declaration order, so
+     * that q[i] of the kth register has ID (size of registers 0..k-1) + i.
+     *
+     * \param prog The program
+     */
+    explicit QubitNumbering(Program& prog) {
+        class Registers final : public Traverse {
+            QubitNumbering& numbering_;
+
+          public:
+            Registers(QubitNumbering& numbering) : numbering_(numbering) {}
+            void visit(GateDecl&) override {}
+            void visit(RegisterDecl& decl) override {
+                if (decl.is_quantum())
+                    numbering_.add_register(decl.id(), decl.size());
+            }
+        };
+
+        Registers alg(*this);
+        prog.accept(alg);
+    }
+
+    /**
+     * \brief Reserves a contiguous block of IDs for a register
+     *
+     * \param name The register name
+     * \param size The size of the register
+     */
+    void add_register(const symbol& name, int size) {
+        if (registers_.find(name) != registers_.end())
+            return;
+
+        int base = this->size();
+        registers_.emplace(name, std::make_pair(base, size));
+        for (int i = 0; i < size; i++)
+            accesses_.emplace_back(parser::Position(), name, i);
+    }
+
+    /**
+     * \brief Get the ID of a variable access, numbering it if necessary
+     *
+     * \param va Const reference to a variable access
+     * \return The ID of the access
+     */
+    int index(const VarAccess& va) {
+        if (auto id = find(va))
+            return *id;
+
+        int id = size();
+        others_.emplace(va, id);
+        accesses_.push_back(va);
+        return id;
+    }
+
+    /**
+     * \brief Get the ID of a variable access if it has one
+     *
+     * \param va Const reference to a variable access
+     * \return The ID of the access, or std::nullopt
+     */
+    std::optional<int> find(const VarAccess& va) const {
+        if (auto offset = va.offset()) {
+            auto it = registers_.find(va.var());
+            if (it != registers_.end() && *offset >= 0 &&
+                *offset < it->second.second)
+                return it->second.first + *offset;
+        }
+
+        if (auto it = others_.find(va); it != others_.end())
+            return it->second;
+
+        return std::nullopt;
+    }
+
+    /**
+     * \brief Get the variable access with a given ID
+     *
+     * \param id The ID
+     * \return Const reference to the variable access
+     */
+    const VarAccess& access(int id) const { return accesses_[id]; }
+
+    /**
+     * \brief Get the number of IDs assigned
+     *
+     * \return The number of IDs
+     */
+    int size() const { return static_cast<int>(accesses_.size()); }
+
+    /**
+     * \brief Forget all IDs
+     */
+    void clear() {
+        registers_.clear();
+        others_.clear();
+        accesses_.clear();
+    }
+
+  private:
+    std::unordered_map<symbol, std::pair<int, int>> registers_; ///< base, size
+    std::unordered_map<VarAccess, int> others_; ///< accesses numbered on use
+    std::vector<VarAccess> accesses_;           ///< accesses by ID
+};
+
+} // namespace ast
+} // namespace qasmtools
@@ -78,6 +78,13 @@ class Program : public ASTNode {
      */
     std::list<ptr<Stmt>>& body() { return body_; }
 
+    /**
+     * \brief Whether the program includes the standard library
+     *
+     * \return true if qelib1.inc is included
+     */
+    bool std_include() const { return std_include_; }
+
     /**
      * \brief Get the number of bits
      *
@@ -35,7 +35,9 @@
 #include "expr.hpp"
 #include "var.hpp"
 
+#include <cstdint>
 #include <functional>
+#include <unordered_map>
 #include <vector>
 
 namespace qasmtools {
@@ -526,6 +528,66 @@ class BarrierGate final : public Gate {
     }
 };
 
+/**
+ * \brief Enum of standard library gates
+ *
+ * Identifies applications of the qelib1 gates (and of the Qiskit extensions
+ * r and cswap) so that passes can dispatch on an integer rather than on the
+ * gate name. Any other gate is GateOp::Other.
+ */
+enum class GateOp : std::uint8_t {
+    Other,
+    U3,
+    U2,
+    U1,
+    CX,
+    Id,
+    U0,
+    X,
+    Y,
+    Z,
+    H,
+    S,
+    Sdg,
+    T,
+    Tdg,
+    R,
+    RX,
+    RY,
+    RZ,
+    CZ,
+    CY,
+    Swap,
+    CH,
+    CCX,
+    CSwap,
+    CRZ,
+    CU1,
+    CU3
+};
+
+/**
+ * \brief Looks up the standard library gate with a given name
+ *
+ * \param name The gate name
+ * \return The corresponding gate enum, or GateOp::Other
+ */
+inline GateOp gate_op(const symbol& name) {
+    static const std::unordered_map<symbol, GateOp> table{
+        {"u3", GateOp::U3},   {"u2", GateOp::U2},   {"u1", GateOp::U1},
+        {"cx", GateOp::CX},   {"id", GateOp::Id},   {"u0", GateOp::U0},
+        {"x", GateOp::X},     {"y", GateOp::Y},     {"z", GateOp::Z},
+        {"h", GateOp::H},     {"s", GateOp::S},     {"sdg", GateOp::Sdg},
+        {"t", GateOp::T},     {"tdg", GateOp::Tdg}, {"r", GateOp::R},
+        {"rx", GateOp::RX},   {"ry", GateOp::RY},   {"rz", GateOp::RZ},
+        {"cz", GateOp::CZ},   {"cy", GateOp::CY},   {"swap", GateOp::Swap},
+        {"ch", GateOp::CH},   {"ccx", GateOp::CCX}, {"cswap", GateOp::CSwap},
+        {"crz", GateOp::CRZ}, {"cu1", GateOp::CU1}, {"cu3", GateOp::CU3}};
+
+    auto it = table.find(name);
+    return it == table.end() ? GateOp::Other : it->second;
+}
+
 /**
  * \class qasmtools::ast::DeclaredGate
  * \brief Class for declared gate applications
@@ -533,6 +595,7 @@ class BarrierGate final : public Gate {
  */
 class DeclaredGate final : public Gate {
     symbol name_;                   ///< gate identifier
+    GateOp op_;                     ///< standard gate, resolved from name_
     std::vector<ptr<Expr>> c_args_; ///< list of classical arguments
     std::vector<VarAccess> q_args_; ///< list of quantum arguments
 
@@ -548,8 +611,8 @@ class DeclaredGate final : public Gate {
     DeclaredGate(parser::Position pos, symbol name,
                  std::vector<ptr<Expr>>&& c_args,
                  std::vector<VarAccess>&& q_args)
-        : Gate(pos), name_(name), c_args_(std::move(c_args)),
-          q_args_(std::move(q_args)) {}
+        : Gate(pos), name_(name), op_(gate_op(name_)),
+          c_args_(std::move(c_args)), q_args_(std::move(q_args)) {}
 
     /**
      * \brief Protected heap-allocated construction
@@ -568,6 +631,13 @@ class DeclaredGate final : public Gate {
      */
     const symbol& name() const { return name_; }
 
+    /**
+     * \brief Get the standard library gate being applied
+     *
+     * \return The gate enum, or GateOp::Other if not a standard gate
+     */
+    GateOp op() const { return op_; }
+
     /**
      * \brief Get the number of classical arguments
      *
@@ -180,7 +180,7 @@ namespace std {
 template <>
 struct hash<qasmtools::ast::VarAccess> {
     std::size_t operator()(const qasmtools::ast::VarAccess& v) const {
-        std::size_t lhs = std::hash<std::string>{}(v.var_);
+        std::size_t lhs = std::hash<qasmtools::ast::symbol>{}(v.var_);
         lhs ^= std::hash<std::optional<int>>{}(v.offset_) + 0x9e3779b9 +
                (lhs << 6) + (lhs >> 2);
         return lhs;
@@ -30,18 +30,77 @@
 
 #pragma once
 
+#include <cstdint>
+#include <deque>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 
 namespace qasmtools {
 namespace parser {
 
+/**
+ * \class qasmtools::parser::FileTable
+ * \brief Global table of source file names
+ *
+ * Positions refer to files by index into this table, so that copying a
+ * position does not copy the file name. Index 0 is the empty name.
+ */
+class FileTable {
+    std::mutex mtx_;
+    std::deque<std::string> names_{""}; ///< file names, by index
+    std::unordered_map<std::string, std::uint32_t> index_{{"", 0}};
+
+    FileTable() = default;
+
+  public:
+    /**
+     * \brief Get the global file table
+     *
+     * \return Reference to the file table
+     */
+    static FileTable& instance() {
+        static FileTable table;
+        return table;
+    }
+
+    /**
+     * \brief Get the index of a file name, adding it if necessary
+     *
+     * \param fname Filename
+     * \return The index of the file name
+     */
+    std::uint32_t intern(const std::string& fname) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = index_.find(fname);
+        if (it != index_.end())
+            return it->second;
+
+        auto id = static_cast<std::uint32_t>(names_.size());
+        names_.push_back(fname);
+        index_.emplace(fname, id);
+        return id;
+    }
+
+    /**
+     * \brief Get the file name with a given index
+     *
+     * \param id The index
+     * \return Const reference to the filename
+     */
+    const std::string& name(std::uint32_t id) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return names_[id];
+    }
+};
+
 /**
  * \class qasmtools::parser::Position
  * \brief Positions in source code
  */
 class Position {
-    std::string fname_ = ""; ///< name of the containing file
+    std::uint32_t file_ = 0; ///< index of the containing file
     int line_ = 1;           ///< line number
     int column_ = 1;         ///< column number
 
@@ -59,7 +118,8 @@ class Position {
      * \param column Column number
      */
     Position(const std::string& fname, int line, int column)
-        : fname_(fname), line_(line), column_(column) {}
+        : file_(FileTable::instance().intern(fname)), line_(line),
+          column_(column) {}
 
     /**
      * \brief Extraction operator overload
@@ -69,7 +129,7 @@ class Position {
      * \return Reference to the output stream
      */
     friend std::ostream& operator<<(std::ostream& os, const Position& pos) {
-        os << pos.fname_ << ":" << pos.line_ << ":" << pos.column_;
+        os << pos.get_filename() << ":" << pos.line_ << ":" << pos.column_;
         return os;
     }
 
@@ -78,7 +138,16 @@ class Position {
      *
      * \return Const reference to the filename
      */
-    const std::string& get_filename() const { return fname_; }
+    const std::string& get_filename() const {
+        return FileTable::instance().name(file_);
+    }
+
+    /**
+     * \brief The index of the containing file in the file table
+     *
+     * \return The file index
+     */
+    std::uint32_t get_file_id() const { return file_; }
 
     /**
      * \brief The line of the position
@@ -26,6 +26,8 @@
 
 #include "qasmtools/parser/parser.hpp"
 
+#include "ir/circuit.hpp"
+
 #include "transformations/desugar.hpp"
 #include "transformations/inline.hpp"
 #include "transformations/oracle_synthesizer.hpp"
@@ -33,6 +35,7 @@
 #include "transformations/expression_simplifier.hpp"
 
 #include "optimization/simplify.hpp"
+#include "optimization/single_qubit_fusion.hpp"
 #include "optimization/rotation_folding.hpp"
 #include "optimization/cnot_resynthesis.hpp"
 
@@ -40,7 +43,9 @@
 #include "mapping/layout/basic.hpp"
 #include "mapping/layout/eager.hpp"
 #include "mapping/layout/bestfit.hpp"
+#include "mapping/layout/anneal.hpp"
 #include "mapping/mapping/swap.hpp"
+#include "mapping/mapping/sabre.hpp"
 #include "mapping/mapping/steiner.hpp"
 
 #include "tools/resource_estimator.hpp"
@@ -64,6 +69,8 @@ enum class Pass {
     rotfold,
     cnotsynth,
     simplify,
+    csimplify,
+    fuse,
     map,
     rewrite
 };
@@ -71,13 +78,14 @@ enum class Pass {
 /**
  * \brief Command-line passes
  */
-enum class Option { none, i, S, r, c, s, m, O1, O2, O3 };
+enum class Option { none, i, S, r, c, s, u, m, O1, O2, O3 };
 std::unordered_map<std::string_view, Option> cli_map{
     {"-i", Option::i},   {"--inline", Option::i},
     {"-S", Option::S},   {"--synthesize", Option::S},
     {"-r", Option::r},   {"--rotation-fold", Option::r},
     {"-c", Option::c},   {"--cnot-resynth", Option::c},
     {"-s", Option::s},   {"--simplify", Option::s},
+    {"-u", Option::u},   {"--fuse", Option::u},
     {"-m", Option::m},   {"--map-to-device", Option::m},
     {"-O1", Option::O1}, {"-O2", Option::O2},
     {"-O3", Option::O3}};
@@ -96,6 +104,8 @@ std::string make_passes_str(int width) {
                << "Apply a CNOT optimization pass\n";
     passes_str << std::setw(width) << std::left << "  -s,--simplify"
                << "Apply a simplification pass\n";
+    passes_str << std::setw(width) << std::left << "  -u,--fuse"
+               << "Fuse runs of single-qubit gates\n";
     passes_str << std::setw(width) << std::left << "  -m,--map-to-device"
                << "Map the circuit to a physical device\n";
     passes_str << std::setw(width) << std::left << "  -O1"
@@ -125,7 +135,12 @@ int main(int argc, char** argv) {
     bool no_expand_registers = false;
     bool no_rewrite_expressions = false;
     bool evaluate_all = false;
+    bool arena_stats = false;
+    unsigned threads = 1;
+    double layout_time_budget = 0;
+    std::uint64_t seed = 0;
     std::string device_json;
+    bool cache_device = false;
     std::string input_qasm;
 
     CLI::App app{"staq -- (c) 2019 - 2021 softwareQ Inc. All rights reserved."};
@@ -143,10 +158,10 @@ int main(int argc, char** argv) {
             {"qasm", "quil", "projectq", "qsharp", "cirq", "resources"}));
     app.add_option("-l,--layout", layout_alg,
                    "Initial device layout algorithm. Default=" + layout_alg)
-        ->check(CLI::IsMember({"linear", "eager", "bestfit"}));
+        ->check(CLI::IsMember({"linear", "eager", "bestfit", "anneal"}));
     app.add_option("-M,--mapping-alg", mapper,
                    "Algorithm to use for mapping CNOT gates. Default=" + mapper)
-        ->check(CLI::IsMember({"swap", "steiner"}));
+        ->check(CLI::IsMember({"swap", "sabre", "steiner"}));
     app.add_flag(
         "--disable-layout-optimization", disable_layout_optimization,
         "Disables an expensive layout optimization pass when using the "
@@ -158,9 +173,23 @@ int main(int argc, char** argv) {
                  "Disables evaluation of parameter expressions");
     app.add_flag("--evaluate-all", evaluate_all,
                  "Evaluate all expressions as real numbers");
+    app.add_flag("--arena-stats", arena_stats,
+                 "Report the memory used by the syntax tree on exit");
+    app.add_option("-j,--threads", threads,
+                   "Threads used for CNOT-dihedral synthesis and layout "
+                   "optimization, 0 for all cores. Default=1");
+    app.add_option("--layout-time-budget", layout_time_budget,
+                   "Wall-clock seconds allowed for layout optimization, 0 "
+                   "for no limit. Default=0");
+    app.add_option("--seed", seed,
+                   "Seed for randomized layout algorithms. Default=0");
     CLI::Option* device_opt =
         app.add_option("-d,--device", device_json, "Device to map onto (.json)")
             ->check(CLI::ExistingFile);
+    app.add_flag("--cache-device", cache_device,
+                 "Caches the parsed device and its shortest paths in "
+                 "DEVICE.cache, next to the device file")
+        ->needs(device_opt);
     app.add_option("FILE.qasm", input_qasm, "OpenQASM circuit")
         ->required()
         ->check(CLI::ExistingFile);
@@ -194,6 +223,9 @@ int main(int argc, char** argv) {
             case Option::s:
                 passes.push_back(Pass::simplify);
                 break;
+            case Option::u:
+                passes.push_back(Pass::fuse);
+                break;
             case Option::m:
                 passes.push_back(Pass::map);
                 break;
@@ -205,15 +237,15 @@ int main(int argc, char** argv) {
                 passes.push_back(Pass::inln);
                 passes.push_back(Pass::simplify);
                 passes.push_back(Pass::rotfold);
-                passes.push_back(Pass::simplify);
+                passes.push_back(Pass::csimplify);
                 break;
             case Option::O3:
                 passes.push_back(Pass::inln);
                 passes.push_back(Pass::simplify);
                 passes.push_back(Pass::rotfold);
-                passes.push_back(Pass::simplify);
+                passes.push_back(Pass::csimplify);
                 passes.push_back(Pass::cnotsynth);
-                passes.push_back(Pass::simplify);
+                passes.push_back(Pass::csimplify);
                 break;
             /* Default */
             case Option::none:
@@ -229,8 +261,19 @@ int main(int argc, char** argv) {
     /* Deserialization */
     mapping::Device dev;
     if (*device_opt) {
-        dev = mapping::parse_json(device_json);
+        dev = mapping::parse_json(device_json, cache_device);
+    }
+
+    /* AST allocation */
+    auto arena = qasmtools::ast::Arena::create();
+    if (arena_stats) {
+        arena->set_stats_hook([](const qasmtools::ast::ArenaStats& stats) {
+            std::cerr << "AST arena: " << stats.peak_bytes << " peak bytes, "
+                      << stats.bytes_reserved << " bytes reserved, "
+                      << stats.total_nodes << " nodes allocated\n";
+        });
     }
+    qasmtools::ast::ArenaScope arena_scope(arena);
 
     /* Parsing */
     auto prog = parse_file(input_qasm);
@@ -256,12 +299,28 @@ int main(int argc, char** argv) {
             case Pass::rotfold:
                 optimization::fold_rotations(*prog);
                 break;
-            case Pass::cnotsynth:
-                optimization::optimize_CNOT(*prog);
+            case Pass::cnotsynth: {
+                optimization::CNOTOptimizer::config params;
+                params.threads = threads;
+                optimization::optimize_CNOT(*prog, params);
+                break;
+            }
+            case Pass::simplify: {
+                transformations::expr_simplify(*prog);
+                auto circuit = ir::lower(*prog);
+                optimization::simplify(circuit);
+                prog = ir::raise(circuit);
                 break;
-            case Pass::simplify:
+            }
+            case Pass::csimplify: {
                 transformations::expr_simplify(*prog);
-                optimization::simplify(*prog);
+                auto circuit = ir::lower(*prog);
+                optimization::simplify(circuit, {true, true});
+                prog = ir::raise(circuit);
+                break;
+            }
+            case Pass::fuse:
+                optimization::fuse_single_qubit_gates(*prog);
                 break;
             case Pass::map: {
                 mapped = true;
@@ -283,11 +342,27 @@ int main(int argc, char** argv) {
                 } else if (layout_alg == "bestfit") {
                     initial_layout =
                         mapping::compute_bestfit_layout(dev, *prog);
+                } else if (layout_alg == "anneal") {
+                    mapping::AnnealLayout::config params;
+                    params.cost =
+                        mapper == "steiner"
+                            ? mapping::AnnealLayout::cost_model::steiner
+                            : mapping::AnnealLayout::cost_model::swap;
+                    params.seed = seed;
+                    params.threads = threads;
+                    params.time_budget = layout_time_budget;
+                    initial_layout =
+                        mapping::compute_anneal_layout(dev, *prog, params);
                 }
 
                 /* (Optional) optimize the layout */
-                if (mapper == "steiner" && do_lo)
-                    optimize_steiner_layout(dev, initial_layout, *prog);
+                if (mapper == "steiner" && do_lo) {
+                    mapping::SteinerLayoutOptimizer::config params;
+                    params.threads = threads;
+                    params.time_budget = layout_time_budget;
+                    mapping::optimize_steiner_layout(dev, initial_layout,
+                                                     *prog, params);
+                }
 
                 /* Apply the layout */
                 mapping::apply_layout(initial_layout, dev, *prog);
@@ -295,8 +370,12 @@ int main(int argc, char** argv) {
                 /* Apply the mapping algorithm */
                 if (mapper == "swap") {
                     output_perm = mapping::map_onto_device(dev, *prog);
+                } else if (mapper == "sabre") {
+                    output_perm = mapping::sabre_mapping(dev, *prog);
                 } else if (mapper == "steiner") {
-                    mapping::steiner_mapping(dev, *prog);
+                    mapping::SteinerMapper::config params;
+                    params.threads = threads;
+                    mapping::steiner_mapping(dev, *prog, params);
                 }
                 break;
             }
@@ -365,4 +444,7 @@ int main(int argc, char** argv) {
             os.close();
         }
     }
+
+    /* Bulk teardown */
+    arena->discard(std::move(prog));
 }
@@ -33,7 +33,9 @@
 #include "mapping/layout/basic.hpp"
 #include "mapping/layout/eager.hpp"
 #include "mapping/layout/bestfit.hpp"
+#include "mapping/layout/anneal.hpp"
 #include "mapping/mapping/swap.hpp"
+#include "mapping/mapping/sabre.hpp"
 #include "mapping/mapping/steiner.hpp"
 
 #include <CLI/CLI.hpp>
@@ -58,9 +60,9 @@ int main(int argc, char** argv) {
         app.add_option("-d,--device", device_json, "Device to map onto (.json)")
             ->check(CLI::ExistingFile);
     app.add_option("-l", layout, "Layout algorithm to use. Default=" + layout)
-        ->check(CLI::IsMember({"linear", "eager", "bestfit"}));
+        ->check(CLI::IsMember({"linear", "eager", "bestfit", "anneal"}));
     app.add_option("-m", mapper, "Mapping algorithm to use. Default=" + mapper)
-        ->check(CLI::IsMember({"swap", "steiner"}));
+        ->check(CLI::IsMember({"swap", "sabre", "steiner"}));
     app.add_flag("--evaluate-all", evaluate_all,
                  "Evaluate all expressions as real numbers");
 
@@ -88,12 +90,20 @@ int main(int argc, char** argv) {
             physical_layout = mapping::compute_eager_layout(dev, *program);
         } else if (layout == "bestfit") {
             physical_layout = mapping::compute_bestfit_layout(dev, *program);
+        } else if (layout == "anneal") {
+            mapping::AnnealLayout::config params;
+            if (mapper != "steiner")
+                params.cost = mapping::AnnealLayout::cost_model::swap;
+            physical_layout =
+                mapping::compute_anneal_layout(dev, *program, params);
         }
         mapping::apply_layout(physical_layout, dev, *program);
 
         // Mapping
         if (mapper == "swap") {
             mapping::map_onto_device(dev, *program);
+        } else if (mapper == "sabre") {
+            mapping::sabre_mapping(dev, *program);
         } else if (mapper == "steiner") {
             mapping::steiner_mapping(dev, *program);
         }
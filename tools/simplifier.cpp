@@ -25,6 +25,7 @@
  */
 
 #include "qasmtools/parser/parser.hpp"
+#include "ir/circuit.hpp"
 #include "optimization/simplify.hpp"
 #include "transformations/expression_simplifier.hpp"
 
@@ -35,19 +36,23 @@ int main(int argc, char** argv) {
     using qasmtools::parser::parse_stdin;
 
     bool no_fixpoint = false;
+    bool commute = false;
 
     CLI::App app{"QASM simplifier"};
 
     app.add_flag("--no-fixpoint", no_fixpoint,
                  "Stops the simplifier after one iteration");
+    app.add_flag("--commute", commute,
+                 "Cancels gates separated by commuting gates");
 
     CLI11_PARSE(app, argc, argv);
 
     auto program = parse_stdin();
     if (program) {
         transformations::expr_simplify(*program);
-        optimization::simplify(*program, {!no_fixpoint});
-        std::cout << *program;
+        auto circuit = ir::lower(*program);
+        optimization::simplify(circuit, {!no_fixpoint, commute});
+        std::cout << *ir::raise(circuit);
     } else {
         std::cerr << "Parsing failed\n";
     }
@@ -0,0 +1,94 @@
+#include "gtest/gtest.h"
+#include "qasmtools/parser/parser.hpp"
+
+using namespace qasmtools;
+
+// Testing arena allocation of syntax trees
+static const std::string src = "OPENQASM 2.0;\n"
+                               "include \"qelib1.inc\";\n"
+                               "\n"
+                               "qreg q[2];\n"
+                               "h q[0];\n"
+                               "cx q[0],q[1];\n";
+
+/******************************************************************************/
+TEST(Arena, Allocation) {
+    std::optional<ast::ArenaStats> final_stats;
+    {
+        auto arena = ast::Arena::create();
+        arena->set_stats_hook([&final_stats](const ast::ArenaStats& stats) {
+            final_stats = stats;
+        });
+
+        ast::ptr<ast::Program> program;
+        {
+            ast::ArenaScope scope(arena);
+            program = parser::parse_string(src, "allocation.qasm");
+        }
+
+        EXPECT_GT(arena->stats().live_nodes, 0);
+        EXPECT_GT(arena->stats().bytes_in_use, 0);
+        EXPECT_EQ(arena->stats().bytes_in_use, arena->stats().peak_bytes);
+
+        // Nodes created outside the scope come from the heap
+        auto copy = ast::object::clone(*program);
+        std::size_t peak = arena->stats().peak_bytes;
+        EXPECT_EQ(arena->stats().total_nodes, arena->stats().live_nodes);
+
+        program.reset();
+        EXPECT_EQ(arena->stats().live_nodes, 0);
+        EXPECT_EQ(arena->stats().bytes_in_use, 0);
+        EXPECT_EQ(arena->stats().peak_bytes, peak);
+        EXPECT_FALSE(final_stats);
+    }
+
+    ASSERT_TRUE(final_stats);
+    EXPECT_GT(final_stats->peak_bytes, 0);
+    EXPECT_GE(final_stats->bytes_reserved, final_stats->peak_bytes);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Arena, Lifetime) {
+    bool released = false;
+    ast::ptr<ast::Program> program;
+    {
+        auto arena = ast::Arena::create();
+        arena->set_stats_hook([&released](auto&) { released = true; });
+        ast::ArenaScope scope(arena);
+        program = parser::parse_string(src, "lifetime.qasm");
+    }
+
+    // Live nodes keep the arena alive
+    EXPECT_FALSE(released);
+    std::stringstream ss;
+    ss << *program;
+    EXPECT_EQ(ss.str(), src);
+
+    program.reset();
+    EXPECT_TRUE(released);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Arena, Discard) {
+    bool released = false;
+    {
+        auto arena = ast::Arena::create();
+        arena->set_stats_hook([&released](auto&) { released = true; });
+        ast::ArenaScope scope(arena);
+
+        auto program = parser::parse_string(src, "discard.qasm");
+        auto copy = ast::object::clone(*program);
+        std::size_t live = arena->stats().live_nodes;
+        arena->discard(std::move(program));
+        EXPECT_TRUE(released);
+        EXPECT_EQ(arena->stats().live_nodes, live);
+
+        // Nodes outside the discarded tree may still be freed
+        copy.reset();
+        EXPECT_LT(arena->stats().live_nodes, live);
+        EXPECT_GT(arena->stats().live_nodes, 0);
+    }
+}
+/******************************************************************************/
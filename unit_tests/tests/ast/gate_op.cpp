@@ -0,0 +1,31 @@
+#include "gtest/gtest.h"
+#include "qasmtools/parser/parser.hpp"
+
+using namespace qasmtools;
+
+// Testing resolution of standard gate names to gate enums
+
+/******************************************************************************/
+TEST(GateOp, Resolution) {
+    std::string src = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "gate foo a { h a; }\n"
+                      "qreg q[2];\n"
+                      "cx q[0],q[1];\n"
+                      "tdg q[0];\n"
+                      "foo q[1];\n";
+    auto program = parser::parse_string(src, "gate_op.qasm");
+
+    std::vector<ast::GateOp> ops;
+    program->foreach_stmt([&ops](auto& stmt) {
+        if (auto gate = dynamic_cast<ast::DeclaredGate*>(&stmt))
+            ops.push_back(gate->op());
+    });
+
+    std::vector<ast::GateOp> expected{ast::GateOp::CX, ast::GateOp::Tdg,
+                                      ast::GateOp::Other};
+    EXPECT_EQ(ops, expected);
+    EXPECT_EQ(ast::gate_op("cu3"), ast::GateOp::CU3);
+    EXPECT_EQ(ast::gate_op("U"), ast::GateOp::Other);
+}
+/******************************************************************************/
@@ -0,0 +1,48 @@
+#include "gtest/gtest.h"
+#include "qasmtools/parser/parser.hpp"
+
+using namespace qasmtools;
+
+// Testing interned symbols and dense qubit numbering
+
+/******************************************************************************/
+TEST(Symbol, Interning) {
+    ast::symbol a("q");
+    ast::symbol b(std::string("q"));
+    ast::symbol c("r");
+
+    EXPECT_EQ(a, b);
+    EXPECT_EQ(&a.str(), &b.str());
+    EXPECT_NE(a, c);
+    EXPECT_EQ(a, "q");
+    EXPECT_EQ(std::string("r"), c);
+    EXPECT_TRUE(a < c);
+    EXPECT_EQ(a + "[0]", "q[0]");
+    EXPECT_EQ(std::hash<ast::symbol>{}(a), std::hash<std::string>{}("q"));
+    EXPECT_TRUE(ast::symbol().empty());
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(QubitNumbering, Registers) {
+    std::string src = "OPENQASM 2.0;\n"
+                      "qreg q[2];\n"
+                      "creg c[2];\n"
+                      "qreg r[3];\n";
+    auto program = parser::parse_string(src, "registers.qasm");
+    ast::QubitNumbering qubits(*program);
+
+    parser::Position pos;
+    EXPECT_EQ(qubits.size(), 5);
+    EXPECT_EQ(qubits.find(ast::VarAccess(pos, "q", 1)), 1);
+    EXPECT_EQ(qubits.find(ast::VarAccess(pos, "r", 0)), 2);
+    EXPECT_EQ(qubits.find(ast::VarAccess(pos, "c", 0)), std::nullopt);
+    EXPECT_EQ(qubits.access(4), ast::VarAccess(pos, "r", 2));
+
+    // Accesses outside the registers are numbered on first use
+    EXPECT_EQ(qubits.index(ast::VarAccess(pos, "a")), 5);
+    EXPECT_EQ(qubits.index(ast::VarAccess(pos, "a")), 5);
+    EXPECT_EQ(qubits.index(ast::VarAccess(pos, "q", 0)), 0);
+    EXPECT_EQ(qubits.size(), 6);
+}
+/******************************************************************************/
@@ -111,3 +111,135 @@ TEST(Channel_Rep, Gate_Merge) {
     EXPECT_EQ(t1.try_merge(tdg1.commute_left(x1))->second, s1);
 }
 /******************************************************************************/
+
+// Testing the packed representation over dense qubit indices
+using Packed = gates::ChannelRepr<int>;
+
+/******************************************************************************/
+TEST(Channel_Rep, Packed_Pauli_Arithmetic) {
+    auto i1 = Packed::Pauli::i(1);
+    auto x1 = Packed::Pauli::x(1);
+    auto z1 = Packed::Pauli::z(1);
+    auto y1 = Packed::Pauli::y(1);
+    auto x70 = Packed::Pauli::x(70);
+
+    EXPECT_NE(x1, i1);
+    EXPECT_EQ(x1 * x1, i1);
+    EXPECT_EQ(z1 * z1, i1);
+    EXPECT_EQ(y1 * y1, i1);
+    EXPECT_EQ(x1 * z1, y1 * Packed::IPhase::three);
+    EXPECT_EQ(z1 * x1, y1 * Packed::IPhase::one);
+    EXPECT_EQ(x70 * x70, i1);
+    EXPECT_NE(x1 * x70, x1);
+    EXPECT_TRUE((x1 * x70).is_z() == false);
+    EXPECT_TRUE((z1 * Packed::Pauli::z(130)).is_z());
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Channel_Rep, Packed_Pauli_Commute) {
+    auto x1 = Packed::Pauli::x(1);
+    auto z1 = Packed::Pauli::z(1);
+    auto x64 = Packed::Pauli::x(64);
+    auto z64 = Packed::Pauli::z(64);
+
+    EXPECT_TRUE(x1.commutes_with(x1));
+    EXPECT_FALSE(x1.commutes_with(z1));
+    EXPECT_TRUE(x1.commutes_with(z64));
+    EXPECT_FALSE(x64.commutes_with(z64));
+    EXPECT_TRUE((x1 * z64).commutes_with(z1 * x64));
+    EXPECT_FALSE((x1 * z64).commutes_with(z1));
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Channel_Rep, Packed_Clifford_Arithmetic) {
+    auto x1 = Packed::Pauli::x(1);
+    auto x2 = Packed::Pauli::x(65);
+    auto z1 = Packed::Pauli::z(1);
+    auto z2 = Packed::Pauli::z(65);
+    auto y1 = Packed::Pauli::y(1);
+
+    auto h1 = Packed::Clifford::h(1);
+    auto s1 = Packed::Clifford::s(1);
+    auto sdg1 = Packed::Clifford::sdg(1);
+    auto cnot12 = Packed::Clifford::cnot(1, 65);
+
+    EXPECT_EQ(h1.conjugate(x1), z1);
+    EXPECT_EQ(h1.conjugate(z1), x1);
+    EXPECT_EQ(h1.conjugate(y1), -y1);
+    EXPECT_EQ(s1.conjugate(y1), -x1);
+    EXPECT_EQ((s1 * sdg1).conjugate(y1), y1);
+
+    EXPECT_EQ((h1 * h1).conjugate(x1), x1);
+    EXPECT_EQ((h1 * h1).conjugate(z1), z1);
+    EXPECT_EQ((h1 * h1).conjugate(y1), y1);
+
+    EXPECT_EQ(cnot12.conjugate(x1), x1 * x2);
+    EXPECT_EQ(cnot12.conjugate(x2), x2);
+    EXPECT_EQ(cnot12.conjugate(z1), z1);
+    EXPECT_EQ(cnot12.conjugate(z2), z1 * z2);
+    EXPECT_EQ(cnot12.conjugate(y1), y1 * x2);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Channel_Rep, Packed_Matches_Generic) {
+    auto to_generic = [](const Packed::Pauli& P) {
+        std::unordered_map<std::string, Gates::PauliOp> ops;
+        P.foreach ([&ops](auto& p) {
+            ops[std::to_string(p.first)] =
+                static_cast<Gates::PauliOp>(p.second);
+        });
+        return Gates::Pauli(ops) * static_cast<Gates::IPhase>(P.phase());
+    };
+
+    Packed::Clifford C;
+    Gates::Clifford D;
+    Packed::Pauli P;
+    Gates::Pauli Q;
+
+    // Deterministic pseudo-random gate sequence across a word boundary
+    unsigned seed = 12345;
+    auto next = [&seed](unsigned n) {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) % n;
+    };
+    for (int i = 0; i < 200; i++) {
+        int q = 60 + next(8);
+        int r = 60 + next(8);
+        auto sq = std::to_string(q);
+        switch (next(5)) {
+            case 0:
+                C *= Packed::Clifford::h(q);
+                D *= Gates::Clifford::h(sq);
+                break;
+            case 1:
+                C *= Packed::Clifford::s(q);
+                D *= Gates::Clifford::s(sq);
+                break;
+            case 2:
+                C *= Packed::Clifford::sdg(q);
+                D *= Gates::Clifford::sdg(sq);
+                break;
+            case 3:
+                if (q != r) {
+                    C *= Packed::Clifford::cnot(q, r);
+                    D *= Gates::Clifford::cnot(sq, std::to_string(r));
+                }
+                break;
+            default:
+                P *= Packed::Pauli(std::make_pair(
+                    q, static_cast<Packed::PauliOp>(1 + next(3))));
+                Q = to_generic(P);
+                break;
+        }
+
+        auto R = Packed::Pauli(
+            std::make_pair(r, static_cast<Packed::PauliOp>(1 + next(3))));
+        EXPECT_EQ(to_generic(C.conjugate(P)), D.conjugate(Q));
+        EXPECT_EQ(to_generic(P * R), Q * to_generic(R));
+        EXPECT_EQ(P.commutes_with(R), Q.commutes_with(to_generic(R)));
+    }
+}
+/******************************************************************************/
@@ -0,0 +1,155 @@
+#include "gtest/gtest.h"
+#include "qasmtools/parser/parser.hpp"
+#include "ir/circuit.hpp"
+
+using namespace staq;
+using namespace qasmtools;
+
+// Testing lowering to and raising from the flat circuit representation
+/******************************************************************************/
+TEST(Circuit, Round_Trip) {
+    std::string src = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "gate foo(theta) a,b {\n"
+                      "\tU(theta,0,0) a;\n"
+                      "\tCX a,b;\n"
+                      "}\n"
+                      "qreg q[2];\n"
+                      "qreg p[3];\n"
+                      "creg c[3];\n"
+                      "U(pi/2,0,pi) q[0];\n"
+                      "CX q[1],p[2];\n"
+                      "foo(0.5) q[0],p[1];\n"
+                      "h p;\n"
+                      "barrier q,p[0];\n"
+                      "measure q[1] -> c[0];\n"
+                      "measure p -> c;\n"
+                      "if (c==1) x q[0];\n"
+                      "reset p[1];\n";
+
+    auto program = parser::parse_string(src, "round_trip.qasm");
+    auto circuit = ir::lower(*program);
+    auto raised = ir::raise(circuit);
+
+    std::stringstream pre, post;
+    pre << *program;
+    post << *raised;
+
+    EXPECT_EQ(pre.str(), post.str());
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Circuit, Dense_Operands) {
+    std::string src = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "qreg q[2];\n"
+                      "creg c[1];\n"
+                      "qreg p[3];\n"
+                      "CX q[1],p[2];\n"
+                      "rz(pi/4) p;\n"
+                      "measure p[0] -> c[0];\n";
+
+    auto program = parser::parse_string(src, "dense_operands.qasm");
+    auto circuit = ir::lower(*program);
+
+    // Skip the standard library declarations
+    std::size_t i = 0;
+    while (circuit.opcode(i) == ir::Opcode::Opaque)
+        i++;
+
+    EXPECT_EQ(circuit.num_qubits(), 5);
+    EXPECT_EQ(circuit.num_bits(), 1);
+    ASSERT_EQ(circuit.size(), i + 6);
+
+    EXPECT_EQ(circuit.opcode(i + 3), ir::Opcode::CX);
+    EXPECT_EQ(circuit.qargs(i + 3)[0], 1);
+    EXPECT_EQ(circuit.qargs(i + 3)[1], 4);
+
+    EXPECT_EQ(circuit.opcode(i + 4), ir::Opcode::Gate);
+    EXPECT_EQ(circuit.gate_name(i + 4), "rz");
+    EXPECT_TRUE(ir::Circuit::is_register(circuit.qargs(i + 4)[0]));
+    EXPECT_EQ(ir::Circuit::register_of(circuit.qargs(i + 4)[0]), 2);
+    ASSERT_EQ(circuit.num_params(i + 4), 1);
+    EXPECT_DOUBLE_EQ(*circuit.value(i + 4, 0), utils::pi / 4);
+
+    EXPECT_EQ(circuit.opcode(i + 5), ir::Opcode::Measure);
+    EXPECT_EQ(circuit.qargs(i + 5)[0], 2);
+    EXPECT_EQ(circuit.aux(i + 5), 0);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Circuit, Erase) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "qreg q[2];\n"
+                      "h q[0];\n"
+                      "CX q[0],q[1];\n"
+                      "rx(pi/2) q[1];\n"
+                      "rx(pi) q[1];\n";
+
+    std::string post = "OPENQASM 2.0;\n"
+                       "include \"qelib1.inc\";\n"
+                       "\n"
+                       "qreg q[2];\n"
+                       "CX q[0],q[1];\n"
+                       "rx(pi) q[1];\n";
+
+    auto program = parser::parse_string(pre, "erase.qasm");
+    auto circuit = ir::lower(*program);
+    std::size_t n = circuit.size();
+    circuit.erase(n - 4);
+    circuit.erase(n - 2);
+    circuit.compact();
+
+    ASSERT_EQ(circuit.size(), n - 2);
+    EXPECT_EQ(circuit.opcode(n - 4), ir::Opcode::CX);
+    EXPECT_DOUBLE_EQ(*circuit.value(n - 3, 0), utils::pi);
+
+    std::stringstream ss;
+    ss << *ir::raise(circuit);
+
+    EXPECT_EQ(ss.str(), post);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Circuit, Positions) {
+    std::string src = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "qreg q[2];\n"
+                      "creg c[1];\n"
+                      "h q[0];\n"
+                      "  CX q[0],q[1];\n"
+                      "measure q[1] -> c[0];\n"
+                      "if (c==1)   x q[0];\n";
+
+    // Positions of the statements, and of the statements they guard
+    auto positions = [](ast::Program& prog) {
+        std::vector<std::string> ret;
+        prog.foreach_stmt([&ret](auto& stmt) {
+            std::stringstream ss;
+            ss << stmt.pos();
+            if (auto if_stmt = dynamic_cast<ast::IfStmt*>(&stmt))
+                ss << " " << if_stmt->then().pos();
+            ret.push_back(ss.str());
+        });
+        return ret;
+    };
+
+    auto program = parser::parse_string(src, "positions.qasm");
+    auto circuit = ir::lower(*program);
+    circuit.erase(circuit.size() - 4);
+    circuit.compact();
+    auto raised = ir::raise(circuit);
+
+    auto expected = positions(*program);
+    expected.erase(expected.end() - 4);
+    EXPECT_EQ(positions(*raised), expected);
+}
+/******************************************************************************/
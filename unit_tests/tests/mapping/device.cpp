@@ -1,5 +1,9 @@
 #include "gtest/gtest.h"
 #include "mapping/device.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
 #include <set>
 
 using namespace staq;
@@ -65,6 +69,24 @@ TEST(Device, Shortest_Path) {
 }
 /******************************************************************************/
 
+/******************************************************************************/
+TEST(Device, Distance) {
+    for (int i = 0; i < 9; i++) {
+        for (int j = 0; j < 9; j++) {
+            EXPECT_EQ(test_device.distance(i, j),
+                      static_cast<int>(test_device.shortest_path(i, j).size()) -
+                          1);
+        }
+    }
+
+    mapping::Device disconnected("Disconnected", 3,
+                                 {{0, 1, 0}, {0, 0, 0}, {0, 0, 0}});
+    EXPECT_EQ(disconnected.distance(1, 0), 1);
+    EXPECT_EQ(disconnected.distance(0, 2), -1);
+    EXPECT_EQ(disconnected.distance(2, 2), 0);
+}
+/******************************************************************************/
+
 /******************************************************************************/
 TEST(Device, Shortest_Path_tokyo) {
     mapping::Device test =
@@ -95,3 +117,157 @@ TEST(Device, Steiner_tree) {
                        steiner_edges(tmp4.begin(), tmp4.end())));
 }
 /******************************************************************************/
+
+/******************************************************************************/
+TEST(Device, Steiner_tree_memo) {
+    mapping::Device dev = test_device;
+    auto tree = dev.steiner(std::list<int>({2, 6, 8}), 0);
+
+    // Terminals are a set, so order, duplicates and the root don't matter
+    EXPECT_EQ(dev.steiner(std::list<int>({8, 2, 6}), 0), tree);
+    EXPECT_EQ(dev.steiner(std::list<int>({6, 0, 2, 8, 2}), 0), tree);
+    EXPECT_EQ(dev.steiner(std::list<int>({2, 6, 8}), 0), tree);
+
+    // Each edge leaves a node already in the tree
+    std::set<int> nodes{0};
+    for (auto [ctrl, tgt] : tree) {
+        EXPECT_TRUE(nodes.count(ctrl));
+        EXPECT_TRUE(dev.coupled(ctrl, tgt) || dev.coupled(tgt, ctrl));
+        nodes.insert(tgt);
+    }
+    for (auto t : {2, 6, 8})
+        EXPECT_TRUE(nodes.count(t));
+
+    EXPECT_TRUE(dev.steiner(std::list<int>({}), 4).empty());
+    EXPECT_TRUE(dev.steiner(std::list<int>({4}), 4).empty());
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Device, Steiner_tree_memo_copy) {
+    auto dev = std::make_unique<mapping::Device>(test_device);
+    auto tree = dev->steiner(std::list<int>({2, 6, 8}), 0);
+    auto other = dev->steiner(std::list<int>({3, 5}), 1);
+
+    // Copies keep the memoized trees but must not share them
+    mapping::Device copy = *dev;
+    mapping::Device assigned;
+    assigned = *dev;
+    dev.reset();
+
+    EXPECT_EQ(copy.steiner(std::list<int>({2, 6, 8}), 0), tree);
+    EXPECT_EQ(copy.steiner(std::list<int>({5, 3}), 1), other);
+    EXPECT_EQ(assigned.steiner(std::list<int>({3, 5}), 1), other);
+    EXPECT_EQ(assigned.steiner(std::list<int>({8, 6, 2}), 0), tree);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Device, Large_Lattice) {
+    // 30 x 30 lattice, directed right and down, plus an isolated qubit
+    int w = 30;
+    int n = w * w + 1;
+    std::vector<std::pair<mapping::coupling, double>> edges;
+    for (int i = 0; i < w * w; i++) {
+        if (i % w != w - 1)
+            edges.emplace_back(std::make_pair(i, i + 1), 0.99);
+        if (i + w < w * w)
+            edges.emplace_back(std::make_pair(i, i + w), 0.99);
+    }
+    mapping::Device test("Lattice", n, edges, std::vector<double>(n, 0.999));
+    ASSERT_GT(test.qubits_, mapping::Device::dense_limit);
+
+    EXPECT_TRUE(test.coupled(0, 1));
+    EXPECT_FALSE(test.coupled(1, 0));
+    EXPECT_DOUBLE_EQ(test.tq_fidelity(0, w), 0.99);
+    EXPECT_EQ(test.couplings().size(), edges.size());
+
+    auto adjacent = [&test](int i, int j) {
+        return test.coupled(i, j) || test.coupled(j, i);
+    };
+
+    EXPECT_EQ(test.distance(0, w * w - 1), 2 * (w - 1));
+    EXPECT_EQ(test.distance(w * w - 1, 0), 2 * (w - 1));
+    auto p = test.shortest_path(w - 1, w * (w - 1));
+    EXPECT_EQ(p.size(), 2 * (w - 1) + 1);
+    EXPECT_EQ(p.front(), w - 1);
+    EXPECT_EQ(p.back(), w * (w - 1));
+    for (auto it = p.begin(); std::next(it) != p.end(); it++)
+        EXPECT_TRUE(adjacent(*it, *std::next(it)));
+
+    EXPECT_EQ(test.distance(0, w * w), -1);
+    EXPECT_EQ(test.shortest_path(0, w * w), mapping::path({0}));
+
+    auto tree = test.steiner(std::list<int>({w - 1, w * (w - 1), w * w - 1}),
+                             w * w / 2);
+    std::set<int> nodes{w * w / 2};
+    for (auto& [a, b] : tree) {
+        EXPECT_TRUE(adjacent(a, b));
+        EXPECT_TRUE(nodes.count(a));
+        nodes.insert(b);
+    }
+    EXPECT_TRUE(nodes.count(w - 1));
+    EXPECT_TRUE(nodes.count(w * (w - 1)));
+    EXPECT_TRUE(nodes.count(w * w - 1));
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Device, Cache) {
+    namespace fs = std::filesystem;
+    auto dir = fs::temp_directory_path() / "staq_device_cache_test";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    auto fname = (dir / "tokyo.json").string();
+    fs::copy_file(PROJECT_ROOT_DIR "/qpus/ibm_tokyo.json", fname);
+
+    // First parse writes the cache, second parse reads it
+    mapping::Device parsed = mapping::parse_json(fname, true);
+    ASSERT_TRUE(fs::exists(fname + ".cache"));
+    mapping::Device cached = mapping::parse_json(fname, true);
+    EXPECT_EQ(cached.to_json(), parsed.to_json());
+    for (int i = 0; i < parsed.qubits_; i++) {
+        for (int j = 0; j < parsed.qubits_; j++) {
+            EXPECT_EQ(cached.coupled(i, j), parsed.coupled(i, j));
+            EXPECT_EQ(cached.distance(i, j), parsed.distance(i, j));
+            EXPECT_EQ(cached.shortest_path(i, j), parsed.shortest_path(i, j));
+        }
+    }
+
+    // Successors which loop are rejected, even under the right key
+    {
+        auto n = static_cast<std::size_t>(parsed.qubits_);
+        auto size = fs::file_size(fname + ".cache");
+        std::fstream fs(fname + ".cache",
+                        std::ios::in | std::ios::out | std::ios::binary);
+        std::int32_t loop = 0; // successor of 0 towards 1
+        fs.seekp(size - 2 * n * n * sizeof(std::int32_t) + sizeof(loop));
+        fs.write(reinterpret_cast<const char*>(&loop), sizeof(loop));
+    }
+    mapping::Device repaired = mapping::parse_json(fname, true);
+    EXPECT_EQ(repaired.shortest_path(0, 1), parsed.shortest_path(0, 1));
+
+    // A modified device invalidates the cache
+    mapping::Device line("Line", 3, {{0, 1, 0}, {1, 0, 1}, {0, 1, 0}});
+    std::ofstream(fname) << line.to_json();
+    mapping::Device reparsed = mapping::parse_json(fname, true);
+    EXPECT_EQ(reparsed.qubits_, 3);
+    EXPECT_EQ(mapping::parse_json(fname, true).to_json(), reparsed.to_json());
+
+    // An oversized name is a cache miss rather than an allocation
+    {
+        std::fstream fs(fname + ".cache",
+                        std::ios::in | std::ios::out | std::ios::binary);
+        std::uint32_t name_size = 0xffffffff;
+        fs.seekp(28); // magic, version, byte order, key and size
+        fs.write(reinterpret_cast<const char*>(&name_size), sizeof(name_size));
+    }
+    EXPECT_EQ(mapping::parse_json(fname, true).to_json(), reparsed.to_json());
+
+    // A corrupt cache is ignored
+    std::ofstream(fname + ".cache", std::ios::binary) << "staqdev";
+    EXPECT_EQ(mapping::parse_json(fname, true).to_json(), reparsed.to_json());
+
+    fs::remove_all(dir);
+}
+/******************************************************************************/
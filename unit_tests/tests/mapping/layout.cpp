@@ -5,6 +5,9 @@
 #include "mapping/layout/basic.hpp"
 #include "mapping/layout/eager.hpp"
 #include "mapping/layout/bestfit.hpp"
+#include "mapping/layout/anneal.hpp"
+
+#include <set>
 
 using namespace staq;
 using namespace qasmtools;
@@ -136,3 +139,103 @@ TEST(Layout, Best_Fit) {
     EXPECT_EQ(ss.str(), post);
 }
 /******************************************************************************/
+
+/******************************************************************************/
+TEST(Layout, Anneal) {
+    std::string src = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg orig[9];\n"
+                      "CX orig[0],orig[1];\n"
+                      "CX orig[0],orig[2];\n"
+                      "CX orig[0],orig[3];\n"
+                      "CX orig[0],orig[4];\n"
+                      "CX orig[0],orig[5];\n"
+                      "U(0,0,pi/4) orig[0];\n"
+                      "CX orig[6],orig[7];\n"
+                      "CX orig[7],orig[8];\n"
+                      "CX orig[8],orig[6];\n"
+                      "U(0,0,pi/4) orig[6];\n"
+                      "CX orig[1],orig[8];\n"
+                      "CX orig[4],orig[6];\n";
+
+    auto program = parser::parse_string(src, "layout_anneal.qasm");
+    auto bestfit = mapping::compute_bestfit_layout(test_device, *program);
+
+    auto swap_cost = [program = program.get()](mapping::layout& l) {
+        int ret = 0;
+        auto summary = mapping::summarize_steiner(*program);
+        auto phys = summary.place(l);
+        for (auto& [ctrl, tgt] : summary.ops) {
+            if (ctrl >= 0 && tgt >= 0)
+                ret += test_device.distance(phys[ctrl], phys[tgt]) - 1;
+        }
+        return ret;
+    };
+    auto steiner_cost = [program = program.get()](mapping::layout& l) {
+        mapping::SteinerDry dry(test_device);
+        return dry.get_cnot_count(*program, l);
+    };
+
+    for (auto cost : {mapping::AnnealLayout::cost_model::swap,
+                      mapping::AnnealLayout::cost_model::steiner}) {
+        mapping::AnnealLayout::config params;
+        params.cost = cost;
+        params.seed = 7;
+        params.restarts = 4;
+        params.iterations = 200;
+        auto layout =
+            mapping::compute_anneal_layout(test_device, *program, params);
+
+        // Every qubit is placed on a distinct physical qubit
+        std::set<int> phys;
+        for (auto& [va, i] : layout)
+            phys.insert(i);
+        EXPECT_EQ(layout.size(), 9);
+        EXPECT_EQ(phys.size(), 9);
+
+        // No worse than the first restart's starting point
+        if (cost == mapping::AnnealLayout::cost_model::swap)
+            EXPECT_LE(swap_cost(layout), swap_cost(bestfit));
+        else
+            EXPECT_LE(steiner_cost(layout), steiner_cost(bestfit));
+
+        // Independent of the number of threads
+        params.threads = 3;
+        EXPECT_EQ(
+            mapping::compute_anneal_layout(test_device, *program, params),
+            layout);
+    }
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Layout, Register_Wide) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg a[2];\n"
+                      "qreg b[1];\n"
+                      "creg c[2];\n"
+                      "U(pi,0,pi) a;\n"
+                      "measure a -> c;\n";
+
+    std::string post = "OPENQASM 2.0;\n"
+                       "\n"
+                       "qreg q[9];\n"
+                       "creg c[2];\n"
+                       "U(pi,0,pi) q[2];\n"
+                       "U(pi,0,pi) q[0];\n"
+                       "measure q[2] -> c[0];\n"
+                       "measure q[0] -> c[1];\n";
+
+    auto program = parser::parse_string(pre, "layout_register_wide.qasm");
+    mapping::layout layout{
+        {ast::VarAccess(parser::Position(), "a", 0), 2},
+        {ast::VarAccess(parser::Position(), "a", 1), 0},
+        {ast::VarAccess(parser::Position(), "b", 0), 1}};
+    mapping::apply_layout(layout, test_device, *program);
+    std::stringstream ss;
+    ss << *program;
+
+    EXPECT_EQ(ss.str(), post);
+}
+/******************************************************************************/
@@ -1,8 +1,10 @@
 #include "gtest/gtest.h"
 #include "qasmtools/parser/parser.hpp"
 #include "mapping/device.hpp"
+#include "transformations/desugar.hpp"
 
 #include "mapping/mapping/swap.hpp"
+#include "mapping/mapping/sabre.hpp"
 #include "mapping/mapping/steiner.hpp"
 
 using namespace staq;
@@ -88,6 +90,154 @@ TEST(Swap_Mapper, Shortest_Path) {
 }
 /******************************************************************************/
 
+/******************************************************************************/
+TEST(Swap_Mapper, Register_Wide) {
+    std::string src = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg q[9];\n"
+                      "creg c[9];\n"
+                      "CX q[0],q[6];\n"
+                      "measure q -> c;\n";
+
+    auto program = parser::parse_string(src, "swap_register_wide.qasm");
+    EXPECT_THROW(mapping::map_onto_device(test_device, *program),
+                 std::logic_error);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Sabre_Mapper, Base) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg q[9];\n"
+                      "CX q[0],q[2];\n";
+
+    std::string post = "OPENQASM 2.0;\n"
+                       "\n"
+                       "qreg q[9];\n"
+                       "CX q[0],q[1];\n"
+                       "CX q[1],q[0];\n"
+                       "CX q[0],q[1];\n"
+                       "CX q[1],q[2];\n";
+
+    auto program = parser::parse_string(pre, "sabre_base.qasm");
+    mapping::SabreMapper::config params;
+    params.refinement_passes = 0;
+    auto perm = mapping::sabre_mapping(test_device, *program, params);
+    std::stringstream ss;
+    ss << *program;
+
+    EXPECT_EQ(ss.str(), post);
+    EXPECT_EQ(perm[0], 1);
+    EXPECT_EQ(perm[1], 0);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Sabre_Mapper, Refinement) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg q[9];\n"
+                      "CX q[0],q[2];\n";
+
+    std::string post = "OPENQASM 2.0;\n"
+                       "\n"
+                       "qreg q[9];\n"
+                       "CX q[1],q[2];\n";
+
+    auto program = parser::parse_string(pre, "sabre_refinement.qasm");
+    mapping::SabreMapper mapper(test_device);
+    auto perm = mapper.run(*program);
+    std::stringstream ss;
+    ss << *program;
+
+    EXPECT_EQ(ss.str(), post);
+    EXPECT_EQ(mapper.initial_permutation(), perm);
+    EXPECT_EQ(perm[0], 1);
+    EXPECT_EQ(perm[1], 0);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Sabre_Mapper, Linear_Equivalence) {
+    std::string src = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg q[9];\n"
+                      "creg c[9];\n";
+    int ctrl[] = {0, 8, 2, 6, 1, 4, 3, 7, 0, 5, 2, 8, 6, 3, 1, 7, 4, 0};
+    int tgt[] = {6, 2, 4, 3, 7, 8, 0, 5, 2, 1, 6, 0, 5, 8, 3, 2, 6, 7};
+    for (int i = 0; i < 18; i++) {
+        src += "CX q[" + std::to_string(ctrl[i]) + "],q[" +
+               std::to_string(tgt[i]) + "];\n";
+        src += "U(0,0,pi/4) q[" + std::to_string(tgt[i]) + "];\n";
+    }
+    src += "measure q -> c;\n";
+
+    // Linear reversible function of the CNOT gates of a program, placing
+    // qubit i at init[i] and reading it back from out[i]. The parity held
+    // by each qubit when it is measured is recorded in bits
+    auto linear = [](ast::Program& prog, std::map<int, int> init,
+                     std::map<int, int> out, int& cnots, bool mapped,
+                     std::vector<unsigned>& bits) {
+        std::vector<unsigned> rows(9);
+        for (int i = 0; i < 9; i++)
+            rows[init[i]] = 1u << i;
+        bits.assign(9, 0);
+        cnots = 0;
+        for (auto& stmt : prog.body()) {
+            if (auto cx = dynamic_cast<ast::CNOTGate*>(stmt.get())) {
+                auto c = *cx->ctrl().offset();
+                auto t = *cx->tgt().offset();
+                if (mapped)
+                    EXPECT_TRUE(test_device.coupled(c, t));
+                rows[t] ^= rows[c];
+                cnots++;
+            } else if (auto m = dynamic_cast<ast::MeasureStmt*>(stmt.get())) {
+                if (auto q = m->q_arg().offset()) {
+                    bits[*m->c_arg().offset()] = rows[*q];
+                } else {
+                    for (int i = 0; i < 9; i++)
+                        bits[i] = rows[i];
+                }
+            }
+        }
+        std::vector<unsigned> ret(9);
+        for (int i = 0; i < 9; i++)
+            ret[i] = rows[out[i]];
+        return ret;
+    };
+
+    std::map<int, int> identity;
+    for (int i = 0; i < 9; i++)
+        identity[i] = i;
+
+    int orig_cnots, swap_cnots, sabre_cnots;
+    std::vector<unsigned> expected_bits, swap_bits, sabre_bits;
+    auto program = parser::parse_string(src, "sabre_linear.qasm");
+    auto expected = linear(*program, identity, identity, orig_cnots, false,
+                           expected_bits);
+
+    auto swap_program = parser::parse_string(src, "sabre_linear.qasm");
+    transformations::desugar(*swap_program);
+    mapping::map_onto_device(test_device, *swap_program);
+    linear(*swap_program, identity, identity, swap_cnots, true, swap_bits);
+
+    mapping::SabreMapper mapper(test_device);
+    auto perm = mapper.run(*program);
+    EXPECT_EQ(linear(*program, mapper.initial_permutation(), perm,
+                     sabre_cnots, true, sabre_bits),
+              expected);
+    EXPECT_LE(sabre_cnots, swap_cnots);
+
+    // The register-wide measurement is expanded, and each bit receives the
+    // value its qubit holds where it is measured
+    std::stringstream ss;
+    ss << *program;
+    EXPECT_EQ(ss.str().find("measure q -> c;"), std::string::npos);
+    EXPECT_EQ(sabre_bits, expected_bits);
+}
+/******************************************************************************/
+
 /******************************************************************************/
 TEST(Steiner_Mapper, Base) {
     std::string pre = "OPENQASM 2.0;\n"
@@ -192,3 +342,174 @@ TEST(Steiner_Mapper, Swap_No_Z) {
     EXPECT_EQ(ss.str(), post);
 }
 /******************************************************************************/
+
+/******************************************************************************/
+TEST(Steiner_Mapper, Blocks) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg q[9];\n"
+                      "creg c[9];\n"
+                      "CX q[0],q[1];\n"
+                      "CX q[1],q[4];\n"
+                      "barrier q[1];\n"
+                      "CX q[4],q[7];\n"
+                      "measure q[4] -> c[4];\n"
+                      "CX q[1],q[4];\n";
+
+    std::string post = "OPENQASM 2.0;\n"
+                       "\n"
+                       "qreg q[9];\n"
+                       "creg c[9];\n"
+                       "CX q[0],q[1];\n"
+                       "CX q[1],q[4];\n"
+                       "barrier q[1];\n"
+                       "CX q[4],q[7];\n"
+                       "measure q[4] -> c[4];\n"
+                       "CX q[1],q[4];\n";
+
+    auto program = parser::parse_string(pre, "steiner_blocks.qasm");
+    mapping::steiner_mapping(test_device, *program);
+    std::stringstream ss;
+    ss << *program;
+
+    EXPECT_EQ(ss.str(), post);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Steiner_Mapper, Threads) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg q[9];\n"
+                      "creg c[9];\n"
+                      "CX q[0],q[4];\n"
+                      "U(0,0,pi/4) q[4];\n"
+                      "CX q[8],q[2];\n"
+                      "U(pi/2,0,pi) q[2];\n"
+                      "CX q[2],q[6];\n"
+                      "U(0,0,pi/8) q[6];\n"
+                      "CX q[6],q[0];\n"
+                      "barrier q[0],q[1];\n"
+                      "CX q[3],q[5];\n"
+                      "U(0,0,pi/2) q[5];\n"
+                      "measure q[5] -> c[5];\n"
+                      "CX q[7],q[1];\n"
+                      "if (c==1) U(pi/2,0,pi) q[1];\n"
+                      "CX q[1],q[7];\n"
+                      "U(0,0,pi/4) q[7];\n";
+
+    auto serial = parser::parse_string(pre, "steiner_threads.qasm");
+    mapping::steiner_mapping(test_device, *serial);
+    std::stringstream expected;
+    expected << *serial;
+
+    for (unsigned threads : {0u, 2u, 4u}) {
+        mapping::SteinerMapper::config params;
+        params.threads = threads;
+
+        auto program = parser::parse_string(pre, "steiner_threads.qasm");
+        mapping::steiner_mapping(test_device, *program, params);
+        std::stringstream ss;
+        ss << *program;
+
+        EXPECT_EQ(ss.str(), expected.str());
+    }
+}
+/******************************************************************************/
+
+/******************************************************************************/
+static const std::string steiner_layout_qasm = "OPENQASM 2.0;\n"
+                                               "\n"
+                                               "qreg q[6];\n"
+                                               "CX q[0],q[5];\n"
+                                               "U(0,0,pi/4) q[5];\n"
+                                               "CX q[5],q[3];\n"
+                                               "CX q[1],q[4];\n"
+                                               "U(0,0,pi/4) q[4];\n"
+                                               "U(pi/2,0,pi) q[0];\n"
+                                               "CX q[2],q[0];\n"
+                                               "CX q[0],q[3];\n"
+                                               "U(0,0,pi/2) q[3];\n"
+                                               "CX q[3],q[1];\n"
+                                               "U(pi/2,0,pi) q[5];\n"
+                                               "CX q[4],q[2];\n"
+                                               "CX q[5],q[0];\n"
+                                               "U(0,0,pi/8) q[0];\n";
+
+static mapping::layout steiner_test_layout() {
+    mapping::layout ret;
+    for (int i = 0; i < 6; i++)
+        ret[ast::VarAccess(parser::Position(), "q", i)] = 8 - i;
+    return ret;
+}
+
+TEST(Steiner_Layout, Block_Costs) {
+    auto program = parser::parse_string(steiner_layout_qasm, "blocks.qasm");
+    auto l = steiner_test_layout();
+    mapping::Device device = test_device;
+
+    auto summary = mapping::summarize_steiner(*program);
+    auto blocks = summary.blocks();
+    EXPECT_EQ(blocks.size(), 3);
+
+    auto phys = summary.place(l);
+    int total = 0;
+    for (auto& block : blocks)
+        total += mapping::steiner_cost(block, phys, device);
+
+    mapping::SteinerDry dry(device);
+    EXPECT_EQ(total, dry.get_cnot_count(*program, l));
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Steiner_Layout, Threads) {
+    auto program = parser::parse_string(steiner_layout_qasm, "threads.qasm");
+    mapping::Device device = test_device;
+    mapping::SteinerDry dry(device);
+
+    auto serial = steiner_test_layout();
+    auto before = dry.get_cnot_count(*program, serial);
+    mapping::optimize_steiner_layout(device, serial, *program);
+    EXPECT_LE(dry.get_cnot_count(*program, serial), before);
+
+    for (unsigned threads : {0u, 3u}) {
+        mapping::SteinerLayoutOptimizer::config params;
+        params.threads = threads;
+
+        auto l = steiner_test_layout();
+        mapping::optimize_steiner_layout(device, l, *program, params);
+        EXPECT_EQ(l, serial);
+    }
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Steiner_Layout, Summary) {
+    auto program = parser::parse_string(steiner_layout_qasm, "summary.qasm");
+    auto summary = mapping::summarize_steiner(*program);
+    ASSERT_EQ(summary.qubits.size(), 6);
+    EXPECT_EQ(summary.qubits[5], ast::VarAccess(parser::Position(), "q", 5));
+
+    // CX q[0],q[5]; U(0,0,pi/4) q[5]; ...; U(pi/2,0,pi) q[0];
+    ASSERT_EQ(summary.ops.size(), 15);
+    EXPECT_EQ(summary.ops[0], std::make_pair(0, 5));
+    EXPECT_EQ(summary.ops[1],
+              std::make_pair(5, mapping::steiner_summary::rotation));
+    EXPECT_EQ(summary.ops[5], std::make_pair(mapping::steiner_summary::end,
+                                             mapping::steiner_summary::end));
+    EXPECT_EQ(summary.ops.back(),
+              std::make_pair(mapping::steiner_summary::end,
+                             mapping::steiner_summary::end));
+
+    // Replaying the summary matches a run over the program
+    mapping::Device device = test_device;
+    mapping::SteinerDry dry(device);
+    auto l = steiner_test_layout();
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(dry.get_cnot_count(summary, l),
+                  dry.get_cnot_count(*program, l));
+        std::swap(l.begin()->second, std::next(l.begin())->second);
+    }
+}
+/******************************************************************************/
@@ -100,3 +100,87 @@ TEST(CNOT_resynthesis, Decl_opt) {
     EXPECT_EQ(ss.str(), post);
 }
 /******************************************************************************/
+
+/******************************************************************************/
+TEST(CNOT_resynthesis, Merge_interleaved) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "qreg q[2];\n"
+                      "t q[0];\n"
+                      "cx q[1],q[0];\n"
+                      "t q[0];\n"
+                      "cx q[1],q[0];\n"
+                      "t q[0];\n"
+                      "cx q[1],q[0];\n"
+                      "t q[0];\n"
+                      "cx q[1],q[0];\n";
+
+    std::string post = "OPENQASM 2.0;\n"
+                       "include \"qelib1.inc\";\n"
+                       "\n"
+                       "qreg q[2];\n"
+                       "s q[0];\n"
+                       "cx q[1],q[0];\n"
+                       "s q[0];\n"
+                       "cx q[1],q[0];\n";
+
+    auto program = parser::parse_string(pre, "merge_interleaved.qasm");
+    optimization::optimize_CNOT(*program);
+    std::stringstream ss;
+    ss << *program;
+
+    EXPECT_EQ(ss.str(), post);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(CNOT_resynthesis, Threads) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "gate foo a,b {\n"
+                      "\tcx a,b;\n"
+                      "\tt b;\n"
+                      "\th a;\n"
+                      "\tcx b,a;\n"
+                      "\tt a;\n"
+                      "\tcx b,a;\n"
+                      "}\n"
+                      "qreg q[3];\n"
+                      "creg c[3];\n"
+                      "cx q[0],q[1];\n"
+                      "t q[1];\n"
+                      "cx q[1],q[2];\n"
+                      "s q[2];\n"
+                      "cx q[0],q[1];\n"
+                      "h q[2];\n"
+                      "cx q[2],q[0];\n"
+                      "tdg q[0];\n"
+                      "measure q[1] -> c[1];\n"
+                      "cx q[1],q[2];\n"
+                      "if (c==2) h q[2];\n"
+                      "cx q[2],q[1];\n"
+                      "z q[1];\n"
+                      "foo q[0],q[2];\n"
+                      "cx q[0],q[2];\n"
+                      "t q[2];\n";
+
+    auto serial = parser::parse_string(pre, "threads.qasm");
+    optimization::optimize_CNOT(*serial);
+    std::stringstream expected;
+    expected << *serial;
+
+    for (unsigned threads : {0u, 2u, 4u}) {
+        optimization::CNOTOptimizer::config params;
+        params.threads = threads;
+
+        auto program = parser::parse_string(pre, "threads.qasm");
+        optimization::optimize_CNOT(*program, params);
+        std::stringstream ss;
+        ss << *program;
+
+        EXPECT_EQ(ss.str(), expected.str());
+    }
+}
+/******************************************************************************/
@@ -205,3 +205,41 @@ TEST(Rotation_folding, Global_Phase) {
     EXPECT_EQ(ss.str(), post);
 }
 /******************************************************************************/
+
+/******************************************************************************/
+TEST(Rotation_folding, Disjoint_Support) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "qreg q[3];\n"
+                      "creg c[1];\n"
+                      "t q[0];\n"
+                      "t q[1];\n"
+                      "t q[2];\n"
+                      "h q[2];\n"
+                      "t q[2];\n"
+                      "measure q[1] -> c[0];\n"
+                      "t q[1];\n"
+                      "t q[0];\n";
+
+    std::string post = "OPENQASM 2.0;\n"
+                       "include \"qelib1.inc\";\n"
+                       "\n"
+                       "qreg q[3];\n"
+                       "creg c[1];\n"
+                       "t q[1];\n"
+                       "t q[2];\n"
+                       "h q[2];\n"
+                       "t q[2];\n"
+                       "measure q[1] -> c[0];\n"
+                       "t q[1];\n"
+                       "s q[0];\n";
+
+    auto program = parser::parse_string(pre, "disjoint_support.qasm");
+    optimization::fold_rotations(*program);
+    std::stringstream ss;
+    ss << *program;
+
+    EXPECT_EQ(ss.str(), post);
+}
+/******************************************************************************/
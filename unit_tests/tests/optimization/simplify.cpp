@@ -1,6 +1,7 @@
 #include "gtest/gtest.h"
 #include "qasmtools/parser/parser.hpp"
 #include "optimization/simplify.hpp"
+#include "ir/circuit.hpp"
 
 using namespace staq;
 using namespace qasmtools;
@@ -176,3 +177,190 @@ TEST(Simplify, Nested_Cancellation) {
     EXPECT_EQ(ss.str(), post);
 }
 /******************************************************************************/
+
+/******************************************************************************/
+TEST(Simplify, Nested_Multi_Qubit_Cancellation) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "qreg q[2];\n"
+                      "h q[1];\n"
+                      "cx q[0],q[1];\n"
+                      "t q[0];\n"
+                      "tdg q[0];\n"
+                      "cx q[0],q[1];\n"
+                      "h q[1];\n";
+
+    std::string post = "OPENQASM 2.0;\n"
+                       "include \"qelib1.inc\";\n"
+                       "\n"
+                       "qreg q[2];\n";
+
+    auto program = parser::parse_string(pre, "nested_multi_qubit.qasm");
+    optimization::simplify(*program);
+    std::stringstream ss;
+    ss << *program;
+
+    EXPECT_EQ(ss.str(), post);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Simplify, Nested_No_Fixpoint) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "qreg q[1];\n"
+                      "x q[0];\n"
+                      "z q[0];\n"
+                      "z q[0];\n"
+                      "x q[0];\n";
+
+    std::string post = "OPENQASM 2.0;\n"
+                       "include \"qelib1.inc\";\n"
+                       "\n"
+                       "qreg q[1];\n"
+                       "x q[0];\n"
+                       "x q[0];\n";
+
+    auto program = parser::parse_string(pre, "nested_no_fixpoint.qasm");
+    optimization::simplify(*program, {false});
+    std::stringstream ss;
+    ss << *program;
+
+    EXPECT_EQ(ss.str(), post);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Simplify, Commuting_Cancellation) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "qreg q[3];\n"
+                      "cx q[0],q[1];\n"
+                      "t q[0];\n"
+                      "x q[1];\n"
+                      "cx q[0],q[2];\n"
+                      "cx q[0],q[1];\n";
+
+    std::string post = "OPENQASM 2.0;\n"
+                       "include \"qelib1.inc\";\n"
+                       "\n"
+                       "qreg q[3];\n"
+                       "t q[0];\n"
+                       "x q[1];\n"
+                       "cx q[0],q[2];\n";
+
+    auto program = parser::parse_string(pre, "commuting_cancellation.qasm");
+    optimization::simplify(*program, {true, true});
+    std::stringstream ss;
+    ss << *program;
+
+    EXPECT_EQ(ss.str(), post);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Simplify, Non_Commuting_No_Cancel) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "qreg q[2];\n"
+                      "cx q[0],q[1];\n"
+                      "t q[1];\n"
+                      "h q[0];\n"
+                      "cx q[0],q[1];\n";
+
+    auto program = parser::parse_string(pre, "non_commuting.qasm");
+    optimization::simplify(*program, {true, true});
+    std::stringstream ss;
+    ss << *program;
+
+    EXPECT_EQ(ss.str(), pre);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Simplify, Conditional_No_Cancel) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "qreg q[2];\n"
+                      "creg c[1];\n"
+                      "measure q[0] -> c[0];\n"
+                      "if (c==1) cx q[0],q[1];\n"
+                      "t q[0];\n"
+                      "cx q[0],q[1];\n"
+                      "if (c==1) h q[1];\n"
+                      "h q[1];\n";
+
+    for (auto params : {optimization::Simplifier::config{false, false},
+                        optimization::Simplifier::config{true, false},
+                        optimization::Simplifier::config{true, true}}) {
+        auto program = parser::parse_string(pre, "conditional.qasm");
+        optimization::simplify(*program, params);
+        std::stringstream ss;
+        ss << *program;
+
+        EXPECT_EQ(ss.str(), pre);
+    }
+}
+/******************************************************************************/
+
+// Testing the flat circuit pass against the syntax tree pass
+/******************************************************************************/
+TEST(Simplify, Circuit_Matches_AST) {
+    std::string src = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "gate foo a,b {\n"
+                      "\th a;\n"
+                      "\th a;\n"
+                      "\tcx a,b;\n"
+                      "}\n"
+                      "qreg q[3];\n"
+                      "qreg p[2];\n"
+                      "creg c[2];\n"
+                      "U(0,pi/2,-pi/2) q[0];\n"
+                      "h q[0];\n"
+                      "x q[1];\n"
+                      "cx q[0],q[2];\n"
+                      "t q[0];\n"
+                      "cx q[0],q[2];\n"
+                      "x q[1];\n"
+                      "tdg q[0];\n"
+                      "h q[0];\n"
+                      "rz(0) q[2];\n"
+                      "h p;\n"
+                      "h p;\n"
+                      "h p[0];\n"
+                      "if (c==1) h p[0];\n"
+                      "h p[0];\n"
+                      "foo q[1],p[1];\n"
+                      "barrier q,p[1];\n"
+                      "s q[1];\n"
+                      "sdg q[1];\n"
+                      "CX q[0],q[1];\n"
+                      "cx q[0],q[1];\n"
+                      "measure q[0] -> c[0];\n"
+                      "x q[0];\n"
+                      "reset p;\n"
+                      "x q[0];\n";
+
+    for (auto params : {optimization::Simplifier::config{false, false},
+                        optimization::Simplifier::config{true, false},
+                        optimization::Simplifier::config{true, true}}) {
+        auto program = parser::parse_string(src, "circuit_matches_ast.qasm");
+        auto circuit = ir::lower(*program);
+        optimization::simplify(*program, params);
+        optimization::simplify(circuit, params);
+
+        std::stringstream expected, actual;
+        expected << *program;
+        actual << *ir::raise(circuit);
+
+        EXPECT_EQ(actual.str(), expected.str());
+    }
+}
+/******************************************************************************/
@@ -0,0 +1,86 @@
+#include "gtest/gtest.h"
+#include "qasmtools/parser/parser.hpp"
+#include "optimization/single_qubit_fusion.hpp"
+
+using namespace staq;
+using namespace qasmtools;
+
+// Testing single-qubit gate fusion
+/******************************************************************************/
+TEST(Single_Qubit_Fusion, Identity) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "qreg q[1];\n"
+                      "h q[0];\n"
+                      "s q[0];\n"
+                      "rz(-pi/2) q[0];\n"
+                      "U(pi/2,0,pi) q[0];\n";
+
+    std::string post = "OPENQASM 2.0;\n"
+                       "include \"qelib1.inc\";\n"
+                       "\n"
+                       "qreg q[1];\n";
+
+    auto program = parser::parse_string(pre, "identity.qasm");
+    optimization::fuse_single_qubit_gates(*program);
+    std::stringstream ss;
+    ss << *program;
+
+    EXPECT_EQ(ss.str(), post);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Single_Qubit_Fusion, Fuse_To_U) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "qreg q[2];\n"
+                      "h q[0];\n"
+                      "h q[1];\n"
+                      "s q[0];\n"
+                      "cx q[0],q[1];\n"
+                      "t q[0];\n";
+
+    std::string post = "OPENQASM 2.0;\n"
+                       "include \"qelib1.inc\";\n"
+                       "\n"
+                       "qreg q[2];\n"
+                       "h q[1];\n"
+                       "U(pi/2,pi/2,pi/1) q[0];\n"
+                       "cx q[0],q[1];\n"
+                       "t q[0];\n";
+
+    auto program = parser::parse_string(pre, "fuse_to_u.qasm");
+    optimization::fuse_single_qubit_gates(*program);
+    std::stringstream ss;
+    ss << *program;
+
+    EXPECT_EQ(ss.str(), post);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Single_Qubit_Fusion, Symbolic_Barrier) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "gate foo(theta) a {\n"
+                      "\th a;\n"
+                      "\trz(theta) a;\n"
+                      "\th a;\n"
+                      "}\n"
+                      "qreg q[1];\n"
+                      "h q[0];\n"
+                      "barrier q[0];\n"
+                      "h q[0];\n";
+
+    auto program = parser::parse_string(pre, "symbolic_barrier.qasm");
+    optimization::fuse_single_qubit_gates(*program);
+    std::stringstream ss;
+    ss << *program;
+
+    EXPECT_EQ(ss.str(), pre);
+}
+/******************************************************************************/
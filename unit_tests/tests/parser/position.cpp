@@ -0,0 +1,39 @@
+#include "gtest/gtest.h"
+#include "qasmtools/parser/parser.hpp"
+
+#include <sstream>
+
+using namespace qasmtools;
+
+// Testing source positions and the shared file table
+
+/******************************************************************************/
+TEST(Position, File_Table) {
+    parser::Position a("position.qasm", 3, 7);
+    parser::Position b("position.qasm", 4, 1);
+    parser::Position c("other.qasm", 1, 1);
+
+    EXPECT_EQ(a.get_file_id(), b.get_file_id());
+    EXPECT_NE(a.get_file_id(), c.get_file_id());
+    EXPECT_EQ(&a.get_filename(), &b.get_filename());
+    EXPECT_EQ(c.get_filename(), "other.qasm");
+    EXPECT_EQ(parser::Position().get_filename(), "");
+
+    std::stringstream ss;
+    ss << a;
+    EXPECT_EQ(ss.str(), "position.qasm:3:7");
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Position, Parsed) {
+    std::string src = "OPENQASM 2.0;\n"
+                      "qreg q[1];\n"
+                      "U(0,0,0) q[0];\n";
+    auto program = parser::parse_string(src, "parsed.qasm");
+
+    auto& stmt = *std::next(program->begin(), 1);
+    EXPECT_EQ(stmt->pos().get_filename(), "parsed.qasm");
+    EXPECT_EQ(stmt->pos().get_linenum(), 3);
+}
+/******************************************************************************/
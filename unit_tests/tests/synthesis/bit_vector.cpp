@@ -0,0 +1,105 @@
+#include "gtest/gtest.h"
+#include "synthesis/bit_vector.hpp"
+
+#include <unordered_map>
+
+using namespace staq;
+using synthesis::bit_vector;
+
+// Testing packed bit vectors
+
+/******************************************************************************/
+TEST(Bit_Vector, Access) {
+    bit_vector v(130);
+    EXPECT_EQ(v.size(), 130);
+    EXPECT_FALSE(v.any());
+
+    v.set(0);
+    v.set(64);
+    v[129] = true;
+    EXPECT_TRUE(v[0]);
+    EXPECT_TRUE(v.test(64));
+    EXPECT_TRUE(v[129]);
+    EXPECT_FALSE(v[63]);
+    EXPECT_EQ(v.count(), 3);
+
+    v.flip(64);
+    v.reset(0);
+    EXPECT_FALSE(v[64]);
+    EXPECT_FALSE(v[0]);
+    EXPECT_EQ(v.count(), 1);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Bit_Vector, Construction) {
+    bit_vector a{1, 0, 1};
+    bit_vector b(std::vector<bool>{true, false, true});
+    bit_vector c(70, true);
+
+    EXPECT_EQ(a, b);
+    EXPECT_EQ(c.count(), 70);
+
+    a.push_back(true);
+    EXPECT_EQ(a.size(), 4);
+    EXPECT_NE(a, b);
+    EXPECT_TRUE(a[3]);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Bit_Vector, Row_Operations) {
+    bit_vector a(100);
+    bit_vector b(100);
+    a.set(3);
+    a.set(99);
+    b.set(3);
+    b.set(70);
+
+    a ^= b;
+    EXPECT_FALSE(a[3]);
+    EXPECT_TRUE(a[70]);
+    EXPECT_TRUE(a[99]);
+    EXPECT_EQ(a.count(), 2);
+
+    a.swap(b);
+    EXPECT_TRUE(a[3]);
+    EXPECT_FALSE(b[3]);
+    EXPECT_EQ(a ^ a, bit_vector(100));
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Bit_Vector, Masked_Count) {
+    bit_vector a(130);
+    bit_vector mask(130);
+    for (std::size_t i = 0; i < 130; i += 3)
+        a.set(i);
+    for (std::size_t i = 64; i < 130; i++)
+        mask.set(i);
+
+    EXPECT_EQ(a.count(mask), 22);
+    EXPECT_EQ(a.count(bit_vector(130)), 0);
+    EXPECT_EQ(a.count(a), a.count());
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Bit_Vector, Hash) {
+    std::unordered_map<bit_vector, int> index;
+    bit_vector a(70);
+    a.set(1);
+    a.set(65);
+    bit_vector b(70);
+    b.set(1);
+
+    index[a] = 0;
+    index[b] = 1;
+    b.set(65);
+    EXPECT_EQ(std::hash<bit_vector>{}(a), std::hash<bit_vector>{}(b));
+    EXPECT_EQ(index.at(b), 0);
+
+    b.push_back(false);
+    EXPECT_EQ(index.find(b), index.end());
+}
+/******************************************************************************/
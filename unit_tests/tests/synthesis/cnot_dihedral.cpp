@@ -4,6 +4,9 @@
 #include "qasmtools/utils/templates.hpp"
 #include "qasmtools/ast/expr.hpp"
 
+#include <algorithm>
+#include <cstdlib>
+
 using namespace staq;
 using namespace qasmtools::utils;
 using namespace qasmtools::ast;
@@ -153,6 +156,55 @@ TEST(Gray_Synth, Gray_code) {
 }
 /******************************************************************************/
 
+/******************************************************************************/
+// Enough terms to count splits through the packed columns
+TEST(Gray_Synth, Many_Terms) {
+    std::size_t n = 12;
+    std::srand(7);
+
+    std::list<synthesis::phase_term> f;
+    std::vector<synthesis::bit_vector> parities;
+    for (int t = 0; t < 300; t++) {
+        synthesis::bit_vector vec(n);
+        for (std::size_t i = 0; i < n; i++) {
+            if (std::rand() % 2)
+                vec.set(i);
+        }
+        if (!vec.any())
+            vec.set(t % n);
+        if (std::find(parities.begin(), parities.end(), vec) ==
+            parities.end()) {
+            parities.push_back(vec);
+            f.emplace_back(vec, angle_to_expr(angles::pi_quarter));
+        }
+    }
+
+    synthesis::linear_op<bool> mat(n, synthesis::bit_vector(n));
+    for (std::size_t i = 0; i < n; i++)
+        mat[i].set(i);
+
+    // Track the parity held by each wire
+    auto circuit = synthesis::gray_synth(f, mat);
+    auto state = mat;
+    std::size_t num_rz = 0;
+    for (auto& gate : circuit) {
+        if (auto cx = std::get_if<std::pair<int, int>>(&gate)) {
+            state[cx->second] ^= state[cx->first];
+        } else {
+            auto& [theta, tgt] = std::get<std::pair<ptr<Expr>, int>>(gate);
+            auto it = std::find(parities.begin(), parities.end(), state[tgt]);
+            ASSERT_NE(it, parities.end());
+            parities.erase(it);
+            num_rz++;
+        }
+    }
+
+    EXPECT_TRUE(parities.empty());
+    EXPECT_GT(num_rz, 0);
+    EXPECT_EQ(state, mat);
+}
+/******************************************************************************/
+
 /******************************************************************************/
 // This test should mimic the Steiner_Gauss base case
 TEST(Gray_Steiner, Base) {
@@ -198,6 +250,7 @@ TEST(Gray_Steiner, Base) {
     output.emplace_back(rz(angles::pi, 0));
 
     EXPECT_TRUE(eq(synthesis::gray_steiner(f, mat, test_device), output));
+    EXPECT_EQ(mat, synthesis::identity(8));
 }
 /******************************************************************************/
 
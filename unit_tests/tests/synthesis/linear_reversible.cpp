@@ -152,3 +152,97 @@ TEST(Steiner_Gauss, Swap_Rows_Nonadjacent) {
             {{2, 1}, {1, 0}, {1, 2}, {2, 1}, {0, 1}, {1, 2}, {1, 0}, {2, 1}}));
 }
 /******************************************************************************/
+
+// Applies a CNOT circuit to the identity
+static synthesis::linear_op<bool> simulate(const circuit& c, std::size_t n) {
+    synthesis::linear_op<bool> ret(n, synthesis::bit_vector(n));
+    for (std::size_t i = 0; i < n; i++)
+        ret[i].set(i);
+    for (auto& [ctrl, tgt] : c)
+        ret[tgt] ^= ret[ctrl];
+    return ret;
+}
+
+/******************************************************************************/
+TEST(Steiner_Gauss, In_Place) {
+    std::size_t n = 9;
+    unsigned seed = 1;
+    auto next = [&seed, n]() {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) % n;
+    };
+
+    for (int trial = 0; trial < 10; trial++) {
+        circuit c;
+        for (std::size_t i = 0; i < 4 * n; i++) {
+            auto ctrl = next();
+            auto tgt = next();
+            if (ctrl != tgt)
+                c.emplace_back(ctrl, tgt);
+        }
+        auto mat = simulate(c, n);
+        auto original = mat;
+
+        // The circuit implements the operator, which is left reduced
+        auto gates = synthesis::steiner_gauss(mat, test_device);
+        EXPECT_EQ(simulate(gates, n), original);
+        EXPECT_EQ(mat, synthesis::identity(n));
+        for (auto& [ctrl, tgt] : gates)
+            EXPECT_TRUE(test_device.coupled(ctrl, tgt) ||
+                        test_device.coupled(tgt, ctrl));
+    }
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(PMH_Synthesis, Base) {
+    synthesis::linear_op<bool> mat{
+        {1, 0},
+        {1, 1},
+    };
+    EXPECT_EQ(synthesis::patel_markov_hayes(mat), circuit({{0, 1}}));
+    EXPECT_EQ(synthesis::patel_markov_hayes(mat, 1), circuit({{0, 1}}));
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(PMH_Synthesis, Swap) {
+    synthesis::linear_op<bool> mat{
+        {0, 1},
+        {1, 0},
+    };
+    EXPECT_EQ(simulate(synthesis::patel_markov_hayes(mat), 2), mat);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(PMH_Synthesis, Random) {
+    std::size_t n = 100;
+    unsigned seed = 1;
+    auto next = [&seed, n]() {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) % n;
+    };
+
+    // A random invertible operator from random CNOTs
+    circuit c;
+    for (std::size_t i = 0; i < n * n; i++) {
+        auto ctrl = next();
+        auto tgt = next();
+        if (ctrl != tgt)
+            c.emplace_back(ctrl, tgt);
+    }
+    auto mat = simulate(c, n);
+
+    for (int section_size : {0, 1, 3, 8}) {
+        auto pmh = synthesis::patel_markov_hayes(mat, section_size);
+        EXPECT_EQ(simulate(pmh, n), mat);
+    }
+    EXPECT_LT(synthesis::patel_markov_hayes(mat).size(),
+              synthesis::gauss_jordan(mat).size());
+    EXPECT_EQ(simulate(synthesis::synthesize_linear(
+                        mat, synthesis::LinearSynth::automatic),
+                    n),
+              mat);
+}
+/******************************************************************************/